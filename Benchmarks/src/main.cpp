@@ -0,0 +1,560 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <inttypes.h>
+#include <memory>
+#include <mutex>
+#include <Sockets/ClientSocket.hpp>
+#include <Sockets/LatencyHistogram.hpp>
+#include <Sockets/ServerSocket.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif /* _WIN32 */
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    // This is the IPv4 address of the loopback interface, used to connect
+    // the benchmark clients to the echo server.
+    constexpr uint32_t loopbackAddress = 0x7f000001;
+
+    // These are the settings which control the benchmark, set from the
+    // command line.
+    struct Settings {
+        uint16_t port = 8100;
+        std::string localPath;
+        std::vector< size_t > messageSizes = {16, 256, 4096, 65536, 1048576};
+        std::vector< size_t > connectionCounts = {1, 10, 100};
+        std::vector< size_t > pipelineDepths = {1, 16};
+        double warmUpSeconds = 0.5;
+        double measureSeconds = 2.0;
+        size_t maximumBytesInFlight = 256 * 1048576;
+        bool batch = false;
+        bool compression = false;
+        Sockets::WritePolicy writePolicy = Sockets::WritePolicy::Default;
+        std::chrono::microseconds coalesceWindow{0};
+        bool csv = false;
+    };
+
+    // This holds the results of one benchmark run.
+    struct Result {
+        size_t messageSize = 0;
+        size_t connections = 0;
+        size_t pipelineDepth = 0;
+        double seconds = 0.0;
+        uint64_t messages = 0;
+        Sockets::LatencyHistogram roundTripTimes;
+    };
+
+    // This is the echo server which runs in the same process as the
+    // benchmark clients.  Every message received from a client is sent
+    // right back to it.
+    struct EchoServer {
+        Sockets::ServerSocket server;
+        bool batchedReceive = false;
+        bool compression = false;
+        Sockets::WritePolicy writePolicy = Sockets::WritePolicy::Default;
+        std::chrono::microseconds coalesceWindow{0};
+        std::mutex mutex;
+        std::unordered_set< std::shared_ptr< Sockets::ServerSocket::Client > > clients;
+
+        void OnAcceptClient(
+            std::shared_ptr< Sockets::ServerSocket::Client >&& client
+        ) {
+            std::lock_guard< decltype(mutex) > lock(mutex);
+            const auto clientInsertion = clients.insert(std::move(client));
+            if (!clientInsertion.second) {
+                return;
+            }
+            const auto& newClient = *clientInsertion.first;
+            std::weak_ptr< Sockets::ServerSocket::Client > clientWeak(newClient);
+            newClient->SetBatchedReceive(batchedReceive);
+            (void)newClient->SetCompression(compression);
+            (void)newClient->SetWritePolicy(writePolicy, coalesceWindow);
+            newClient->Start(
+                // onReceived
+                [clientWeak](const std::string& message) {
+                    auto client = clientWeak.lock();
+                    if (!client) {
+                        return;
+                    }
+                    client->SendMessage(message);
+                },
+
+                // onClosed
+                [this, clientWeak]{
+                    auto client = clientWeak.lock();
+                    if (!client) {
+                        return;
+                    }
+                    client->Close();
+                    std::lock_guard< decltype(mutex) > lock(mutex);
+                    (void)clients.erase(client);
+                }
+            );
+        }
+    };
+
+    // This is the state of one benchmark client connection.  The client
+    // keeps a fixed number of messages outstanding (the pipeline depth),
+    // sending a new message every time a complete echo of an earlier one
+    // has been received.
+    struct ClientState {
+        std::mutex mutex;
+        std::condition_variable condition;
+        Sockets::ClientSocket* socket = nullptr;
+        std::string payload;
+        bool batch = false;
+        std::deque< Clock::time_point > outstanding;
+        size_t bytesReceived = 0;
+        bool running = true;
+        bool closed = false;
+        uint64_t messages = 0;
+        Sockets::LatencyHistogram roundTripTimes;
+    };
+
+    // This is set while the benchmark is in its measurement period
+    // (as opposed to warming up or winding down).
+    std::atomic< bool > measuring{false};
+
+    void OnClientReceived(
+        const std::shared_ptr< ClientState >& state,
+        const std::string& message
+    ) {
+        std::lock_guard< decltype(state->mutex) > lock(state->mutex);
+        state->bytesReceived += message.length();
+        const auto now = Clock::now();
+        size_t messagesToSend = 0;
+        while (
+            !state->outstanding.empty()
+            && (state->bytesReceived >= state->payload.length())
+        ) {
+            state->bytesReceived -= state->payload.length();
+            if (measuring) {
+                ++state->messages;
+                state->roundTripTimes.Record(
+                    (uint64_t)std::chrono::duration_cast< std::chrono::nanoseconds >(
+                        now - state->outstanding.front()
+                    ).count()
+                );
+            }
+            state->outstanding.pop_front();
+            if (state->running) {
+                state->outstanding.push_back(Clock::now());
+                if (state->batch) {
+                    ++messagesToSend;
+                } else {
+                    state->socket->SendMessage(state->payload);
+                }
+            }
+        }
+        if (messagesToSend > 0) {
+            state->socket->SendMessages(
+                std::vector< std::string >(messagesToSend, state->payload)
+            );
+        }
+        if (state->outstanding.empty()) {
+            state->condition.notify_all();
+        }
+    }
+
+    void OnClientClosed(const std::shared_ptr< ClientState >& state) {
+        std::lock_guard< decltype(state->mutex) > lock(state->mutex);
+        state->closed = true;
+        state->condition.notify_all();
+    }
+
+    // This function runs a single benchmark with the given message size,
+    // number of connections and pipeline depth.
+    bool RunBenchmark(
+        const Settings& settings,
+        size_t messageSize,
+        size_t connections,
+        size_t pipelineDepth,
+        Result& result
+    ) {
+        // Connect all the clients to the echo server.
+        std::vector< std::unique_ptr< Sockets::ClientSocket > > sockets;
+        std::vector< std::shared_ptr< ClientState > > states;
+        const std::string payload(messageSize, 'x');
+        for (size_t i = 0; i < connections; ++i) {
+            std::unique_ptr< Sockets::ClientSocket > socket(new Sockets::ClientSocket());
+            const auto state = std::make_shared< ClientState >();
+            state->socket = socket.get();
+            state->payload = payload;
+            state->batch = settings.batch;
+            socket->SetBatchedReceive(settings.batch);
+            (void)socket->SetCompression(settings.compression);
+            (void)socket->SetWritePolicy(settings.writePolicy, settings.coalesceWindow);
+            const auto onReceived = [state](const std::string& message){
+                OnClientReceived(state, message);
+            };
+            const auto onClosed = [state]{ OnClientClosed(state); };
+            if (settings.localPath.empty()) {
+                if (
+                    !socket->Bind()
+                    || !socket->Connect(
+                        loopbackAddress,
+                        settings.port,
+                        onReceived,
+                        onClosed
+                    )
+                ) {
+                    return false;
+                }
+            } else if (!socket->Connect(settings.localPath, onReceived, onClosed)) {
+                return false;
+            }
+            sockets.push_back(std::move(socket));
+            states.push_back(state);
+        }
+
+        // Fill every client's pipeline, let things warm up, and then
+        // measure for the configured amount of time.
+        for (const auto& state: states) {
+            std::lock_guard< decltype(state->mutex) > lock(state->mutex);
+            for (size_t i = 0; i < pipelineDepth; ++i) {
+                state->outstanding.push_back(Clock::now());
+                if (!state->batch) {
+                    state->socket->SendMessage(state->payload);
+                }
+            }
+            if (state->batch) {
+                state->socket->SendMessages(
+                    std::vector< std::string >(pipelineDepth, state->payload)
+                );
+            }
+        }
+        std::this_thread::sleep_for(
+            std::chrono::duration< double >(settings.warmUpSeconds)
+        );
+        measuring = true;
+        const auto start = Clock::now();
+        std::this_thread::sleep_for(
+            std::chrono::duration< double >(settings.measureSeconds)
+        );
+        measuring = false;
+        const auto end = Clock::now();
+
+        // Stop sending new messages, wait for the outstanding ones to
+        // come back, and then close all the connections.
+        const auto deadline = Clock::now() + std::chrono::seconds(10);
+        for (const auto& state: states) {
+            std::unique_lock< decltype(state->mutex) > lock(state->mutex);
+            state->running = false;
+            (void)state->condition.wait_until(
+                lock,
+                deadline,
+                [&state]{ return state->outstanding.empty() || state->closed; }
+            );
+        }
+        for (const auto& socket: sockets) {
+            socket->Close();
+        }
+        for (const auto& state: states) {
+            std::unique_lock< decltype(state->mutex) > lock(state->mutex);
+            (void)state->condition.wait_until(
+                lock,
+                deadline,
+                [&state]{ return state->closed; }
+            );
+        }
+
+        // Gather up the results.
+        result.messageSize = messageSize;
+        result.connections = connections;
+        result.pipelineDepth = pipelineDepth;
+        result.seconds = std::chrono::duration< double >(end - start).count();
+        for (const auto& state: states) {
+            std::lock_guard< decltype(state->mutex) > lock(state->mutex);
+            result.messages += state->messages;
+            result.roundTripTimes.Merge(state->roundTripTimes);
+        }
+        return true;
+    }
+
+    void PrintResult(
+        const Settings& settings,
+        const Result& result,
+        bool first
+    ) {
+        const double messagesPerSecond = (
+            (result.seconds > 0.0)
+            ? (double)result.messages / result.seconds
+            : 0.0
+        );
+        const double megabytesPerSecond = (
+            messagesPerSecond * (double)result.messageSize / 1048576.0
+        );
+        const auto& rtt = result.roundTripTimes;
+        if (settings.csv) {
+            if (first) {
+                printf(
+                    "messageSize,connections,pipelineDepth,seconds,messages,"
+                    "messagesPerSecond,megabytesPerSecond,"
+                    "rttP50Microseconds,rttP99Microseconds,"
+                    "rttP999Microseconds,rttMaxMicroseconds\n"
+                );
+            }
+            printf(
+                "%zu,%zu,%zu,%.3f,%" PRIu64 ",%.1f,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+                result.messageSize,
+                result.connections,
+                result.pipelineDepth,
+                result.seconds,
+                result.messages,
+                messagesPerSecond,
+                megabytesPerSecond,
+                (double)rtt.GetPercentile(50.0) / 1000.0,
+                (double)rtt.GetPercentile(99.0) / 1000.0,
+                (double)rtt.GetPercentile(99.9) / 1000.0,
+                (double)rtt.GetMaximum() / 1000.0
+            );
+        } else {
+            printf(
+                "%s  {\"messageSize\": %zu, \"connections\": %zu, "
+                "\"pipelineDepth\": %zu, \"seconds\": %.3f, "
+                "\"messages\": %" PRIu64 ", \"messagesPerSecond\": %.1f, "
+                "\"megabytesPerSecond\": %.3f, "
+                "\"rttP50Microseconds\": %.3f, \"rttP99Microseconds\": %.3f, "
+                "\"rttP999Microseconds\": %.3f, \"rttMaxMicroseconds\": %.3f}",
+                first ? "" : ",\n",
+                result.messageSize,
+                result.connections,
+                result.pipelineDepth,
+                result.seconds,
+                result.messages,
+                messagesPerSecond,
+                megabytesPerSecond,
+                (double)rtt.GetPercentile(50.0) / 1000.0,
+                (double)rtt.GetPercentile(99.0) / 1000.0,
+                (double)rtt.GetPercentile(99.9) / 1000.0,
+                (double)rtt.GetMaximum() / 1000.0
+            );
+        }
+        fflush(stdout);
+    }
+
+    bool ParseList(const char* text, std::vector< size_t >& values) {
+        values.clear();
+        while (*text != '\0') {
+            char* end;
+            const auto value = strtoull(text, &end, 10);
+            if (
+                (end == text)
+                || ((*end != ',') && (*end != '\0'))
+            ) {
+                return false;
+            }
+            values.push_back((size_t)value);
+            text = (*end == ',') ? end + 1 : end;
+        }
+        return !values.empty();
+    }
+
+    bool ParseSettings(int argc, char* argv[], Settings& settings) {
+        for (int i = 1; i < argc; ++i) {
+            const char* argument = argv[i];
+            const char* value = strchr(argument, '=');
+            if (value == NULL) {
+                if (strcmp(argument, "--csv") == 0) {
+                    settings.csv = true;
+                    continue;
+                }
+                if (strcmp(argument, "--batch") == 0) {
+                    settings.batch = true;
+                    continue;
+                }
+                if (strcmp(argument, "--compression") == 0) {
+                    settings.compression = true;
+                    continue;
+                }
+                return false;
+            }
+            const std::string name(argument, value++);
+            if (name == "--sizes") {
+                if (!ParseList(value, settings.messageSizes)) {
+                    return false;
+                }
+            } else if (name == "--connections") {
+                if (!ParseList(value, settings.connectionCounts)) {
+                    return false;
+                }
+            } else if (name == "--depths") {
+                if (!ParseList(value, settings.pipelineDepths)) {
+                    return false;
+                }
+            } else if (name == "--warmup") {
+                settings.warmUpSeconds = atof(value);
+            } else if (name == "--duration") {
+                settings.measureSeconds = atof(value);
+            } else if (name == "--max-in-flight") {
+                settings.maximumBytesInFlight = (size_t)strtoull(value, NULL, 10);
+            } else if (name == "--write-policy") {
+                if (strcmp(value, "default") == 0) {
+                    settings.writePolicy = Sockets::WritePolicy::Default;
+                } else if (strcmp(value, "low-latency") == 0) {
+                    settings.writePolicy = Sockets::WritePolicy::LowLatency;
+                } else if (strcmp(value, "auto-cork") == 0) {
+                    settings.writePolicy = Sockets::WritePolicy::AutoCork;
+                } else {
+                    return false;
+                }
+            } else if (name == "--cork-window") {
+                settings.coalesceWindow = std::chrono::microseconds(atoi(value));
+            } else if (name == "--port") {
+                settings.port = (uint16_t)atoi(value);
+            } else if (name == "--local") {
+                settings.localPath = value;
+            } else if (name == "--format") {
+                if (strcmp(value, "csv") == 0) {
+                    settings.csv = true;
+                } else if (strcmp(value, "json") == 0) {
+                    settings.csv = false;
+                } else {
+                    return false;
+                }
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void PrintUsage() {
+        fprintf(
+            stderr,
+            "usage: Benchmarks [options]\n"
+            "\n"
+            "Measure TCP echo throughput and round-trip time over loopback.\n"
+            "\n"
+            "  --sizes=N,...        message sizes in bytes\n"
+            "                       (default 16,256,4096,65536,1048576)\n"
+            "  --connections=N,...  concurrent connections (default 1,10,100)\n"
+            "  --depths=N,...       messages in flight per connection\n"
+            "                       (default 1,16)\n"
+            "  --warmup=S           seconds to warm up each run (default 0.5)\n"
+            "  --duration=S         seconds to measure each run (default 2)\n"
+            "  --max-in-flight=N    skip runs with more bytes than this in\n"
+            "                       flight at once (default 268435456)\n"
+            "  --batch              send and receive messages in batches\n"
+            "  --compression        compress messages of 256 bytes or more\n"
+            "  --write-policy=P     default, low-latency or auto-cork\n"
+            "                       (default default)\n"
+            "  --cork-window=US     microseconds to hold writes back with\n"
+            "                       the auto-cork policy (default 0)\n"
+            "  --port=N             TCP port for the echo server (default 8100)\n"
+            "  --local=PATH         use a local (Unix domain) socket at this\n"
+            "                       path instead of TCP\n"
+            "  --format=json|csv    output format (default json)\n"
+        );
+    }
+
+    // Each connection uses a few file descriptors, so make sure we're
+    // allowed to have as many as we can.
+    void RaiseFileDescriptorLimit() {
+#ifndef _WIN32
+        struct rlimit limit;
+        if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+            limit.rlim_cur = limit.rlim_max;
+            (void)setrlimit(RLIMIT_NOFILE, &limit);
+        }
+#endif /* _WIN32 */
+    }
+
+}
+
+int main(int argc, char* argv[]) {
+    Settings settings;
+    if (!ParseSettings(argc, argv, settings)) {
+        PrintUsage();
+        return EXIT_FAILURE;
+    }
+    RaiseFileDescriptorLimit();
+
+    // Start the echo server.
+    EchoServer echoServer;
+    echoServer.batchedReceive = settings.batch;
+    echoServer.compression = settings.compression;
+    echoServer.writePolicy = settings.writePolicy;
+    echoServer.coalesceWindow = settings.coalesceWindow;
+    if (
+        settings.localPath.empty()
+        ? !echoServer.server.Bind(settings.port)
+        : !echoServer.server.Bind(settings.localPath)
+    ) {
+        return EXIT_FAILURE;
+    }
+    if (
+        !echoServer.server.Listen(
+            [&echoServer](std::shared_ptr< Sockets::ServerSocket::Client >&& client){
+                echoServer.OnAcceptClient(std::move(client));
+            }
+        )
+    ) {
+        return EXIT_FAILURE;
+    }
+
+    // Run every combination of message size, connection count and
+    // pipeline depth, printing the results as we go.
+    bool first = true;
+    if (!settings.csv) {
+        printf("[\n");
+    }
+    for (const auto messageSize: settings.messageSizes) {
+        for (const auto connections: settings.connectionCounts) {
+            for (const auto pipelineDepth: settings.pipelineDepths) {
+                if (
+                    messageSize * connections * pipelineDepth
+                    > settings.maximumBytesInFlight
+                ) {
+                    fprintf(
+                        stderr,
+                        "Skipping size=%zu connections=%zu depth=%zu "
+                        "(too many bytes in flight).\n",
+                        messageSize,
+                        connections,
+                        pipelineDepth
+                    );
+                    continue;
+                }
+                fprintf(
+                    stderr,
+                    "Running size=%zu connections=%zu depth=%zu...\n",
+                    messageSize,
+                    connections,
+                    pipelineDepth
+                );
+                Result result;
+                if (
+                    !RunBenchmark(
+                        settings,
+                        messageSize,
+                        connections,
+                        pipelineDepth,
+                        result
+                    )
+                ) {
+                    fprintf(stderr, "error: benchmark run failed\n");
+                    return EXIT_FAILURE;
+                }
+                PrintResult(settings, result, first);
+                first = false;
+            }
+        }
+    }
+    if (!settings.csv) {
+        printf("\n]\n");
+    }
+    return EXIT_SUCCESS;
+}
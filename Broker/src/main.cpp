@@ -0,0 +1,311 @@
+#include <atomic>
+#include <chrono>
+#include <inttypes.h>
+#include <memory>
+#include <signal.h>
+#include <Sockets/Broker.hpp>
+#include <Sockets/ClientSocket.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    // This is the IPv4 address of the loopback interface, used to connect
+    // the benchmark subscribers to the broker.
+    constexpr uint32_t loopbackAddress = 0x7f000001;
+
+    // This is the topic used by the benchmark.
+    const std::string benchmarkTopic = "benchmark";
+
+    // These are the settings which control the broker, set from the command
+    // line.
+    struct Settings {
+        uint16_t port = 8200;
+        Sockets::Broker::SlowSubscriberPolicy policy = Sockets::Broker::SlowSubscriberPolicy::Drop;
+        size_t maximumQueueBytes = Sockets::Broker::defaultMaximumQueueBytes;
+        bool benchmark = false;
+        size_t subscribers = 100;
+        size_t messages = 10000;
+        size_t messageSize = 256;
+    };
+
+    // This is one of the clients subscribed to the broker by the benchmark.
+    struct BenchmarkSubscriber {
+        Sockets::ClientSocket client;
+        Sockets::Broker::Decoder decoder;
+        std::atomic< uint64_t > probesReceived{0};
+        std::atomic< uint64_t > messagesReceived{0};
+    };
+
+    // This flag is set by our SIGINT signal handler in order to cause the main
+    // program's polling loop to exit and let the program clean up and
+    // terminate.
+    bool shutDown = false;
+
+    // This function is set up to be called whenever the SIGINT signal
+    // (interrupt signal, typically sent when the user presses <Ctrl>+<C> on
+    // the terminal) is sent to the program.  We just set a flag which is
+    // checked in the program's polling loop to control when the loop is
+    // exited.
+    void OnSigInt(int) {
+        shutDown = true;
+    }
+
+    bool ParseSettings(int argc, char* argv[], Settings& settings) {
+        for (int i = 1; i < argc; ++i) {
+            const char* argument = argv[i];
+            if (strcmp(argument, "--benchmark") == 0) {
+                settings.benchmark = true;
+                continue;
+            }
+            const char* value = strchr(argument, '=');
+            if (value == NULL) {
+                return false;
+            }
+            const std::string name(argument, value++);
+            if (name == "--port") {
+                settings.port = (uint16_t)atoi(value);
+            } else if (name == "--policy") {
+                if (strcmp(value, "drop") == 0) {
+                    settings.policy = Sockets::Broker::SlowSubscriberPolicy::Drop;
+                } else if (strcmp(value, "conflate") == 0) {
+                    settings.policy = Sockets::Broker::SlowSubscriberPolicy::Conflate;
+                } else if (strcmp(value, "disconnect") == 0) {
+                    settings.policy = Sockets::Broker::SlowSubscriberPolicy::Disconnect;
+                } else {
+                    return false;
+                }
+            } else if (name == "--max-queue") {
+                settings.maximumQueueBytes = (size_t)strtoull(value, NULL, 10);
+            } else if (name == "--subscribers") {
+                settings.subscribers = (size_t)strtoull(value, NULL, 10);
+            } else if (name == "--messages") {
+                settings.messages = (size_t)strtoull(value, NULL, 10);
+            } else if (name == "--size") {
+                settings.messageSize = (size_t)strtoull(value, NULL, 10);
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void PrintUsage() {
+        fprintf(
+            stderr,
+            "usage: Broker [options]\n"
+            "\n"
+            "Accept connections and pass messages among them by topic.\n"
+            "\n"
+            "  --port=PORT                  TCP port on which to accept\n"
+            "                               connections (default 8200)\n"
+            "  --policy=POLICY              what to do with messages for a\n"
+            "                               subscriber which has fallen behind:\n"
+            "                               drop, conflate or disconnect\n"
+            "                               (default drop)\n"
+            "  --max-queue=BYTES            how much may be queued for a\n"
+            "                               subscriber before it's considered\n"
+            "                               to have fallen behind\n"
+            "                               (default 1048576)\n"
+            "  --benchmark                  instead of serving, connect\n"
+            "                               subscribers to the broker, publish\n"
+            "                               to them, and report how fast the\n"
+            "                               messages were delivered\n"
+            "  --subscribers=COUNT          number of subscribers for the\n"
+            "                               benchmark (default 100)\n"
+            "  --messages=COUNT             number of messages published by\n"
+            "                               the benchmark (default 10000)\n"
+            "  --size=BYTES                 payload size of messages published\n"
+            "                               by the benchmark (default 256)\n"
+        );
+    }
+
+    void PrintStatistics(const Sockets::BrokerStatistics& statistics) {
+        printf(
+            "%" PRIu64 " subscribers, %" PRIu64 " topics, %" PRIu64 " published, %" PRIu64
+            " delivered, %" PRIu64 " dropped, %" PRIu64 " conflated, %" PRIu64
+            " disconnected\n",
+            statistics.subscribers,
+            statistics.topics,
+            statistics.messagesPublished,
+            statistics.messagesDelivered,
+            statistics.messagesDropped,
+            statistics.messagesConflated,
+            statistics.subscribersDisconnected
+        );
+    }
+
+    int Serve(Sockets::Broker& broker, const Settings& settings) {
+        printf("Now brokering messages on port %" PRIu16 "...\n", settings.port);
+
+        // Poll the flag set by our SIGINT handler, until it is set,
+        // reporting what the broker has done every so often.
+        auto nextReport = Clock::now() + std::chrono::seconds(10);
+        while (!shutDown) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            const auto now = Clock::now();
+            if (now >= nextReport) {
+                PrintStatistics(broker.GetStatistics());
+                nextReport = now + std::chrono::seconds(10);
+            }
+        }
+        printf("Program exiting.\n");
+        return EXIT_SUCCESS;
+    }
+
+    int Benchmark(Sockets::Broker& broker, const Settings& settings) {
+        // Connect the subscribers and subscribe them to the benchmark
+        // topic.
+        std::vector< std::unique_ptr< BenchmarkSubscriber > > subscribers;
+        for (size_t i = 0; i < settings.subscribers; ++i) {
+            std::unique_ptr< BenchmarkSubscriber > subscriber(new BenchmarkSubscriber());
+            const auto subscriberPointer = subscriber.get();
+            if (
+                !subscriber->client.Bind()
+                || !subscriber->client.Connect(
+                    loopbackAddress,
+                    settings.port,
+                    [subscriberPointer](const std::string& message){
+                        (void)subscriberPointer->decoder.Decode(
+                            message,
+                            [subscriberPointer](
+                                Sockets::Broker::Command /* command */,
+                                const std::string& /* topic */,
+                                const std::string& payload
+                            ){
+                                if (payload.empty()) {
+                                    ++subscriberPointer->probesReceived;
+                                } else {
+                                    ++subscriberPointer->messagesReceived;
+                                }
+                            }
+                        );
+                    },
+                    []{}
+                )
+            ) {
+                return EXIT_FAILURE;
+            }
+            subscriber->client.SendMessage(
+                Sockets::Broker::Encode(
+                    Sockets::Broker::Command::Subscribe,
+                    benchmarkTopic
+                )
+            );
+            subscribers.push_back(std::move(subscriber));
+        }
+
+        // Publish empty probe messages until every subscriber has received
+        // one, so that we know all the subscriptions are in place.
+        for (;;) {
+            if (shutDown) {
+                return EXIT_FAILURE;
+            }
+            broker.Publish(benchmarkTopic, std::string());
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            bool ready = true;
+            for (const auto& subscriber: subscribers) {
+                if (subscriber->probesReceived == 0) {
+                    ready = false;
+                    break;
+                }
+            }
+            if (ready) {
+                break;
+            }
+        }
+        const auto baseline = broker.GetStatistics();
+
+        // Publish the messages, and wait until every message has been
+        // delivered, dropped or conflated for each remaining subscriber,
+        // and everything delivered has been received.
+        printf(
+            "Publishing %zu messages of %zu bytes to %zu subscribers...\n",
+            settings.messages,
+            settings.messageSize,
+            settings.subscribers
+        );
+        const std::string payload(settings.messageSize, 'x');
+        const auto start = Clock::now();
+        for (size_t i = 0; i < settings.messages; ++i) {
+            broker.Publish(benchmarkTopic, payload);
+        }
+        uint64_t received = 0;
+        for (;;) {
+            received = 0;
+            for (const auto& subscriber: subscribers) {
+                received += subscriber->messagesReceived;
+            }
+            const auto statistics = broker.GetStatistics();
+            const auto delivered = statistics.messagesDelivered - baseline.messagesDelivered;
+            if (
+                (received >= delivered)
+                && (
+                    (statistics.subscribers == 0)
+                    || (
+                        delivered
+                        + (statistics.messagesDropped - baseline.messagesDropped)
+                        + (statistics.messagesConflated - baseline.messagesConflated)
+                        >= settings.messages * statistics.subscribers
+                    )
+                )
+            ) {
+                break;
+            }
+            if (shutDown) {
+                return EXIT_FAILURE;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        const auto seconds = std::chrono::duration< double >(Clock::now() - start).count();
+
+        // Report the results.
+        PrintStatistics(broker.GetStatistics());
+        printf(
+            "Received %" PRIu64 " messages in %.3f seconds: %.0f messages/s, %.1f MB/s\n",
+            received,
+            seconds,
+            (double)received / seconds,
+            (double)(received * settings.messageSize) / seconds / 1e6
+        );
+        return EXIT_SUCCESS;
+    }
+
+    // This is the function called from the main program in order to operate
+    // the broker while a SIGINT handler is set up to control when the program
+    // should terminate.
+    int InterruptableMain(const Settings& settings) {
+        Sockets::Broker broker;
+        broker.SetSlowSubscriberPolicy(settings.policy, settings.maximumQueueBytes);
+        if (!broker.Listen(settings.port)) {
+            return EXIT_FAILURE;
+        }
+        if (settings.benchmark) {
+            return Benchmark(broker, settings);
+        } else {
+            return Serve(broker, settings);
+        }
+    }
+
+}
+
+int main(int argc, char* argv[]) {
+    Settings settings;
+    if (!ParseSettings(argc, argv, settings)) {
+        PrintUsage();
+        return EXIT_FAILURE;
+    }
+
+    // Catch SIGINT (interrupt signal, typically sent when the user presses
+    // <Ctrl>+<C> on the terminal) during program execution.
+    const auto previousInterruptHandler = signal(SIGINT, OnSigInt);
+    const auto returnValue = InterruptableMain(settings);
+    (void)signal(SIGINT, previousInterruptHandler);
+    return returnValue;
+}
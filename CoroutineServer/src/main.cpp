@@ -0,0 +1,97 @@
+#include <atomic>
+#include <chrono>
+#include <inttypes.h>
+#include <signal.h>
+#include <Sockets/Coroutines.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <utility>
+
+namespace {
+
+    // This is the TCP port number on which to accept new connections.
+    constexpr uint16_t port = 8000;
+
+    // This counts the currently connected clients.
+    std::atomic< size_t > clients{0};
+
+    // This flag is set by our SIGINT signal handler in order to cause the main
+    // program's polling loop to exit and let the program clean up and
+    // terminate.
+    bool shutDown = false;
+
+    // This coroutine handles one client connection from when it's accepted
+    // until it's closed for reading from the other end, at which point the
+    // connection is released when the coroutine finishes.
+    //
+    // Each time the coroutine waits, it's resumed on the connection's own
+    // thread once there's something for it.
+    Sockets::Task HandleClient(Sockets::CoroutineConnection connection) {
+        printf("New connection accepted (%zu total).\n", (size_t)++clients);
+
+        // Send a message to the client to test the server's ability to send a
+        // message as well as the client's ability to receive it.
+        co_await connection.Send("Welcome!");
+
+        // Print each message received until the connection is closed.
+        std::string message;
+        while (co_await connection.Receive(message)) {
+            printf("Received message: %s\n", message.c_str());
+        }
+        printf("Client connection closed (%zu remain).\n", (size_t)--clients);
+    }
+
+    // This coroutine accepts client connections, starting a coroutine to
+    // handle each one.  It's resumed on the listener's thread.
+    Sockets::Task AcceptClients(Sockets::CoroutineListener& listener) {
+        for (;;) {
+            HandleClient(co_await listener.Accept());
+        }
+    }
+
+    // This function is set up to be called whenever the SIGINT signal
+    // (interrupt signal, typically sent when the user presses <Ctrl>+<C> on
+    // the terminal) is sent to the program.  We just set a flag which is
+    // checked in the program's polling loop to control when the loop is
+    // exited.
+    void OnSigInt(int) {
+        shutDown = true;
+    }
+
+    // This is the function called from the main program in order to operate
+    // the socket while a SIGINT handler is set up to control when the program
+    // should terminate.
+    int InterruptableMain() {
+        // Make a socket and assign an address to it.
+        Sockets::CoroutineListener listener;
+        if (!listener.Bind(port)) {
+            return EXIT_FAILURE;
+        }
+
+        // Set up the socket to receive incoming connections.
+        if (!listener.Listen()) {
+            return EXIT_FAILURE;
+        }
+        AcceptClients(listener);
+        printf("Now listening for connections on port %" PRIu16 "...\n", port);
+
+        // Poll the flag set by our SIGINT handler, until it is set.
+        while (!shutDown) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        printf("Program exiting.\n");
+        return EXIT_SUCCESS;
+    }
+
+}
+
+int main(int argc, char* argv[]) {
+    // Catch SIGINT (interrupt signal, typically sent when the user presses
+    // <Ctrl>+<C> on the terminal) during program execution.
+    const auto previousInterruptHandler = signal(SIGINT, OnSigInt);
+    const auto returnValue = InterruptableMain();
+    (void)signal(SIGINT, previousInterruptHandler);
+    return returnValue;
+}
@@ -0,0 +1,515 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <inttypes.h>
+#include <memory>
+#include <mutex>
+#include <Sockets/DatagramSocket.hpp>
+#include <Sockets/LatencyHistogram.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    // This is the IPv4 address of the loopback interface, to which all
+    // datagrams are sent.
+    constexpr uint32_t loopbackAddress = 0x7f000001;
+
+    // Every datagram starts with this header, which the receivers use to
+    // detect lost and reordered datagrams and to measure latency.
+    struct Header {
+        uint32_t sender;
+        uint32_t reserved;
+        uint64_t sequence;
+        uint64_t sentAt;
+    };
+
+    // These are the settings which control the benchmark, set from the
+    // command line.
+    struct Settings {
+        uint16_t port = 8200;
+        std::vector< size_t > payloadSizes = {64, 512, 1472};
+        size_t senders = 1;
+        size_t receivers = 1;
+        double rate = 100000.0;
+        double measureSeconds = 2.0;
+        double drainSeconds = 0.25;
+        uint64_t maximumQueueDepth = 1024;
+        bool findMaximumRate = false;
+        bool csv = false;
+    };
+
+    // This holds the results of one benchmark run.
+    struct Result {
+        size_t payloadSize = 0;
+        double targetRate = 0.0;
+        double seconds = 0.0;
+        uint64_t sent = 0;
+        uint64_t received = 0;
+        uint64_t lost = 0;
+        uint64_t outOfOrder = 0;
+        uint64_t maximumQueueDepth = 0;
+        uint64_t queueFullStalls = 0;
+        Sockets::LatencyHistogram latencies;
+    };
+
+    uint64_t Now() {
+        return (uint64_t)std::chrono::duration_cast< std::chrono::nanoseconds >(
+            Clock::now().time_since_epoch()
+        ).count();
+    }
+
+    // This is the state of one receiving socket.  It tracks, for each
+    // sender, the next sequence number expected, so that gaps and
+    // reordering can be detected.
+    struct ReceiverState {
+        std::mutex mutex;
+        std::vector< uint64_t > nextSequence;
+        uint64_t received = 0;
+        uint64_t outOfOrder = 0;
+        Sockets::LatencyHistogram latencies;
+
+        void OnReceived(const std::string& message) {
+            const auto now = Now();
+            if (message.length() < sizeof(Header)) {
+                return;
+            }
+            Header header;
+            (void)memcpy(&header, message.data(), sizeof(header));
+            std::lock_guard< decltype(mutex) > lock(mutex);
+            if (header.sender >= nextSequence.size()) {
+                return;
+            }
+            ++received;
+            if (header.sequence < nextSequence[header.sender]) {
+                ++outOfOrder;
+            } else {
+                nextSequence[header.sender] = header.sequence + 1;
+            }
+            latencies.Record(now - header.sentAt);
+        }
+    };
+
+    // This is the loop run by a thread for each sending socket.  It sends
+    // datagrams to each receiver in turn, at the requested rate (or as fast
+    // as possible if the rate is zero), holding back whenever the socket's
+    // send queue gets too deep.
+    void SendLoop(
+        const Settings& settings,
+        Sockets::DatagramSocket& socket,
+        uint32_t sender,
+        size_t payloadSize,
+        double ratePerSender,
+        Clock::time_point end,
+        std::vector< uint64_t >& sequences,
+        uint64_t& maximumQueueDepth,
+        uint64_t& queueFullStalls
+    ) {
+        std::string payload(std::max(payloadSize, sizeof(Header)), 'x');
+        const auto start = Clock::now();
+        uint64_t sent = 0;
+        size_t receiver = 0;
+        for (;;) {
+            const auto now = Clock::now();
+            if (now >= end) {
+                break;
+            }
+            if (ratePerSender > 0.0) {
+                const auto due = (uint64_t)(
+                    std::chrono::duration< double >(now - start).count()
+                    * ratePerSender
+                );
+                if (sent >= due) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(50));
+                    continue;
+                }
+            }
+            const auto queueDepth = socket.GetStatistics().sendQueueDepth;
+            maximumQueueDepth = std::max(maximumQueueDepth, queueDepth);
+            if (queueDepth >= settings.maximumQueueDepth) {
+                ++queueFullStalls;
+                std::this_thread::yield();
+                continue;
+            }
+            Header header;
+            header.sender = sender;
+            header.reserved = 0;
+            header.sequence = sequences[receiver]++;
+            header.sentAt = Now();
+            (void)memcpy(&payload[0], &header, sizeof(header));
+            socket.SendMessage(
+                payload,
+                loopbackAddress,
+                (uint16_t)(settings.port + receiver)
+            );
+            ++sent;
+            receiver = (receiver + 1) % settings.receivers;
+        }
+    }
+
+    // This function runs a single benchmark with the given payload size
+    // and total target rate (in datagrams per second).
+    bool RunBenchmark(
+        const Settings& settings,
+        size_t payloadSize,
+        double rate,
+        Result& result
+    ) {
+        // Set up the receiving sockets.
+        std::vector< std::unique_ptr< Sockets::DatagramSocket > > receivers;
+        std::vector< std::shared_ptr< ReceiverState > > receiverStates;
+        for (size_t i = 0; i < settings.receivers; ++i) {
+            std::unique_ptr< Sockets::DatagramSocket > receiver(new Sockets::DatagramSocket());
+            if (!receiver->Bind((uint16_t)(settings.port + i))) {
+                return false;
+            }
+            const auto state = std::make_shared< ReceiverState >();
+            state->nextSequence.resize(settings.senders);
+            receiver->Start(
+                [state](const std::string& message){
+                    state->OnReceived(message);
+                }
+            );
+            receivers.push_back(std::move(receiver));
+            receiverStates.push_back(state);
+        }
+
+        // Set up the sending sockets, and run a thread for each one to
+        // generate datagrams.
+        std::vector< std::unique_ptr< Sockets::DatagramSocket > > senders;
+        for (size_t i = 0; i < settings.senders; ++i) {
+            std::unique_ptr< Sockets::DatagramSocket > sender(new Sockets::DatagramSocket());
+            if (!sender->Bind()) {
+                return false;
+            }
+            sender->Start([](const std::string&){});
+            senders.push_back(std::move(sender));
+        }
+        std::vector< std::vector< uint64_t > > sequences(
+            settings.senders,
+            std::vector< uint64_t >(settings.receivers)
+        );
+        std::vector< uint64_t > maximumQueueDepths(settings.senders);
+        std::vector< uint64_t > queueFullStalls(settings.senders);
+        std::vector< std::thread > threads;
+        const auto start = Clock::now();
+        const auto end = start + std::chrono::duration_cast< Clock::duration >(
+            std::chrono::duration< double >(settings.measureSeconds)
+        );
+        for (size_t i = 0; i < settings.senders; ++i) {
+            threads.emplace_back(
+                SendLoop,
+                std::cref(settings),
+                std::ref(*senders[i]),
+                (uint32_t)i,
+                payloadSize,
+                rate / (double)settings.senders,
+                end,
+                std::ref(sequences[i]),
+                std::ref(maximumQueueDepths[i]),
+                std::ref(queueFullStalls[i])
+            );
+        }
+        for (auto& thread: threads) {
+            thread.join();
+        }
+
+        // Wait for the send queues to empty, and give the receivers a
+        // little extra time to catch up, before tallying the results.
+        const auto drainDeadline = Clock::now() + std::chrono::seconds(5);
+        for (const auto& sender: senders) {
+            while (
+                (sender->GetStatistics().sendQueueDepth > 0)
+                && (Clock::now() < drainDeadline)
+            ) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        const auto sendEnd = Clock::now();
+        std::this_thread::sleep_for(
+            std::chrono::duration< double >(settings.drainSeconds)
+        );
+        result.payloadSize = std::max(payloadSize, sizeof(Header));
+        result.targetRate = rate;
+        result.seconds = std::chrono::duration< double >(sendEnd - start).count();
+        for (size_t i = 0; i < settings.senders; ++i) {
+            for (const auto sequence: sequences[i]) {
+                result.sent += sequence;
+            }
+            result.maximumQueueDepth = std::max(
+                result.maximumQueueDepth,
+                maximumQueueDepths[i]
+            );
+            result.queueFullStalls += queueFullStalls[i];
+        }
+        for (const auto& state: receiverStates) {
+            std::lock_guard< decltype(state->mutex) > lock(state->mutex);
+            result.received += state->received;
+            result.outOfOrder += state->outOfOrder;
+            result.latencies.Merge(state->latencies);
+        }
+        result.lost = (
+            (result.sent > result.received)
+            ? result.sent - result.received
+            : 0
+        );
+        return true;
+    }
+
+    void PrintResult(
+        const Settings& settings,
+        const Result& result,
+        bool first
+    ) {
+        const double packetsPerSecond = (
+            (result.seconds > 0.0)
+            ? (double)result.received / result.seconds
+            : 0.0
+        );
+        const double megabytesPerSecond = (
+            packetsPerSecond * (double)result.payloadSize / 1048576.0
+        );
+        const double dropRate = (
+            (result.sent > 0)
+            ? (double)result.lost / (double)result.sent
+            : 0.0
+        );
+        const auto& latencies = result.latencies;
+        if (settings.csv) {
+            if (first) {
+                printf(
+                    "payloadSize,targetRate,seconds,sent,received,lost,"
+                    "dropRate,outOfOrder,packetsPerSecond,megabytesPerSecond,"
+                    "maximumQueueDepth,queueFullStalls,"
+                    "latencyP50Microseconds,latencyP99Microseconds,"
+                    "latencyP999Microseconds,latencyMaxMicroseconds\n"
+                );
+            }
+            printf(
+                "%zu,%.0f,%.3f,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%.6f,%" PRIu64
+                ",%.1f,%.3f,%" PRIu64 ",%" PRIu64 ",%.3f,%.3f,%.3f,%.3f\n",
+                result.payloadSize,
+                result.targetRate,
+                result.seconds,
+                result.sent,
+                result.received,
+                result.lost,
+                dropRate,
+                result.outOfOrder,
+                packetsPerSecond,
+                megabytesPerSecond,
+                result.maximumQueueDepth,
+                result.queueFullStalls,
+                (double)latencies.GetPercentile(50.0) / 1000.0,
+                (double)latencies.GetPercentile(99.0) / 1000.0,
+                (double)latencies.GetPercentile(99.9) / 1000.0,
+                (double)latencies.GetMaximum() / 1000.0
+            );
+        } else {
+            printf(
+                "%s  {\"payloadSize\": %zu, \"targetRate\": %.0f, "
+                "\"seconds\": %.3f, \"sent\": %" PRIu64 ", "
+                "\"received\": %" PRIu64 ", \"lost\": %" PRIu64 ", "
+                "\"dropRate\": %.6f, \"outOfOrder\": %" PRIu64 ", "
+                "\"packetsPerSecond\": %.1f, \"megabytesPerSecond\": %.3f, "
+                "\"maximumQueueDepth\": %" PRIu64 ", "
+                "\"queueFullStalls\": %" PRIu64 ", "
+                "\"latencyP50Microseconds\": %.3f, "
+                "\"latencyP99Microseconds\": %.3f, "
+                "\"latencyP999Microseconds\": %.3f, "
+                "\"latencyMaxMicroseconds\": %.3f}",
+                first ? "" : ",\n",
+                result.payloadSize,
+                result.targetRate,
+                result.seconds,
+                result.sent,
+                result.received,
+                result.lost,
+                dropRate,
+                result.outOfOrder,
+                packetsPerSecond,
+                megabytesPerSecond,
+                result.maximumQueueDepth,
+                result.queueFullStalls,
+                (double)latencies.GetPercentile(50.0) / 1000.0,
+                (double)latencies.GetPercentile(99.0) / 1000.0,
+                (double)latencies.GetPercentile(99.9) / 1000.0,
+                (double)latencies.GetMaximum() / 1000.0
+            );
+        }
+        fflush(stdout);
+    }
+
+    // This function finds the highest rate at which no datagrams are lost,
+    // by bisecting between a rate known to be lossless and one known to be
+    // lossy (starting from the configured rate and doubling it until loss
+    // is seen).
+    bool FindMaximumRate(
+        const Settings& settings,
+        size_t payloadSize,
+        Result& best,
+        bool& first
+    ) {
+        double low = 0.0;
+        double high = std::max(settings.rate, 1000.0);
+        bool foundLossy = false;
+        for (int trial = 0; trial < 16; ++trial) {
+            const double rate = (
+                foundLossy
+                ? (low + high) / 2.0
+                : high
+            );
+            Result result;
+            if (!RunBenchmark(settings, payloadSize, rate, result)) {
+                return false;
+            }
+            PrintResult(settings, result, first);
+            first = false;
+            if (result.lost == 0) {
+                low = rate;
+                best = result;
+                if (!foundLossy) {
+                    high *= 2.0;
+                }
+            } else {
+                foundLossy = true;
+                high = rate;
+            }
+            if (
+                foundLossy
+                && (high - low <= high * 0.02)
+            ) {
+                break;
+            }
+        }
+        fprintf(
+            stderr,
+            "Highest lossless rate for %zu-byte payloads: %.0f datagrams/sec\n",
+            payloadSize,
+            low
+        );
+        return true;
+    }
+
+    bool ParseList(const char* text, std::vector< size_t >& values) {
+        values.clear();
+        while (*text != '\0') {
+            char* end;
+            const auto value = strtoull(text, &end, 10);
+            if (
+                (end == text)
+                || ((*end != ',') && (*end != '\0'))
+            ) {
+                return false;
+            }
+            values.push_back((size_t)value);
+            text = (*end == ',') ? end + 1 : end;
+        }
+        return !values.empty();
+    }
+
+    bool ParseSettings(int argc, char* argv[], Settings& settings) {
+        for (int i = 1; i < argc; ++i) {
+            const char* argument = argv[i];
+            const char* value = strchr(argument, '=');
+            if (value == NULL) {
+                if (strcmp(argument, "--find-max-rate") == 0) {
+                    settings.findMaximumRate = true;
+                    continue;
+                }
+                return false;
+            }
+            const std::string name(argument, value++);
+            if (name == "--sizes") {
+                if (!ParseList(value, settings.payloadSizes)) {
+                    return false;
+                }
+            } else if (name == "--senders") {
+                settings.senders = std::max((size_t)atoi(value), (size_t)1);
+            } else if (name == "--receivers") {
+                settings.receivers = std::max((size_t)atoi(value), (size_t)1);
+            } else if (name == "--rate") {
+                settings.rate = atof(value);
+            } else if (name == "--duration") {
+                settings.measureSeconds = atof(value);
+            } else if (name == "--max-queue") {
+                settings.maximumQueueDepth = (uint64_t)strtoull(value, NULL, 10);
+            } else if (name == "--port") {
+                settings.port = (uint16_t)atoi(value);
+            } else if (name == "--format") {
+                if (strcmp(value, "csv") == 0) {
+                    settings.csv = true;
+                } else if (strcmp(value, "json") == 0) {
+                    settings.csv = false;
+                } else {
+                    return false;
+                }
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void PrintUsage() {
+        fprintf(
+            stderr,
+            "usage: DatagramBenchmark [options]\n"
+            "\n"
+            "Measure UDP packet rate, loss and latency over loopback.\n"
+            "\n"
+            "  --sizes=N,...      payload sizes in bytes (default 64,512,1472)\n"
+            "  --senders=N        number of sending sockets (default 1)\n"
+            "  --receivers=N      number of receiving sockets (default 1)\n"
+            "  --rate=N           total datagrams per second to send, or 0\n"
+            "                     for as fast as possible (default 100000)\n"
+            "  --duration=S       seconds to send for each run (default 2)\n"
+            "  --max-queue=N      most datagrams to let queue up in a sending\n"
+            "                     socket before holding back (default 1024)\n"
+            "  --find-max-rate    search for the highest rate with no loss,\n"
+            "                     starting from the given rate\n"
+            "  --port=N           first UDP port of the receivers (default 8200)\n"
+            "  --format=json|csv  output format (default json)\n"
+        );
+    }
+
+}
+
+int main(int argc, char* argv[]) {
+    Settings settings;
+    if (!ParseSettings(argc, argv, settings)) {
+        PrintUsage();
+        return EXIT_FAILURE;
+    }
+    bool first = true;
+    if (!settings.csv) {
+        printf("[\n");
+    }
+    for (const auto payloadSize: settings.payloadSizes) {
+        fprintf(stderr, "Running size=%zu...\n", payloadSize);
+        Result result;
+        if (settings.findMaximumRate) {
+            if (!FindMaximumRate(settings, payloadSize, result, first)) {
+                fprintf(stderr, "error: benchmark run failed\n");
+                return EXIT_FAILURE;
+            }
+        } else {
+            if (!RunBenchmark(settings, payloadSize, settings.rate, result)) {
+                fprintf(stderr, "error: benchmark run failed\n");
+                return EXIT_FAILURE;
+            }
+            PrintResult(settings, result, first);
+            first = false;
+        }
+    }
+    if (!settings.csv) {
+        printf("\n]\n");
+    }
+    return EXIT_SUCCESS;
+}
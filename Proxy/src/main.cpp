@@ -0,0 +1,230 @@
+#include <chrono>
+#include <inttypes.h>
+#include <memory>
+#include <mutex>
+#include <signal.h>
+#include <Sockets/Relay.hpp>
+#include <Sockets/ServerSocket.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <unordered_set>
+
+namespace {
+
+    // These are the settings which control the proxy, set from the command
+    // line.
+    struct Settings {
+        uint16_t listenPort = 8100;
+        uint32_t upstreamAddress = 0x7f000001;
+        uint16_t upstreamPort = 8000;
+    };
+
+    // This holds the set of connections currently being relayed.
+    std::unordered_set< std::shared_ptr< Sockets::Relay > > relays;
+
+    // This is used to serialize access to the set of relays.
+    std::mutex mutex;
+
+    // This flag is set by our SIGINT signal handler in order to cause the main
+    // program's polling loop to exit and let the program clean up and
+    // terminate.
+    bool shutDown = false;
+
+    // This function is set up to be called whenever the SIGINT signal
+    // (interrupt signal, typically sent when the user presses <Ctrl>+<C> on
+    // the terminal) is sent to the program.  We just set a flag which is
+    // checked in the program's polling loop to control when the loop is
+    // exited.
+    void OnSigInt(int) {
+        shutDown = true;
+    }
+
+    bool ParseAddress(const char* text, uint32_t& address, uint16_t& port) {
+        unsigned int octets[4];
+        unsigned int portNumber;
+        char extra;
+        if (
+            sscanf(
+                text,
+                "%u.%u.%u.%u:%u%c",
+                &octets[0],
+                &octets[1],
+                &octets[2],
+                &octets[3],
+                &portNumber,
+                &extra
+            ) != 5
+        ) {
+            return false;
+        }
+        address = 0;
+        for (const auto octet: octets) {
+            if (octet > 255) {
+                return false;
+            }
+            address = (address << 8) | octet;
+        }
+        if (portNumber > 65535) {
+            return false;
+        }
+        port = (uint16_t)portNumber;
+        return true;
+    }
+
+    bool ParseSettings(int argc, char* argv[], Settings& settings) {
+        for (int i = 1; i < argc; ++i) {
+            const char* argument = argv[i];
+            const char* value = strchr(argument, '=');
+            if (value == NULL) {
+                return false;
+            }
+            const std::string name(argument, value++);
+            if (name == "--listen") {
+                settings.listenPort = (uint16_t)atoi(value);
+            } else if (name == "--upstream") {
+                if (
+                    !ParseAddress(
+                        value,
+                        settings.upstreamAddress,
+                        settings.upstreamPort
+                    )
+                ) {
+                    return false;
+                }
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void PrintUsage() {
+        fprintf(
+            stderr,
+            "usage: Proxy [options]\n"
+            "\n"
+            "Accept connections and relay them to an upstream server.\n"
+            "\n"
+            "  --listen=PORT                TCP port on which to accept\n"
+            "                               connections (default 8100)\n"
+            "  --upstream=ADDRESS:PORT      IPv4 address and TCP port of the\n"
+            "                               upstream server\n"
+            "                               (default 127.0.0.1:8000)\n"
+        );
+    }
+
+    void OnAcceptClient(
+        std::shared_ptr< Sockets::ServerSocket::Client >&& client,
+        const Settings& settings
+    ) {
+        // Add a relay for the client to the set, before starting it, so
+        // that it's there to be removed if the connection closes right away.
+        const auto relay = std::make_shared< Sockets::Relay >();
+        std::weak_ptr< Sockets::Relay > relayWeak(relay);
+        std::lock_guard< decltype(mutex) > lock(mutex);
+        (void)relays.insert(relay);
+        if (
+            !relay->Start(
+                std::move(client),
+                settings.upstreamAddress,
+                settings.upstreamPort,
+                [relayWeak]{
+                    auto relay = relayWeak.lock();
+                    if (!relay) {
+                        return;
+                    }
+                    const auto statistics = relay->GetStatistics();
+                    std::lock_guard< decltype(mutex) > lock(mutex);
+                    (void)relays.erase(relay);
+                    printf(
+                        "Connection closed after relaying %" PRIu64 " bytes up "
+                        "and %" PRIu64 " bytes down (%zu remain).\n",
+                        statistics.bytesToUpstream,
+                        statistics.bytesToDownstream,
+                        relays.size()
+                    );
+                }
+            )
+        ) {
+            (void)relays.erase(relay);
+            return;
+        }
+        printf("New connection accepted (%zu total).\n", relays.size());
+    }
+
+    // This is the function called from the main program in order to operate
+    // the proxy while a SIGINT handler is set up to control when the program
+    // should terminate.
+    int InterruptableMain(const Settings& settings) {
+        // Make a socket and assign an address to it.
+        auto server = std::make_shared< Sockets::ServerSocket >();
+        if (!server->Bind(settings.listenPort)) {
+            return EXIT_FAILURE;
+        }
+
+        // Set up the socket to receive incoming connections.
+        if (
+            !server->Listen(
+                [&settings](std::shared_ptr< Sockets::ServerSocket::Client >&& client){
+                    OnAcceptClient(std::move(client), settings);
+                }
+            )
+        ) {
+            return EXIT_FAILURE;
+        }
+        printf(
+            "Now relaying connections on port %" PRIu16 " to %" PRIu32 ".%" PRIu32
+            ".%" PRIu32 ".%" PRIu32 ":%" PRIu16 "...\n",
+            settings.listenPort,
+            (settings.upstreamAddress >> 24) & 0xff,
+            (settings.upstreamAddress >> 16) & 0xff,
+            (settings.upstreamAddress >> 8) & 0xff,
+            settings.upstreamAddress & 0xff,
+            settings.upstreamPort
+        );
+
+        // Poll the flag set by our SIGINT handler, until it is set.
+        while (!shutDown) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+
+        // Stop accepting connections, and then stop relaying the ones we
+        // have.  The relays are released outside of the lock, since their
+        // workers may be waiting for it to remove themselves from the set.
+        server.reset();
+        decltype(relays) remainingRelays;
+        {
+            std::lock_guard< decltype(mutex) > lock(mutex);
+            remainingRelays.swap(relays);
+        }
+        for (const auto& relay: remainingRelays) {
+            relay->Stop();
+        }
+        remainingRelays.clear();
+        printf("Program exiting.\n");
+        return EXIT_SUCCESS;
+    }
+
+}
+
+int main(int argc, char* argv[]) {
+    Settings settings;
+    if (!ParseSettings(argc, argv, settings)) {
+        PrintUsage();
+        return EXIT_FAILURE;
+    }
+
+    // Relays write to sockets which the other end may have closed, so
+    // broken pipes are to be expected and handled as errors.
+    (void)signal(SIGPIPE, SIG_IGN);
+
+    // Catch SIGINT (interrupt signal, typically sent when the user presses
+    // <Ctrl>+<C> on the terminal) during program execution.
+    const auto previousInterruptHandler = signal(SIGINT, OnSigInt);
+    const auto returnValue = InterruptableMain(settings);
+    (void)signal(SIGINT, previousInterruptHandler);
+    return returnValue;
+}
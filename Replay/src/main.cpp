@@ -0,0 +1,294 @@
+#include <atomic>
+#include <chrono>
+#include <inttypes.h>
+#include <memory>
+#include <signal.h>
+#include <Sockets/Capture.hpp>
+#include <Sockets/ClientSocket.hpp>
+#include <Sockets/DatagramSocket.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    // This is how long to wait, once everything has been sent, for the
+    // connections to finish sending and for replies to arrive.
+    constexpr auto drainTimeout = std::chrono::seconds(5);
+
+    // These are the settings which control the replay, set from the command
+    // line.
+    struct Settings {
+        std::string capturePath;
+        uint32_t targetAddress = 0x7f000001;
+        uint16_t targetPort = 8000;
+        double speed = 1.0;
+        Sockets::Capture::Direction direction = Sockets::Capture::Direction::Inbound;
+    };
+
+    // This is a connection to the target, standing in for one of the
+    // connections in the capture.
+    struct Stream {
+        Sockets::ClientSocket client;
+        bool connected = false;
+    };
+
+    // This flag is set by our SIGINT signal handler in order to cause the main
+    // program's replay loop to exit and let the program clean up and
+    // terminate.
+    bool shutDown = false;
+
+    // These count what the target sent back.
+    std::atomic< uint64_t > bytesReceived{0};
+    std::atomic< uint64_t > connectionsClosed{0};
+
+    // This function is set up to be called whenever the SIGINT signal
+    // (interrupt signal, typically sent when the user presses <Ctrl>+<C> on
+    // the terminal) is sent to the program.  We just set a flag which is
+    // checked in the program's replay loop to control when the loop is
+    // exited.
+    void OnSigInt(int) {
+        shutDown = true;
+    }
+
+    bool ParseAddress(const char* text, uint32_t& address, uint16_t& port) {
+        unsigned int octets[4];
+        unsigned int portNumber;
+        char extra;
+        if (
+            sscanf(
+                text,
+                "%u.%u.%u.%u:%u%c",
+                &octets[0],
+                &octets[1],
+                &octets[2],
+                &octets[3],
+                &portNumber,
+                &extra
+            ) != 5
+        ) {
+            return false;
+        }
+        address = 0;
+        for (const auto octet: octets) {
+            if (octet > 255) {
+                return false;
+            }
+            address = (address << 8) | octet;
+        }
+        if (portNumber > 65535) {
+            return false;
+        }
+        port = (uint16_t)portNumber;
+        return true;
+    }
+
+    bool ParseSettings(int argc, char* argv[], Settings& settings) {
+        for (int i = 1; i < argc; ++i) {
+            const char* argument = argv[i];
+            const char* value = strchr(argument, '=');
+            if (value == NULL) {
+                return false;
+            }
+            const std::string name(argument, value++);
+            if (name == "--capture") {
+                settings.capturePath = value;
+            } else if (name == "--target") {
+                if (
+                    !ParseAddress(
+                        value,
+                        settings.targetAddress,
+                        settings.targetPort
+                    )
+                ) {
+                    return false;
+                }
+            } else if (name == "--speed") {
+                settings.speed = atof(value);
+                if (settings.speed < 0.0) {
+                    return false;
+                }
+            } else if (name == "--direction") {
+                if (strcmp(value, "inbound") == 0) {
+                    settings.direction = Sockets::Capture::Direction::Inbound;
+                } else if (strcmp(value, "outbound") == 0) {
+                    settings.direction = Sockets::Capture::Direction::Outbound;
+                } else {
+                    return false;
+                }
+            } else {
+                return false;
+            }
+        }
+        return !settings.capturePath.empty();
+    }
+
+    void PrintUsage() {
+        fprintf(
+            stderr,
+            "usage: Replay --capture=PATH [options]\n"
+            "\n"
+            "Replay the messages recorded in a capture file against a server.\n"
+            "\n"
+            "  --capture=PATH               capture file to replay\n"
+            "  --target=ADDRESS:PORT        IPv4 address and port of the\n"
+            "                               server; connections are replayed\n"
+            "                               to its TCP port, and datagrams to\n"
+            "                               its UDP port\n"
+            "                               (default 127.0.0.1:8000)\n"
+            "  --speed=FACTOR               how much faster than recorded to\n"
+            "                               replay, or 0 to replay as fast as\n"
+            "                               possible (default 1)\n"
+            "  --direction=DIRECTION        which messages to replay: inbound\n"
+            "                               (those the captured program\n"
+            "                               received, to stand in for its\n"
+            "                               peers) or outbound (those it sent,\n"
+            "                               to stand in for it)\n"
+            "                               (default inbound)\n"
+        );
+    }
+
+    // This is the function called from the main program in order to
+    // replay the capture while a SIGINT handler is set up to control when
+    // the program should terminate.
+    int InterruptableMain(const Settings& settings) {
+        Sockets::Capture::Reader reader;
+        if (!reader.Open(settings.capturePath)) {
+            return EXIT_FAILURE;
+        }
+        std::unordered_map< uint64_t, std::unique_ptr< Stream > > streams;
+        Sockets::DatagramSocket datagramSocket;
+        bool datagramSocketStarted = false;
+        uint64_t messagesSent = 0;
+        uint64_t bytesSent = 0;
+        bool firstRecord = true;
+        uint64_t firstTimestamp = 0;
+        const auto start = Clock::now();
+        Sockets::Capture::Record record;
+        while (
+            !shutDown
+            && reader.Next(record)
+        ) {
+            if (record.direction != settings.direction) {
+                continue;
+            }
+
+            // Keep to the recorded timing, sped up as asked.
+            if (firstRecord) {
+                firstTimestamp = record.timestamp;
+                firstRecord = false;
+            }
+            if (settings.speed > 0.0) {
+                std::this_thread::sleep_until(
+                    start + std::chrono::duration_cast< Clock::duration >(
+                        std::chrono::duration< double, std::nano >(
+                            (double)(record.timestamp - firstTimestamp) / settings.speed
+                        )
+                    )
+                );
+            }
+
+            if (record.transport == Sockets::Capture::Transport::Datagram) {
+                if (!datagramSocketStarted) {
+                    if (!datagramSocket.Bind()) {
+                        return EXIT_FAILURE;
+                    }
+                    datagramSocket.Start(
+                        [](const std::string& message){
+                            bytesReceived += message.length();
+                        }
+                    );
+                    datagramSocketStarted = true;
+                }
+                datagramSocket.SendMessage(
+                    record.message,
+                    settings.targetAddress,
+                    settings.targetPort
+                );
+            } else {
+                // Each connection in the capture is replayed on a connection
+                // of its own, made when its first message comes up.
+                auto& stream = streams[record.stream];
+                if (!stream) {
+                    stream.reset(new Stream());
+                    stream->connected = (
+                        stream->client.Bind()
+                        && stream->client.Connect(
+                            settings.targetAddress,
+                            settings.targetPort,
+                            [](const std::string& message){
+                                bytesReceived += message.length();
+                            },
+                            []{
+                                ++connectionsClosed;
+                            }
+                        )
+                    );
+                }
+                if (!stream->connected) {
+                    continue;
+                }
+                stream->client.SendMessage(record.message);
+            }
+            ++messagesSent;
+            bytesSent += record.message.length();
+        }
+        const auto seconds = std::chrono::duration< double >(Clock::now() - start).count();
+
+        // Give the connections a chance to finish sending, and the target a
+        // chance to reply.
+        const auto drainDeadline = Clock::now() + drainTimeout;
+        for (const auto& stream: streams) {
+            while (
+                !shutDown
+                && stream.second->connected
+                && (stream.second->client.GetSendQueueBytes() > 0)
+                && (Clock::now() < drainDeadline)
+            ) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        if (!shutDown) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+
+        // Report the results.
+        printf(
+            "Replayed %" PRIu64 " messages (%" PRIu64 " bytes) on %zu connections"
+            " in %.3f seconds: %.0f messages/s, %.1f MB/s\n",
+            messagesSent,
+            bytesSent,
+            streams.size(),
+            seconds,
+            (double)messagesSent / seconds,
+            (double)bytesSent / seconds / 1e6
+        );
+        printf(
+            "Received %" PRIu64 " bytes back; %" PRIu64 " connections closed by the target\n",
+            (uint64_t)bytesReceived,
+            (uint64_t)connectionsClosed
+        );
+        return EXIT_SUCCESS;
+    }
+
+}
+
+int main(int argc, char* argv[]) {
+    Settings settings;
+    if (!ParseSettings(argc, argv, settings)) {
+        PrintUsage();
+        return EXIT_FAILURE;
+    }
+
+    // Catch SIGINT (interrupt signal, typically sent when the user presses
+    // <Ctrl>+<C> on the terminal) during program execution.
+    const auto previousInterruptHandler = signal(SIGINT, OnSigInt);
+    const auto returnValue = InterruptableMain(settings);
+    (void)signal(SIGINT, previousInterruptHandler);
+    return returnValue;
+}
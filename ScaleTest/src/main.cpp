@@ -0,0 +1,509 @@
+#include <algorithm>
+#include <chrono>
+#include <inttypes.h>
+#include <memory>
+#include <mutex>
+#include <Sockets/ClientSocket.hpp>
+#include <Sockets/LatencyHistogram.hpp>
+#include <Sockets/ServerSocket.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif /* _WIN32 */
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    // This is the IPv4 address of the loopback interface, where the echo
+    // server accepts connections.  Clients are bound to a range of loopback
+    // addresses starting here, so that each address has its own set of
+    // ephemeral ports, to avoid running out of them.
+    constexpr uint32_t loopbackAddress = 0x7f000001;
+
+    // This is the number of separate latency histograms kept, to reduce
+    // contention between connections recording round-trip times.
+    constexpr size_t numLatencyStripes = 16;
+
+    // These are the settings which control the test, set from the command
+    // line.
+    struct Settings {
+        uint16_t port = 8300;
+        size_t connections = 10000;
+        size_t step = 1000;
+        double activeFraction = 0.1;
+        size_t addresses = 16;
+        int pingIntervalMilliseconds = 100;
+        double sampleSeconds = 1.0;
+        double holdSeconds = 0.0;
+        bool csv = false;
+    };
+
+    // This holds the measurements taken at one step of the ramp.
+    struct Sample {
+        size_t connections = 0;
+        size_t activeConnections = 0;
+        double connectSeconds = 0.0;
+        double acceptSeconds = 0.0;
+        size_t newConnections = 0;
+        uint64_t residentBytes = 0;
+        uint64_t threads = 0;
+        Sockets::LatencyHistogram roundTripTimes;
+    };
+
+    // This is the echo server which runs in the same process as the
+    // test clients.  Every message received from a client is sent
+    // right back to it.
+    struct EchoServer {
+        Sockets::ServerSocket server;
+        std::mutex mutex;
+        std::unordered_set< std::shared_ptr< Sockets::ServerSocket::Client > > clients;
+
+        void OnAcceptClient(
+            std::shared_ptr< Sockets::ServerSocket::Client >&& client
+        ) {
+            std::lock_guard< decltype(mutex) > lock(mutex);
+            const auto clientInsertion = clients.insert(std::move(client));
+            if (!clientInsertion.second) {
+                return;
+            }
+            const auto& newClient = *clientInsertion.first;
+            std::weak_ptr< Sockets::ServerSocket::Client > clientWeak(newClient);
+            const auto started = newClient->Start(
+                // onReceived
+                [clientWeak](const std::string& message) {
+                    auto client = clientWeak.lock();
+                    if (!client) {
+                        return;
+                    }
+                    client->SendMessage(message);
+                },
+
+                // onClosed
+                [this, clientWeak]{
+                    auto client = clientWeak.lock();
+                    if (!client) {
+                        return;
+                    }
+                    client->Close();
+                    std::lock_guard< decltype(mutex) > lock(mutex);
+                    (void)clients.erase(client);
+                }
+            );
+            if (!started) {
+                (void)clients.erase(clientInsertion.first);
+            }
+        }
+    };
+
+    // These are the latency histograms shared by all connections, each
+    // protected by its own mutex.
+    struct LatencyStripe {
+        std::mutex mutex;
+        Sockets::LatencyHistogram roundTripTimes;
+    };
+    LatencyStripe latencyStripes[numLatencyStripes];
+
+    uint64_t Now() {
+        return (uint64_t)std::chrono::duration_cast< std::chrono::nanoseconds >(
+            Clock::now().time_since_epoch()
+        ).count();
+    }
+
+    // This is the state of one test client connection.  Active connections
+    // periodically send a timestamp to the echo server, and measure the
+    // round-trip time when it comes back.
+    struct ClientState {
+        std::mutex mutex;
+        size_t index = 0;
+        std::string partial;
+
+        void OnReceived(const std::string& message) {
+            const auto now = Now();
+            std::lock_guard< decltype(mutex) > lock(mutex);
+            partial += message;
+            size_t offset = 0;
+            auto& stripe = latencyStripes[index % numLatencyStripes];
+            while (partial.length() - offset >= sizeof(uint64_t)) {
+                uint64_t sentAt;
+                (void)memcpy(&sentAt, partial.data() + offset, sizeof(sentAt));
+                offset += sizeof(sentAt);
+                std::lock_guard< decltype(stripe.mutex) > stripeLock(stripe.mutex);
+                stripe.roundTripTimes.Record(now - sentAt);
+            }
+            partial.erase(0, offset);
+        }
+    };
+
+    struct TestClient {
+        std::unique_ptr< Sockets::ClientSocket > socket;
+        std::shared_ptr< ClientState > state;
+    };
+
+    // This function reads the resident set size and thread count of the
+    // process, where the operating system makes them available.
+    void MeasureProcess(uint64_t& residentBytes, uint64_t& threads) {
+        residentBytes = 0;
+        threads = 0;
+#ifdef __linux__
+        FILE* status = fopen("/proc/self/status", "r");
+        if (status == NULL) {
+            return;
+        }
+        char line[256];
+        while (fgets(line, sizeof(line), status) != NULL) {
+            unsigned long long value;
+            if (sscanf(line, "VmRSS: %llu kB", &value) == 1) {
+                residentBytes = (uint64_t)value * 1024;
+            } else if (sscanf(line, "Threads: %llu", &value) == 1) {
+                threads = (uint64_t)value;
+            }
+        }
+        (void)fclose(status);
+#endif /* __linux__ */
+    }
+
+    // This function sends a timestamp on every active connection, once per
+    // ping interval, for the given amount of time.  Every Nth connection is
+    // active, where N is chosen to match the configured active fraction.
+    void PingActiveConnections(
+        const Settings& settings,
+        const std::vector< TestClient >& clients,
+        double seconds,
+        size_t& activeConnections
+    ) {
+        const size_t stride = (
+            (settings.activeFraction > 0.0)
+            ? std::max((size_t)(1.0 / settings.activeFraction + 0.5), (size_t)1)
+            : 0
+        );
+        activeConnections = (
+            (stride == 0)
+            ? 0
+            : (clients.size() + stride - 1) / stride
+        );
+        const auto end = Clock::now() + std::chrono::duration_cast< Clock::duration >(
+            std::chrono::duration< double >(seconds)
+        );
+        const auto interval = std::chrono::milliseconds(settings.pingIntervalMilliseconds);
+        auto nextPing = Clock::now();
+        while (Clock::now() < end) {
+            if (stride != 0) {
+                for (size_t i = 0; i < clients.size(); i += stride) {
+                    const auto sentAt = Now();
+                    clients[i].socket->SendMessage(
+                        std::string((const char*)&sentAt, sizeof(sentAt))
+                    );
+                }
+            }
+            nextPing += interval;
+            std::this_thread::sleep_until(std::min(nextPing, end));
+        }
+    }
+
+    Sockets::LatencyHistogram TakeRoundTripTimes() {
+        Sockets::LatencyHistogram roundTripTimes;
+        for (auto& stripe: latencyStripes) {
+            std::lock_guard< decltype(stripe.mutex) > lock(stripe.mutex);
+            roundTripTimes.Merge(stripe.roundTripTimes);
+            stripe.roundTripTimes.Reset();
+        }
+        return roundTripTimes;
+    }
+
+    void PrintSample(
+        const Settings& settings,
+        const Sample& sample,
+        uint64_t baselineResidentBytes,
+        bool first
+    ) {
+        const double connectsPerSecond = (
+            (sample.connectSeconds > 0.0)
+            ? (double)sample.newConnections / sample.connectSeconds
+            : 0.0
+        );
+        const double acceptsPerSecond = (
+            (sample.acceptSeconds > 0.0)
+            ? (double)sample.newConnections / sample.acceptSeconds
+            : 0.0
+        );
+        const uint64_t bytesPerConnection = (
+            (
+                (sample.connections > 0)
+                && (sample.residentBytes > baselineResidentBytes)
+            )
+            ? (sample.residentBytes - baselineResidentBytes) / sample.connections
+            : 0
+        );
+        const auto& rtt = sample.roundTripTimes;
+        if (settings.csv) {
+            if (first) {
+                printf(
+                    "connections,activeConnections,connectsPerSecond,"
+                    "acceptsPerSecond,residentBytes,bytesPerConnection,threads,"
+                    "messages,rttP50Microseconds,rttP99Microseconds,"
+                    "rttP999Microseconds,rttMaxMicroseconds\n"
+                );
+            }
+            printf(
+                "%zu,%zu,%.1f,%.1f,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64
+                ",%.3f,%.3f,%.3f,%.3f\n",
+                sample.connections,
+                sample.activeConnections,
+                connectsPerSecond,
+                acceptsPerSecond,
+                sample.residentBytes,
+                bytesPerConnection,
+                sample.threads,
+                rtt.GetCount(),
+                (double)rtt.GetPercentile(50.0) / 1000.0,
+                (double)rtt.GetPercentile(99.0) / 1000.0,
+                (double)rtt.GetPercentile(99.9) / 1000.0,
+                (double)rtt.GetMaximum() / 1000.0
+            );
+        } else {
+            printf(
+                "%s  {\"connections\": %zu, \"activeConnections\": %zu, "
+                "\"connectsPerSecond\": %.1f, \"acceptsPerSecond\": %.1f, "
+                "\"residentBytes\": %" PRIu64 ", "
+                "\"bytesPerConnection\": %" PRIu64 ", "
+                "\"threads\": %" PRIu64 ", \"messages\": %" PRIu64 ", "
+                "\"rttP50Microseconds\": %.3f, \"rttP99Microseconds\": %.3f, "
+                "\"rttP999Microseconds\": %.3f, \"rttMaxMicroseconds\": %.3f}",
+                first ? "" : ",\n",
+                sample.connections,
+                sample.activeConnections,
+                connectsPerSecond,
+                acceptsPerSecond,
+                sample.residentBytes,
+                bytesPerConnection,
+                sample.threads,
+                rtt.GetCount(),
+                (double)rtt.GetPercentile(50.0) / 1000.0,
+                (double)rtt.GetPercentile(99.0) / 1000.0,
+                (double)rtt.GetPercentile(99.9) / 1000.0,
+                (double)rtt.GetMaximum() / 1000.0
+            );
+        }
+        fflush(stdout);
+    }
+
+    bool ParseSettings(int argc, char* argv[], Settings& settings) {
+        for (int i = 1; i < argc; ++i) {
+            const char* argument = argv[i];
+            const char* value = strchr(argument, '=');
+            if (value == NULL) {
+                return false;
+            }
+            const std::string name(argument, value++);
+            if (name == "--connections") {
+                settings.connections = (size_t)strtoull(value, NULL, 10);
+            } else if (name == "--step") {
+                settings.step = std::max((size_t)strtoull(value, NULL, 10), (size_t)1);
+            } else if (name == "--active") {
+                settings.activeFraction = atof(value);
+            } else if (name == "--addresses") {
+                settings.addresses = std::min(
+                    std::max((size_t)atoi(value), (size_t)1),
+                    (size_t)254
+                );
+            } else if (name == "--ping-interval") {
+                settings.pingIntervalMilliseconds = std::max(atoi(value), 1);
+            } else if (name == "--sample") {
+                settings.sampleSeconds = atof(value);
+            } else if (name == "--hold") {
+                settings.holdSeconds = atof(value);
+            } else if (name == "--port") {
+                settings.port = (uint16_t)atoi(value);
+            } else if (name == "--format") {
+                if (strcmp(value, "csv") == 0) {
+                    settings.csv = true;
+                } else if (strcmp(value, "json") == 0) {
+                    settings.csv = false;
+                } else {
+                    return false;
+                }
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void PrintUsage() {
+        fprintf(
+            stderr,
+            "usage: ScaleTest [options]\n"
+            "\n"
+            "Ramp up loopback connections, measuring resource use and latency.\n"
+            "\n"
+            "  --connections=N    number of connections to ramp up to\n"
+            "                     (default 10000)\n"
+            "  --step=N           connections to add per step (default 1000)\n"
+            "  --active=F         fraction of connections sending messages\n"
+            "                     (default 0.1)\n"
+            "  --addresses=N      number of loopback addresses (127.0.0.x) to\n"
+            "                     spread clients across (default 16)\n"
+            "  --ping-interval=N  milliseconds between messages on an active\n"
+            "                     connection (default 100)\n"
+            "  --sample=S         seconds to measure latency at each step\n"
+            "                     (default 1)\n"
+            "  --hold=S           seconds to keep all connections open at the\n"
+            "                     end, measuring once more (default 0)\n"
+            "  --port=N           TCP port for the echo server (default 8300)\n"
+            "  --format=json|csv  output format (default json)\n"
+        );
+    }
+
+    // Each connection uses a few file descriptors, so make sure we're
+    // allowed to have as many as we can.
+    void RaiseFileDescriptorLimit() {
+#ifndef _WIN32
+        struct rlimit limit;
+        if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+            limit.rlim_cur = limit.rlim_max;
+            (void)setrlimit(RLIMIT_NOFILE, &limit);
+        }
+#endif /* _WIN32 */
+    }
+
+}
+
+int main(int argc, char* argv[]) {
+    Settings settings;
+    if (!ParseSettings(argc, argv, settings)) {
+        PrintUsage();
+        return EXIT_FAILURE;
+    }
+    RaiseFileDescriptorLimit();
+    uint64_t baselineResidentBytes, baselineThreads;
+    MeasureProcess(baselineResidentBytes, baselineThreads);
+
+    // Start the echo server.
+    EchoServer echoServer;
+    if (!echoServer.server.Bind(settings.port)) {
+        return EXIT_FAILURE;
+    }
+    if (
+        !echoServer.server.Listen(
+            [&echoServer](std::shared_ptr< Sockets::ServerSocket::Client >&& client){
+                echoServer.OnAcceptClient(std::move(client));
+            }
+        )
+    ) {
+        return EXIT_FAILURE;
+    }
+
+    // Ramp up the number of connections one step at a time, measuring
+    // after each step, until we reach the target or something gives out.
+    std::vector< TestClient > clients;
+    bool first = true;
+    bool stopped = false;
+    if (!settings.csv) {
+        printf("[\n");
+    }
+    while (
+        !stopped
+        && (clients.size() < settings.connections)
+    ) {
+        Sample sample;
+        const auto acceptedBefore = echoServer.server.GetStatistics().accepted;
+        const auto stepStart = Clock::now();
+        const auto stepSize = std::min(settings.step, settings.connections - clients.size());
+        for (size_t i = 0; i < stepSize; ++i) {
+            TestClient client;
+            client.socket.reset(new Sockets::ClientSocket());
+            client.state = std::make_shared< ClientState >();
+            client.state->index = clients.size();
+            const auto state = client.state;
+            const auto sourceAddress = (uint32_t)(
+                loopbackAddress + (clients.size() % settings.addresses)
+            );
+            if (
+                !client.socket->Bind(sourceAddress, 0)
+                || !client.socket->Connect(
+                    loopbackAddress,
+                    settings.port,
+                    [state](const std::string& message){
+                        state->OnReceived(message);
+                    },
+                    []{}
+                )
+            ) {
+                fprintf(
+                    stderr,
+                    "Stopped ramping at %zu connections: unable to add more.\n",
+                    clients.size()
+                );
+                stopped = true;
+                break;
+            }
+            clients.push_back(std::move(client));
+            ++sample.newConnections;
+        }
+        sample.connectSeconds = std::chrono::duration< double >(
+            Clock::now() - stepStart
+        ).count();
+
+        // Wait for the server to finish accepting the new connections.
+        const auto acceptDeadline = Clock::now() + std::chrono::seconds(10);
+        while (
+            (echoServer.server.GetStatistics().accepted - acceptedBefore < sample.newConnections)
+            && (Clock::now() < acceptDeadline)
+        ) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        sample.acceptSeconds = std::chrono::duration< double >(
+            Clock::now() - stepStart
+        ).count();
+
+        // Measure latency on the active connections, as well as the
+        // resources used by the process.
+        (void)TakeRoundTripTimes();
+        PingActiveConnections(
+            settings,
+            clients,
+            settings.sampleSeconds,
+            sample.activeConnections
+        );
+        sample.roundTripTimes = TakeRoundTripTimes();
+        sample.connections = clients.size();
+        MeasureProcess(sample.residentBytes, sample.threads);
+        PrintSample(settings, sample, baselineResidentBytes, first);
+        first = false;
+        fprintf(stderr, "Reached %zu connections.\n", clients.size());
+    }
+
+    // Optionally keep everything going for a while (a soak), and measure
+    // once more at the end.
+    if (settings.holdSeconds > 0.0) {
+        Sample sample;
+        (void)TakeRoundTripTimes();
+        PingActiveConnections(
+            settings,
+            clients,
+            settings.holdSeconds,
+            sample.activeConnections
+        );
+        sample.roundTripTimes = TakeRoundTripTimes();
+        sample.connections = clients.size();
+        MeasureProcess(sample.residentBytes, sample.threads);
+        PrintSample(settings, sample, baselineResidentBytes, first);
+    }
+    if (!settings.csv) {
+        printf("\n]\n");
+    }
+    fprintf(stderr, "Closing %zu connections...\n", clients.size());
+    for (const auto& client: clients) {
+        client.socket->Close();
+    }
+    clients.clear();
+    return EXIT_SUCCESS;
+}
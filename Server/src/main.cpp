@@ -1,17 +1,45 @@
+#include <chrono>
 #include <inttypes.h>
+#include <memory>
 #include <mutex>
 #include <signal.h>
 #include <Sockets/ServerSocket.hpp>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <string>
 #include <thread>
 #include <unordered_set>
+#include <vector>
 
 namespace {
 
     // This is the TCP port number on which to accept new connections.
     constexpr uint16_t port = 8000;
 
+    // This is how long to wait for another program to hand over its
+    // listening socket, when taking over from one.
+    constexpr auto takeOverTimeout = std::chrono::seconds(60);
+
+    // These are the settings which control how the server starts and
+    // stops, set from the command line.
+    struct Settings {
+        // If set, this is the path of a local socket on which another
+        // program hands over its listening socket and connections, instead
+        // of binding a new listening socket.
+        std::string takeOverPath;
+
+        // If set, this is the path of a local socket on which another
+        // program is waiting to take over the listening socket and
+        // connections when this program is interrupted.
+        std::string handOffPath;
+
+        // This is how long to wait, when the program is interrupted, for
+        // connections to finish sending before they're handed off or
+        // closed.
+        std::chrono::milliseconds drainTimeout{5000};
+    };
+
     // This holds the set of currently connected clients.
     std::unordered_set< std::shared_ptr< Sockets::ServerSocket::Client > > clients;
 
@@ -19,6 +47,12 @@ namespace {
     // clients.
     std::mutex mutex;
 
+    // This flag is set on the main thread while it's given the connections
+    // handed over by the server we're taking over from, which were already
+    // greeted there, as opposed to new connections, which are accepted on
+    // the listener's own thread.
+    thread_local bool acceptingHandedOverClients = false;
+
     // This flag is set by our SIGINT signal handler in order to cause the main
     // program's polling loop to exit and let the program clean up and
     // terminate.
@@ -90,7 +124,73 @@ namespace {
 
         // Send a message to the client to test the server's ability to send a
         // message as well as the client's ability to receive it.
-        newClient->SendMessage("Welcome!");
+        if (!acceptingHandedOverClients) {
+            newClient->SendMessage("Welcome!");
+        }
+    }
+
+    bool ParseSettings(int argc, char* argv[], Settings& settings) {
+        for (int i = 1; i < argc; ++i) {
+            const char* argument = argv[i];
+            const char* value = strchr(argument, '=');
+            if (value == NULL) {
+                return false;
+            }
+            const std::string name(argument, value++);
+            if (name == "--take-over") {
+                settings.takeOverPath = value;
+            } else if (name == "--hand-off") {
+                settings.handOffPath = value;
+            } else if (name == "--drain-timeout") {
+                settings.drainTimeout = std::chrono::milliseconds(atoi(value));
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void PrintUsage() {
+        fprintf(
+            stderr,
+            "usage: Server [options]\n"
+            "\n"
+            "Accept connections on port 8000 and print what they send.\n"
+            "\n"
+            "  --take-over=PATH             instead of binding the port, take\n"
+            "                               over the listening socket and\n"
+            "                               connections of a server started\n"
+            "                               with --hand-off=PATH\n"
+            "  --hand-off=PATH              when interrupted, hand the\n"
+            "                               listening socket and connections\n"
+            "                               to a server started with\n"
+            "                               --take-over=PATH\n"
+            "  --drain-timeout=MS           when interrupted, how long to wait\n"
+            "                               for connections to finish sending\n"
+            "                               (default 5000)\n"
+        );
+    }
+
+    // Hand off the listening socket and as many of the connected clients as
+    // possible to the program taking over from this one.  Those handed off
+    // are removed from the set of connected clients.
+    //
+    // The lock isn't held during the hand-off, since the connections'
+    // callbacks need it while they're being handed off.
+    void HandOff(Sockets::ServerSocket& server, const Settings& settings) {
+        std::vector< std::shared_ptr< Sockets::ServerSocket::Client > > handedOff;
+        if (!server.HandOff(settings.handOffPath, handedOff, settings.drainTimeout)) {
+            return;
+        }
+        std::lock_guard< decltype(mutex) > lock(mutex);
+        for (const auto& client: handedOff) {
+            (void)clients.erase(client);
+        }
+        printf(
+            "Handed off listening socket and %zu of %zu connections.\n",
+            handedOff.size(),
+            handedOff.size() + clients.size()
+        );
     }
 
     // This function is set up to be called whenever the SIGINT signal
@@ -105,21 +205,42 @@ namespace {
     // This is the function called from the main program in order to operate
     // the socket while a SIGINT handler is set up to control when the program
     // should terminate.
-    int InterruptableMain() {
-        // Make a socket and assign an address to it.
+    int InterruptableMain(const Settings& settings) {
+        // Make a socket and assign an address to it, or take over one from
+        // the server we're replacing.
         Sockets::ServerSocket server;
-        if (!server.Bind(port)) {
-            return EXIT_FAILURE;
+        if (settings.takeOverPath.empty()) {
+            if (!server.Bind(port)) {
+                return EXIT_FAILURE;
+            }
+        } else {
+            printf("Waiting to take over from another server...\n");
+            if (!server.TakeOver(settings.takeOverPath, takeOverTimeout)) {
+                return EXIT_FAILURE;
+            }
         }
 
-        // Set up the socket to receive incoming connections.
+        // Set up the socket to receive incoming connections.  Any
+        // connections handed over are given to us first, on this thread.
+        acceptingHandedOverClients = true;
         server.Listen(OnAcceptClient);
+        acceptingHandedOverClients = false;
         printf("Now listening for connections on port %" PRIu16 "...\n", port);
 
         // Poll the flag set by our SIGINT handler, until it is set.
         while (!shutDown) {
             std::this_thread::sleep_for(std::chrono::milliseconds(100));
         }
+
+        // Hand off to the server replacing this one, if there is one, and
+        // let whatever connections are left finish sending before closing
+        // them, rather than cutting them off.
+        if (!settings.handOffPath.empty()) {
+            HandOff(server, settings);
+        }
+        if (!server.Drain(settings.drainTimeout)) {
+            printf("Some connections didn't finish sending in time.\n");
+        }
         printf("Program exiting.\n");
         return EXIT_SUCCESS;
     }
@@ -127,10 +248,16 @@ namespace {
 }
 
 int main(int argc, char* argv[]) {
+    Settings settings;
+    if (!ParseSettings(argc, argv, settings)) {
+        PrintUsage();
+        return EXIT_FAILURE;
+    }
+
     // Catch SIGINT (interrupt signal, typically sent when the user presses
     // <Ctrl>+<C> on the terminal) during program execution.
     const auto previousInterruptHandler = signal(SIGINT, OnSigInt);
-    const auto returnValue = InterruptableMain();
+    const auto returnValue = InterruptableMain(settings);
     (void)signal(SIGINT, previousInterruptHandler);
     return returnValue;
 }
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <Sockets/Detail/Abstractions.hpp>
+#include <Sockets/SendPriority.hpp>
+#include <Sockets/WritePolicy.hpp>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Sockets {
+
+    class Capture;
+    class SlabPool;
+
+    /**
+     * This is a lock which does nothing, for connections which are only
+     * ever used from their own callbacks (and so from a single thread).
+     */
+    struct NullMutex {
+        void lock() {}
+        bool try_lock() { return true; }
+        void unlock() {}
+    };
+
+    /**
+     * This is a lock which spins rather than sleeps while waiting, for
+     * connections whose lock is only ever held briefly.
+     */
+    class SpinMutex {
+    public:
+        // Methods
+
+        void lock() {
+            while (flag_.test_and_set(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+        }
+
+        bool try_lock() {
+            return !flag_.test_and_set(std::memory_order_acquire);
+        }
+
+        void unlock() {
+            flag_.clear(std::memory_order_release);
+        }
+
+    private:
+        // Properties
+        std::atomic_flag flag_ = ATOMIC_FLAG_INIT;
+    };
+
+    /**
+     * These are the policies of the general-purpose connection used by
+     * ClientSocket and ServerSocket.  A specialized connection is made by
+     * instantiating BasicConnection with a class providing the same
+     * members:
+     *
+     * - Mutex is the lock guarding the connection's state (std::mutex,
+     *   SpinMutex, or NullMutex if the connection is only used from its
+     *   own callbacks).
+     * - Queue is the container of buffers waiting to be sent; it needs
+     *   bidirectional iterators, insert, front, pop_front and size
+     *   (std::list or std::deque).
+     * - receiveBufferSize is the most read from the socket at once.
+     * - framing says whether the connection supports compression; without
+     *   it, the framing code is compiled out and SetCompression fails.
+     * - OnReceived and OnClosed are the types of the callbacks, which may
+     *   be lambda or function object types so that calls to them can be
+     *   inlined.
+     */
+    struct DefaultConnectionPolicies {
+        // Types
+        using Mutex = std::mutex;
+        template< class T > using Queue = std::list< T >;
+        using OnReceived = std::function< void(const std::string&) >;
+        using OnClosed = std::function< void() >;
+
+        // Constants
+        static constexpr size_t receiveBufferSize = 65536;
+        static constexpr bool framing = true;
+    };
+
+    /**
+     * This operates a connected stream socket: it queues and sends
+     * messages, delivers what's received, and keeps track of timeouts,
+     * heartbeats, compression, rate limits and statistics.  Its locking,
+     * send queue, receive buffer size, framing support and callback types
+     * are chosen at compile time by the given policies (see
+     * DefaultConnectionPolicies).
+     *
+     * The member definitions are in <Sockets/BasicConnectionImpl.hpp>,
+     * which only needs to be included by the one source file of a program
+     * which instantiates the template with its own policies.  The library
+     * already holds the instantiation with the default policies.
+     */
+    template< class Policies >
+    class BasicConnection {
+    public:
+        // Types
+        using OnReceived = typename Policies::OnReceived;
+        using OnClosed = typename Policies::OnClosed;
+
+        // Constructors
+        BasicConnection();
+        explicit BasicConnection(const std::shared_ptr< SlabPool >& pool);
+
+        // Methods
+
+        /**
+         * Start handing the socket back, so that it can be passed to
+         * another process: stop reading from it, and finish sending what's
+         * queued.  Call EndRelease to wait for this and take the socket.
+         * Neither may be called from the connection's callbacks.
+         *
+         * Nothing more can be sent from here on: messages and files sent
+         * while the release is going on, or after it's finished, are
+         * dropped with an error.  If the release fails, sending works
+         * again.
+         *
+         * Returns false if the connection can't be released, because it
+         * isn't started, is closing, or has negotiated framing (whose state
+         * couldn't be carried over).
+         */
+        bool BeginRelease();
+
+        void Close();
+
+        /**
+         * Wait until the given time for a release started by BeginRelease
+         * to finish, and take the socket.  The callbacks aren't called
+         * again once the socket has been taken.
+         *
+         * Returns INVALID_SOCKET if the queue couldn't be sent in time or
+         * the connection failed, in which case the connection carries on
+         * as before.
+         */
+        SOCKET EndRelease(std::chrono::steady_clock::time_point deadline);
+
+        void Flush();
+        LatencyHistograms GetLatencyHistograms() const;
+        size_t GetSendQueueBytes() const;
+        ConnectionStatistics GetStatistics() const;
+
+        /**
+         * Returns true while there's something queued which may yet be
+         * sent, i.e. the queue isn't empty and the connection hasn't
+         * failed.
+         */
+        bool IsSending() const;
+
+        void SendMessage(const std::string& message, SendPriority priority);
+        void SendMessage(
+            const std::shared_ptr< const std::string >& message,
+            SendPriority priority
+        );
+        bool SendFile(
+            int file,
+            uint64_t offset,
+            size_t length
+        );
+        void SendMessages(
+            const std::vector< std::string >& messages,
+            SendPriority priority
+        );
+        void SetBatchedReceive(bool batchedReceive);
+        void SetCapture(const std::shared_ptr< Capture >& capture);
+        bool SetCompression(bool compression, size_t threshold);
+        void SetHeartbeat(
+            std::chrono::milliseconds interval,
+            const std::string& message
+        );
+        void SetIdleTimeouts(
+            std::chrono::milliseconds readTimeout,
+            std::chrono::milliseconds writeTimeout,
+            std::chrono::milliseconds idleTimeout
+        );
+        bool SetKeepAlive(
+            std::chrono::seconds idle,
+            std::chrono::seconds interval,
+            unsigned int count
+        );
+        void SetRateLimit(uint64_t bytesPerSecond, size_t burst);
+        bool SetUserTimeout(std::chrono::milliseconds timeout);
+        bool SetWritePolicy(
+            WritePolicy writePolicy,
+            std::chrono::microseconds coalesceWindow
+        );
+        bool SetZeroCopyThreshold(size_t threshold);
+        bool Start(
+            SOCKET socket,
+            OnReceived onReceived,
+            OnClosed onClosed
+        );
+
+    private:
+        // Properties
+        struct Impl;
+        std::shared_ptr< Impl > impl_;
+    };
+
+    extern template class BasicConnection< DefaultConnectionPolicies >;
+
+}
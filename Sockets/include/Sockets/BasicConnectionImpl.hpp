@@ -0,0 +1,1723 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <Sockets/BasicConnection.hpp>
+#include <Sockets/Capture.hpp>
+#include <Sockets/Detail/Abstractions.hpp>
+#include <Sockets/Detail/Counter.hpp>
+#include <Sockets/Detail/LatencyRecorder.hpp>
+#include <Sockets/Detail/Lz.hpp>
+#include <Sockets/Detail/SlabPool.hpp>
+#include <Sockets/Detail/TokenBucket.hpp>
+#include <Sockets/Detail/TraceBuffer.hpp>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Sockets {
+
+    // These are the details shared by every kind of connection.
+    namespace ConnectionDetail {
+
+        // This is the most data delivered in one call to the receive callback
+        // when batched receive is enabled, as a multiple of the receive buffer
+        // size, so that a fast sender can't keep a connection from handling
+        // anything else.
+        constexpr size_t maximumBatchReads = 16;
+
+        // Once this much data is queued, writes aren't held back any longer to
+        // wait for more, even if the coalescing window hasn't ended.
+        constexpr size_t maximumCoalesceSize = 65536;
+
+        // This is the most data sent from a file in one operation, so that a
+        // large file doesn't keep a connection from handling anything else.
+        constexpr size_t maximumFileChunkSize = 1048576;
+
+        // This is how long to wait before trying again to send from a pipe
+        // which had no data ready.
+        constexpr auto pipeRetryInterval = std::chrono::milliseconds(1);
+
+        // When compression is enabled, everything sent on a connection is put
+        // in frames, each a type and a length followed by that much data.
+        // Each side starts with a hello frame saying what it can decompress,
+        // and only compresses once it knows the other side can decompress.
+        enum class FrameType : uint8_t {
+            Hello = 0,
+            Plain = 1,
+            Compressed = 2,
+        };
+        constexpr size_t frameHeaderSize = 5;
+
+        // A frame's length must fit in its header, so data too long for one
+        // frame is split across several.
+        constexpr size_t maximumFrameLength = 0xffffffff;
+
+        // A hello frame carries a version number and a set of flags, one for
+        // each codec which can be decompressed.
+        constexpr uint8_t compressionVersion = 1;
+        constexpr uint8_t compressionCodecLz = 0x01;
+        constexpr size_t helloSize = 2;
+
+        // Later versions may send longer hello frames, but never longer than
+        // this, so that a peer can't make us hold on to a huge one.
+        constexpr size_t maximumHelloSize = 64;
+
+        // Data is compressed in blocks of at most this size, each in its own
+        // frame, which starts with the length of the uncompressed data.
+        constexpr size_t compressionBlockSize = 65536;
+        constexpr size_t compressedHeaderSize = 4;
+
+        // This is the number of send priority classes, and how much each byte
+        // of a message in each class counts against its share of the
+        // connection, so that classes get shares in inverse proportion.
+        constexpr size_t numSendPriorities = 3;
+        constexpr uint64_t sendPriorityCosts[numSendPriorities] = {1, 4, 16};
+
+        using Clock = std::chrono::steady_clock;
+
+        inline void WriteUint32(uint32_t value, uint8_t* to) {
+            to[0] = (uint8_t)value;
+            to[1] = (uint8_t)(value >> 8);
+            to[2] = (uint8_t)(value >> 16);
+            to[3] = (uint8_t)(value >> 24);
+        }
+
+        inline uint32_t ReadUint32(const uint8_t* from) {
+            return (
+                (uint32_t)from[0]
+                | ((uint32_t)from[1] << 8)
+                | ((uint32_t)from[2] << 16)
+                | ((uint32_t)from[3] << 24)
+            );
+        }
+
+        inline void AppendFrameHeader(FrameType type, size_t length, std::string& to) {
+            uint8_t header[frameHeaderSize];
+            header[0] = (uint8_t)type;
+            WriteUint32((uint32_t)length, header + 1);
+            (void)to.append((const char*)header, sizeof(header));
+        }
+
+    }
+
+    using namespace ConnectionDetail;
+
+    template< class Policies >
+    struct BasicConnection< Policies >::Impl {
+        // Types
+        struct OwnedFile {
+            int handle = -1;
+
+            ~OwnedFile() noexcept {
+                if (handle >= 0) {
+                    CloseFile(handle);
+                }
+            }
+            OwnedFile(const OwnedFile&) = delete;
+            OwnedFile(OwnedFile&& other) noexcept
+                : handle(other.handle)
+            {
+                other.handle = -1;
+            }
+            OwnedFile& operator=(const OwnedFile&) = delete;
+            OwnedFile& operator=(OwnedFile&& other) noexcept {
+                std::swap(handle, other.handle);
+                return *this;
+            }
+
+            OwnedFile() = default;
+        };
+
+        struct Buffer {
+            std::string message;
+            size_t offset = 0;
+
+            // This is set instead of the message when sending a message
+            // which is shared with other connections.
+            std::shared_ptr< const std::string > sharedMessage;
+
+            Clock::time_point enqueued;
+
+            // These are used instead of the message when sending data from
+            // a file or pipe.
+            OwnedFile file;
+            bool isPipe = false;
+            uint64_t fileOffset = 0;
+            size_t fileLength = 0;
+            Clock::time_point retryAt;
+
+            // These are set if any of the message was sent without copying,
+            // in which case it has to be kept until the last such send
+            // (identified by number) is complete.
+            bool zeroCopy = false;
+            uint32_t zeroCopySequence = 0;
+
+            // This is the priority class of the buffer, and where it falls
+            // in the schedule (see Enqueue).
+            SendPriority priority = SendPriority::Normal;
+            uint64_t startTag = 0;
+
+            bool IsFile() const {
+                return (file.handle >= 0);
+            }
+
+            const std::string& Message() const {
+                return sharedMessage ? *sharedMessage : message;
+            }
+
+            size_t Length() const {
+                return IsFile() ? fileLength : Message().length();
+            }
+        };
+
+        // Properties
+
+        // This holds the buffers waiting to be sent, in the order in which
+        // they're to be sent.
+        typename Policies::template Queue< Buffer > buffersToSend;
+
+        // These are used to schedule buffers of different priorities.  The
+        // virtual time is the start tag of the last buffer completed, and
+        // each class remembers where its last buffer finishes.
+        uint64_t virtualTime = 0;
+        uint64_t lastFinishTags[numSendPriorities] = {};
+        bool readClosed = false;
+        bool writeClosed = false;
+        bool error = false;
+        bool batchedReceive = false;
+
+        // These are set while the socket is being handed back (see
+        // BeginRelease), and once it's ready to be taken.
+        bool releasing = false;
+        bool released = false;
+        typename Policies::Mutex mutex;
+        uint8_t receiveBuffer[Policies::receiveBufferSize];
+        SOCKET socket = INVALID_SOCKET;
+
+        // This is set if the socket is a local (Unix domain) one, to which
+        // TCP options don't apply.
+        bool isLocal = false;
+
+        SocketEventLoop socketEventLoop;
+        UsesSockets usesSockets;
+
+        // Idle detection and heartbeat settings; a zero duration disables
+        // the corresponding timer.
+        std::chrono::milliseconds readTimeout{0};
+        std::chrono::milliseconds writeTimeout{0};
+        std::chrono::milliseconds idleTimeout{0};
+        std::chrono::milliseconds heartbeatInterval{0};
+        std::string heartbeatMessage;
+        Clock::time_point lastReceived;
+        Clock::time_point lastSent;
+        Clock::time_point lastSendProgress;
+
+        // TCP keep-alive settings, remembered until the socket is known.
+        bool keepAliveConfigured = false;
+        std::chrono::seconds keepAliveIdle{0};
+        std::chrono::seconds keepAliveInterval{0};
+        unsigned int keepAliveCount = 0;
+        bool userTimeoutConfigured = false;
+        std::chrono::milliseconds userTimeout{0};
+
+        // Write coalescing settings.  The flush flag overrides the
+        // coalescing window until the send queue is next empty.  The
+        // window is measured from when the queue last became non-empty,
+        // since the buffer at the front may have been queued later, if
+        // one of higher priority went ahead of the rest.
+        WritePolicy writePolicy = WritePolicy::Default;
+        std::chrono::microseconds coalesceWindow{0};
+        bool flushRequested = false;
+        Clock::time_point sendQueueStarted;
+
+        // Zero-copy settings and state.  Messages sent without copying are
+        // moved here once fully sent, and kept until the operating system
+        // says it's done with them.  (Their data is always in a shared
+        // message by then, so moving the buffer doesn't move the data.)
+        size_t zeroCopyThreshold = 0;
+        bool zeroCopyEnabled = false;
+        uint32_t zeroCopyNextSequence = 0;
+        uint64_t zeroCopyOutstanding = 0;
+        std::deque< Buffer > zeroCopyPending;
+
+        // Compression settings and state.  The compressor is only made
+        // when compression is enabled, and it's used while holding the
+        // compression mutex, which is always taken before the main mutex.
+        std::atomic< bool > framing{false};
+        size_t compressionThreshold = 0;
+        std::atomic< bool > peerDecompresses{false};
+        typename Policies::Mutex compressionMutex;
+        std::unique_ptr< LzCompressor > compressor;
+
+        // Rate limit settings and state.  The operating system is also
+        // asked to pace the socket at the same rate, where it can.
+        uint64_t rateLimit = 0;
+        TokenBucket pacing;
+
+        // If set, messages sent and received are recorded here, under the
+        // given stream number.
+        std::shared_ptr< Capture > capture;
+        uint64_t captureStream = 0;
+
+        // These are used to take apart frames as they're received.
+        bool helloReceived = false;
+        uint8_t frameHeader[frameHeaderSize];
+        size_t frameHeaderReceived = 0;
+        FrameType frameType = FrameType::Plain;
+        size_t frameRemaining = 0;
+        std::string framePayload;
+
+        // Statistics
+        Counter bytesReceived;
+        Counter bytesSent;
+        Counter messagesReceived;
+        Counter messagesSent;
+        Counter receiveCalls;
+        Counter sendCalls;
+        Counter partialWrites;
+        Counter receiveWouldBlock;
+        Counter sendWouldBlock;
+        Counter sendQueueDepth;
+        Counter sendQueueBytes;
+        Counter sendQueueDepths[numSendPriorities];
+        Counter zeroCopySends;
+        Counter zeroCopyCompletions;
+        Counter zeroCopyCopied;
+        Counter compressionInputBytes;
+        Counter compressionOutputBytes;
+        Counter compressionNanoseconds;
+        Counter decompressionInputBytes;
+        Counter decompressionOutputBytes;
+        Counter decompressionNanoseconds;
+        Counter throttleStalls;
+        Counter throttledNanoseconds;
+        LatencyRecorder sendQueueResidency;
+        LatencyRecorder receiveHandlerTime;
+
+        // Lifecycle
+
+        ~Impl() noexcept {
+            if (!IS_INVALID_SOCKET(socket)) {
+                (void)closesocket(socket);
+            }
+        }
+
+        Impl(const Impl&) = delete;
+        Impl(Impl&&) noexcept = delete;
+        Impl& operator=(const Impl&) = delete;
+        Impl& operator=(Impl&&) noexcept = delete;
+
+        // Constructor
+        //
+        // This is user-provided, rather than defaulted, so that creating an
+        // Impl doesn't zero-fill the receive buffer first.
+        Impl() {
+        }
+
+        // Methods
+
+        bool ApplyKeepAlive() {
+            if (isLocal) {
+                return true;
+            }
+            int enable = 1;
+            if (
+                IS_SOCKET_ERROR(
+                    setsockopt(
+                        socket,
+                        SOL_SOCKET,
+                        SO_KEEPALIVE,
+                        (const char*)&enable,
+                        sizeof(enable)
+                    )
+                )
+            ) {
+                fprintf(stderr, "error: unable to enable keep-alive\n");
+                return false;
+            }
+            bool success = true;
+#if defined(TCP_KEEPIDLE)
+            int idle = (int)keepAliveIdle.count();
+            if (
+                (idle > 0)
+                && IS_SOCKET_ERROR(
+                    setsockopt(
+                        socket,
+                        IPPROTO_TCP,
+                        TCP_KEEPIDLE,
+                        (const char*)&idle,
+                        sizeof(idle)
+                    )
+                )
+            ) {
+                success = false;
+            }
+#elif defined(TCP_KEEPALIVE)
+            int idle = (int)keepAliveIdle.count();
+            if (
+                (idle > 0)
+                && IS_SOCKET_ERROR(
+                    setsockopt(
+                        socket,
+                        IPPROTO_TCP,
+                        TCP_KEEPALIVE,
+                        (const char*)&idle,
+                        sizeof(idle)
+                    )
+                )
+            ) {
+                success = false;
+            }
+#endif
+#if defined(TCP_KEEPINTVL)
+            int interval = (int)keepAliveInterval.count();
+            if (
+                (interval > 0)
+                && IS_SOCKET_ERROR(
+                    setsockopt(
+                        socket,
+                        IPPROTO_TCP,
+                        TCP_KEEPINTVL,
+                        (const char*)&interval,
+                        sizeof(interval)
+                    )
+                )
+            ) {
+                success = false;
+            }
+#endif
+#if defined(TCP_KEEPCNT)
+            int count = (int)keepAliveCount;
+            if (
+                (count > 0)
+                && IS_SOCKET_ERROR(
+                    setsockopt(
+                        socket,
+                        IPPROTO_TCP,
+                        TCP_KEEPCNT,
+                        (const char*)&count,
+                        sizeof(count)
+                    )
+                )
+            ) {
+                success = false;
+            }
+#endif
+            if (!success) {
+                fprintf(stderr, "error: unable to configure keep-alive\n");
+            }
+            return success;
+        }
+
+        // Record a message being sent, if the connection is captured.
+        void CaptureOutbound(const std::string& message) {
+            if (capture) {
+                capture->Append(
+                    captureStream,
+                    Capture::Direction::Outbound,
+                    Capture::Transport::Stream,
+                    message
+                );
+            }
+        }
+
+        bool ApplyUserTimeout() {
+            if (isLocal) {
+                return true;
+            }
+#if defined(TCP_USER_TIMEOUT)
+            unsigned int timeout = (unsigned int)userTimeout.count();
+            if (
+                IS_SOCKET_ERROR(
+                    setsockopt(
+                        socket,
+                        IPPROTO_TCP,
+                        TCP_USER_TIMEOUT,
+                        (const char*)&timeout,
+                        sizeof(timeout)
+                    )
+                )
+            ) {
+                fprintf(stderr, "error: unable to set user timeout\n");
+                return false;
+            }
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        bool ApplyWritePolicy() {
+            if (isLocal) {
+                return true;
+            }
+            int noDelay = (writePolicy == WritePolicy::Default) ? 0 : 1;
+            if (
+                IS_SOCKET_ERROR(
+                    setsockopt(
+                        socket,
+                        IPPROTO_TCP,
+                        TCP_NODELAY,
+                        (const char*)&noDelay,
+                        sizeof(noDelay)
+                    )
+                )
+            ) {
+                fprintf(stderr, "error: unable to set no-delay option\n");
+                return false;
+            }
+            return true;
+        }
+
+        // Determine whether writes are being held back, in order to gather
+        // more messages to send together.
+        bool IsCoalescing(Clock::time_point now) const {
+            if (
+                (writePolicy != WritePolicy::AutoCork)
+                || (coalesceWindow.count() == 0)
+                || flushRequested
+                || writeClosed
+                || buffersToSend.empty()
+            ) {
+                return false;
+            }
+            const auto& first = buffersToSend.front();
+            return (
+                (first.offset == 0)
+                && (sendQueueBytes.Get() < maximumCoalesceSize)
+                && (now < sendQueueStarted + coalesceWindow)
+            );
+        }
+
+        // Put the given data in frames to be sent.  If asked to compress
+        // (which needs the compression mutex to be held), data at least
+        // as big as the threshold is compressed in blocks, each of which
+        // is sent as is if it doesn't get any smaller.
+        std::string MakeFrames(const char* data, size_t length, bool compress) {
+            std::string frames;
+            if (
+                !compress
+                || (length < compressionThreshold)
+                || !peerDecompresses
+            ) {
+                frames.reserve(length + (length / maximumFrameLength + 1) * frameHeaderSize);
+                size_t offset = 0;
+                do {
+                    const auto frameLength = std::min(length - offset, maximumFrameLength);
+                    AppendFrameHeader(FrameType::Plain, frameLength, frames);
+                    (void)frames.append(data + offset, frameLength);
+                    offset += frameLength;
+                } while (offset < length);
+                return frames;
+            }
+            frames.reserve(
+                length
+                + (length / compressionBlockSize + 1) * (frameHeaderSize + compressedHeaderSize)
+            );
+            const auto start = Clock::now();
+            for (size_t offset = 0; offset < length; offset += compressionBlockSize) {
+                const auto blockLength = std::min(length - offset, compressionBlockSize);
+                const auto frameStart = frames.length();
+                const auto overhead = frameHeaderSize + compressedHeaderSize;
+                const auto capacity = (
+                    (blockLength > compressedHeaderSize)
+                    ? (blockLength - compressedHeaderSize - 1)
+                    : 0
+                );
+                frames.resize(frameStart + overhead + capacity);
+                const auto frame = (uint8_t*)&frames[frameStart];
+                const auto compressedLength = compressor->Compress(
+                    (const uint8_t*)data + offset,
+                    blockLength,
+                    frame + overhead,
+                    capacity
+                );
+                compressionInputBytes.Add(blockLength);
+                if (compressedLength > 0) {
+                    frame[0] = (uint8_t)FrameType::Compressed;
+                    WriteUint32((uint32_t)(compressedHeaderSize + compressedLength), frame + 1);
+                    WriteUint32((uint32_t)blockLength, frame + frameHeaderSize);
+                    frames.resize(frameStart + overhead + compressedLength);
+                    compressionOutputBytes.Add(compressedHeaderSize + compressedLength);
+                } else {
+                    frames.resize(frameStart);
+                    AppendFrameHeader(FrameType::Plain, blockLength, frames);
+                    (void)frames.append(data + offset, blockLength);
+                    compressionOutputBytes.Add(blockLength);
+                }
+            }
+            compressionNanoseconds.Add(
+                (uint64_t)std::chrono::duration_cast< std::chrono::nanoseconds >(
+                    Clock::now() - start
+                ).count()
+            );
+            return frames;
+        }
+
+        // Take apart frames received, adding the data they carry to the
+        // given message.
+        //
+        // Returns false if the frames are invalid.
+        bool ReceiveFrames(const uint8_t* data, size_t length, std::string& message) {
+            while (length > 0) {
+                if (frameHeaderReceived < frameHeaderSize) {
+                    const auto amount = std::min(frameHeaderSize - frameHeaderReceived, length);
+                    (void)memcpy(frameHeader + frameHeaderReceived, data, amount);
+                    frameHeaderReceived += amount;
+                    data += amount;
+                    length -= amount;
+                    if (frameHeaderReceived < frameHeaderSize) {
+                        break;
+                    }
+                    frameType = (FrameType)frameHeader[0];
+                    frameRemaining = ReadUint32(frameHeader + 1);
+                    framePayload.clear();
+                    if (
+                        (frameType == FrameType::Hello)
+                        ? (
+                            (frameRemaining < helloSize)
+                            || (frameRemaining > maximumHelloSize)
+                        )
+                        : (
+                            !helloReceived
+                            || (
+                                (frameType == FrameType::Compressed)
+                                && (
+                                    (frameRemaining <= compressedHeaderSize)
+                                    || (frameRemaining > compressedHeaderSize + compressionBlockSize)
+                                )
+                            )
+                            || (
+                                (frameType != FrameType::Plain)
+                                && (frameType != FrameType::Compressed)
+                            )
+                        )
+                    ) {
+                        return false;
+                    }
+                } else {
+                    const auto amount = std::min(frameRemaining, length);
+                    if (frameType == FrameType::Plain) {
+                        (void)message.append((const char*)data, amount);
+                    } else {
+                        (void)framePayload.append((const char*)data, amount);
+                    }
+                    frameRemaining -= amount;
+                    data += amount;
+                    length -= amount;
+                }
+                if (frameRemaining == 0) {
+                    frameHeaderReceived = 0;
+                    if (!FinishFrame(message)) {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }
+
+        bool FinishFrame(std::string& message) {
+            const auto payload = (const uint8_t*)framePayload.data();
+            if (frameType == FrameType::Hello) {
+                if (payload[0] < compressionVersion) {
+                    return false;
+                }
+                peerDecompresses = ((payload[1] & compressionCodecLz) != 0);
+                helloReceived = true;
+            } else if (frameType == FrameType::Compressed) {
+                const auto originalLength = (size_t)ReadUint32(payload);
+                if (originalLength > compressionBlockSize) {
+                    return false;
+                }
+                const auto start = Clock::now();
+                const auto messageLength = message.length();
+                message.resize(messageLength + originalLength);
+                if (
+                    !LzDecompress(
+                        payload + compressedHeaderSize,
+                        framePayload.length() - compressedHeaderSize,
+                        (uint8_t*)&message[messageLength],
+                        originalLength
+                    )
+                ) {
+                    return false;
+                }
+                decompressionInputBytes.Add(framePayload.length());
+                decompressionOutputBytes.Add(originalLength);
+                decompressionNanoseconds.Add(
+                    (uint64_t)std::chrono::duration_cast< std::chrono::nanoseconds >(
+                        Clock::now() - start
+                    ).count()
+                );
+            }
+            return true;
+        }
+
+        // Check whether the application may queue more to be sent, which
+        // it may not while the socket is being handed back (see
+        // BeginRelease) or once it's been taken, since there'd be no
+        // telling whether it went out before the socket changed hands.
+        //
+        // This must be called while holding the mutex.
+        bool CanSend() {
+            if (
+                releasing
+                || released
+            ) {
+                fprintf(stderr, "error: unable to send on a connection being released\n");
+                return false;
+            }
+            return true;
+        }
+
+        // Queue a buffer to be sent.  Buffers are scheduled by start-time
+        // fair queuing: each one's start tag is where its class's previous
+        // buffer finishes, or the current virtual time if that's later, and
+        // its length (weighted by its class) is added to get where it
+        // finishes.  Buffers go out in order of start tag, and then class,
+        // which keeps each class in order, lets higher classes go first,
+        // and shares the connection among busy classes by weight.  A buffer
+        // partly sent is always finished first.
+        void Enqueue(Buffer&& buffer) {
+            buffer.enqueued = Clock::now();
+            if (buffersToSend.empty()) {
+                lastSendProgress = sendQueueStarted = buffer.enqueued;
+                virtualTime = 0;
+                for (auto& lastFinishTag: lastFinishTags) {
+                    lastFinishTag = 0;
+                }
+            }
+            const auto priority = (size_t)buffer.priority;
+            buffer.startTag = std::max(virtualTime, lastFinishTags[priority]);
+            lastFinishTags[priority] = (
+                buffer.startTag
+                + std::max(buffer.Length(), (size_t)1) * sendPriorityCosts[priority]
+            );
+            sendQueueDepth.Add();
+            sendQueueDepths[priority].Add();
+            sendQueueBytes.Add(buffer.Length());
+            auto position = buffersToSend.end();
+            while (position != buffersToSend.begin()) {
+                const auto previous = std::prev(position);
+                if (
+                    (
+                        (previous == buffersToSend.begin())
+                        && (previous->offset > 0)
+                    )
+                    || (previous->startTag < buffer.startTag)
+                    || (
+                        (previous->startTag == buffer.startTag)
+                        && (previous->priority <= buffer.priority)
+                    )
+                ) {
+                    break;
+                }
+                position = previous;
+            }
+            (void)buffersToSend.insert(position, std::move(buffer));
+        }
+
+        // Determine whether everything sent and received is in frames.
+        // Without framing support this is always false, so that the
+        // framing code is compiled out.
+        bool IsFraming() const {
+            return (
+                Policies::framing
+                && framing
+            );
+        }
+
+        // Determine whether writes are waiting for a pipe to have data.
+        bool IsWaitingForPipe(Clock::time_point now) const {
+            return (
+                !buffersToSend.empty()
+                && buffersToSend.front().isPipe
+                && (now < buffersToSend.front().retryAt)
+            );
+        }
+
+        // Determine whether writes are being held back by the rate limit.
+        bool IsPacing(Clock::time_point now) const {
+            return (
+                pacing.IsLimited()
+                && !buffersToSend.empty()
+                && (pacing.GetAllowance(now) == 0)
+            );
+        }
+
+        bool IsReadyToSend() {
+            std::lock_guard< decltype(mutex) > lock(mutex);
+            const auto now = Clock::now();
+            return (
+                !buffersToSend.empty()
+                && !IsCoalescing(now)
+                && !IsWaitingForPipe(now)
+                && !IsPacing(now)
+            );
+        }
+
+        bool OnSocketReady(
+            const OnReceived& onReceived,
+            const OnClosed& onClosed
+        ) {
+            std::unique_lock< decltype(mutex) > lock(mutex);
+            if (error) {
+                return true;
+            }
+            if (zeroCopyOutstanding > 0) {
+                ReadZeroCopyCompletions();
+            }
+            bool readReady = (
+                !releasing
+                && TryReadingSocket(onReceived, onClosed, lock)
+            );
+            bool writeReady = TryWritingSocket(onClosed, lock);
+            if (
+                releasing
+                && !error
+                && buffersToSend.empty()
+                && (zeroCopyOutstanding == 0)
+            ) {
+                released = true;
+                socketEventLoop.Stop();
+                return true;
+            }
+            if (!error) {
+                writeReady = UpdateTimers(onClosed, lock) || writeReady;
+            }
+            if (
+                error
+                || (
+                    readClosed
+                    && writeClosed
+                    && buffersToSend.empty()
+                )
+            ) {
+                socketEventLoop.Stop();
+            }
+            return !readReady && !writeReady;
+        }
+
+        // Read what's available from the socket and deliver it.  Normally
+        // this is one read per call; with batched receive, reads continue
+        // until the socket would block (or a batch limit is reached), and
+        // everything read is delivered in a single call to the callback.
+        //
+        // Returns true if there may be more to read right away.
+        bool TryReadingSocket(
+            const OnReceived& onReceived,
+            const OnClosed& onClosed,
+            std::unique_lock< decltype(mutex) >& lock
+        ) {
+            if (readClosed) {
+                return false;
+            }
+            std::string message;
+            bool closed = false;
+            bool mayHaveMore = true;
+            do {
+                receiveCalls.Add();
+                const int amountReceived = recv(
+                    socket,
+                    (char*)receiveBuffer,
+                    (SOCKET_DATAGRAM_LENGTH_TYPE)Policies::receiveBufferSize,
+                    0
+                );
+                if (IS_SOCKET_ERROR(amountReceived)) {
+                    if (LAST_SOCKET_OPERATION_WOULD_BLOCK) {
+                        receiveWouldBlock.Add();
+                        TraceEvent(Trace::EventType::WouldBlock, (int64_t)socket);
+                    } else {
+                        error = true;
+                        TraceEvent(Trace::EventType::Error, (int64_t)socket);
+                        if (!LAST_SOCKET_OPERATION_WAS_RESET) {
+                            fprintf(stderr, "error: unable to read socket\n");
+                        }
+                        closed = true;
+                    }
+                    mayHaveMore = false;
+                } else if (amountReceived > 0) {
+                    lastReceived = Clock::now();
+                    bytesReceived.Add((uint64_t)amountReceived);
+                    TraceEvent(Trace::EventType::Receive, (int64_t)socket, (uint64_t)amountReceived);
+                    if (!IsFraming()) {
+                        (void)message.append(
+                            receiveBuffer,
+                            receiveBuffer + amountReceived
+                        );
+                    } else if (!ReceiveFrames(receiveBuffer, (size_t)amountReceived, message)) {
+                        error = true;
+                        TraceEvent(Trace::EventType::Error, (int64_t)socket);
+                        fprintf(stderr, "error: invalid frame received\n");
+                        (void)shutdown(socket, SD_BOTH);
+                        socketEventLoop.StopReading();
+                        closed = true;
+                        mayHaveMore = false;
+                    }
+                } else {
+                    readClosed = true;
+                    socketEventLoop.StopReading();
+                    TraceEvent(Trace::EventType::Close, (int64_t)socket);
+                    closed = true;
+                    mayHaveMore = false;
+                }
+            } while (
+                mayHaveMore
+                && batchedReceive
+                && (message.length() < maximumBatchReads * Policies::receiveBufferSize)
+            );
+            if (!message.empty()) {
+                messagesReceived.Add();
+                if (capture) {
+                    capture->Append(
+                        captureStream,
+                        Capture::Direction::Inbound,
+                        Capture::Transport::Stream,
+                        message
+                    );
+                }
+                lock.unlock();
+                const auto handlerStart = Clock::now();
+                onReceived(message);
+                const auto handlerEnd = Clock::now();
+                lock.lock();
+                receiveHandlerTime.Record(handlerEnd - handlerStart);
+            }
+            if (closed) {
+                lock.unlock();
+                onClosed();
+                lock.lock();
+            }
+            return (
+                mayHaveMore
+                && !message.empty()
+            );
+        }
+
+        // Write queued data to the socket.  Normally this is the rest of
+        // the first queued message; with the auto-cork write policy, it's as
+        // many queued messages as can be written in one operation.  Data
+        // from files is written on its own, one chunk at a time.
+        //
+        // Returns true if there's more to write right away.
+        bool TryWritingSocket(
+            const OnClosed& onClosed,
+            std::unique_lock< decltype(mutex) >& lock
+        ) {
+            const auto start = Clock::now();
+            if (
+                buffersToSend.empty()
+                || IsCoalescing(start)
+                || IsWaitingForPipe(start)
+            ) {
+                return false;
+            }
+            if (IsPacing(start)) {
+                if (pacing.Stall(start)) {
+                    throttleStalls.Add();
+                }
+                return false;
+            }
+            throttledNanoseconds.Add(
+                (uint64_t)std::chrono::duration_cast< std::chrono::nanoseconds >(
+                    pacing.Resume(start)
+                ).count()
+            );
+            const auto allowance = pacing.GetAllowance(start);
+            auto& first = buffersToSend.front();
+            long long amountSent;
+            size_t amountToSend = 0;
+            sendCalls.Add();
+            if (first.IsFile()) {
+                amountToSend = std::min(
+                    std::min(first.fileLength - first.offset, maximumFileChunkSize),
+                    allowance
+                );
+                amountSent = SendFileData(
+                    socket,
+                    first.file.handle,
+                    first.isPipe,
+                    first.fileOffset + first.offset,
+                    amountToSend
+                );
+                if (amountSent == 0) {
+                    // The file or pipe ended early, so give up on the rest.
+                    sendQueueBytes.Subtract(first.fileLength - first.offset);
+                    first.fileLength = first.offset;
+                    CompleteFirstBuffer(start);
+                    return FinishWriting();
+                }
+                if (
+                    IS_SOCKET_ERROR(amountSent)
+                    && LAST_SOCKET_OPERATION_WOULD_BLOCK
+                    && first.isPipe
+                ) {
+                    // Either the pipe or the socket isn't ready, and the
+                    // event loop can only watch the socket, so check back
+                    // in a little while.
+                    first.retryAt = start + pipeRetryInterval;
+                }
+            } else if (
+                zeroCopyEnabled
+                && (first.Message().length() >= zeroCopyThreshold)
+            ) {
+                // The operating system keeps reading the message after the
+                // send returns, so the data mustn't move when the buffer
+                // does, as it may with a string's own storage (in the
+                // queue, or if the string is short enough to be stored
+                // inline).  A shared message is never moved.
+                if (!first.sharedMessage) {
+                    first.sharedMessage = std::make_shared< const std::string >(
+                        std::move(first.message)
+                    );
+                    first.message.clear();
+                }
+                amountToSend = std::min(first.Message().length() - first.offset, allowance);
+                amountSent = SendZeroCopy(
+                    socket,
+                    first.Message().c_str() + first.offset,
+                    amountToSend
+                );
+                if (!IS_SOCKET_ERROR(amountSent)) {
+                    first.zeroCopy = true;
+                    first.zeroCopySequence = zeroCopyNextSequence++;
+                    ++zeroCopyOutstanding;
+                    zeroCopySends.Add();
+                }
+            } else {
+                SendBuffer pieces[maximumSendBuffers];
+                size_t numPieces = 0;
+                const size_t maximumPieces = (
+                    (writePolicy == WritePolicy::AutoCork)
+                    ? maximumSendBuffers
+                    : 1
+                );
+                for (
+                    auto buffer = buffersToSend.begin();
+                    (
+                        (buffer != buffersToSend.end())
+                        && !buffer->IsFile()
+                        && !(
+                            zeroCopyEnabled
+                            && (buffer->Message().length() >= zeroCopyThreshold)
+                        )
+                        && (numPieces < maximumPieces)
+                        && (amountToSend < allowance)
+                    );
+                    ++buffer
+                ) {
+                    pieces[numPieces].data = buffer->Message().c_str() + buffer->offset;
+                    pieces[numPieces].length = std::min(
+                        buffer->Message().length() - buffer->offset,
+                        allowance - amountToSend
+                    );
+                    amountToSend += pieces[numPieces].length;
+                    ++numPieces;
+                }
+                amountSent = SendBuffers(
+                    socket,
+                    pieces,
+                    numPieces,
+                    (
+                        (writePolicy == WritePolicy::AutoCork)
+                        && (numPieces < buffersToSend.size())
+                    )
+                );
+            }
+            if (IS_SOCKET_ERROR(amountSent)) {
+                if (LAST_SOCKET_OPERATION_WOULD_BLOCK) {
+                    sendWouldBlock.Add();
+                    TraceEvent(Trace::EventType::WouldBlock, (int64_t)socket);
+                } else {
+                    error = true;
+                    TraceEvent(Trace::EventType::Error, (int64_t)socket);
+                    if (!LAST_SOCKET_OPERATION_WAS_RESET) {
+                        fprintf(stderr, "error: unable to write socket\n");
+                    }
+                    lock.unlock();
+                    onClosed();
+                    lock.lock();
+                }
+                return false;
+            }
+            const auto now = Clock::now();
+            if (amountSent > 0) {
+                lastSent = lastSendProgress = now;
+            }
+            pacing.Consume((size_t)amountSent, now);
+            bytesSent.Add((uint64_t)amountSent);
+            TraceEvent(Trace::EventType::Send, (int64_t)socket, (uint64_t)amountSent);
+            sendQueueBytes.Subtract((uint64_t)amountSent);
+            // Empty buffers are completed along with the rest, even when
+            // nothing else was sent.
+            auto amountRemaining = (size_t)amountSent;
+            while (
+                !buffersToSend.empty()
+                && (
+                    (amountRemaining > 0)
+                    || (buffersToSend.front().offset >= buffersToSend.front().Length())
+                )
+            ) {
+                auto& buffer = buffersToSend.front();
+                const auto amountFromBuffer = std::min(
+                    amountRemaining,
+                    buffer.Length() - buffer.offset
+                );
+                buffer.offset += amountFromBuffer;
+                amountRemaining -= amountFromBuffer;
+                if (buffer.offset >= buffer.Length()) {
+                    CompleteFirstBuffer(now);
+                }
+            }
+            if ((size_t)amountSent < amountToSend) {
+                const auto& buffer = buffersToSend.front();
+                partialWrites.Add();
+                TraceEvent(
+                    Trace::EventType::PartialWrite,
+                    (int64_t)socket,
+                    (uint64_t)(buffer.Length() - buffer.offset)
+                );
+            }
+            return FinishWriting();
+        }
+
+        void CompleteFirstBuffer(Clock::time_point now) {
+            auto& buffer = buffersToSend.front();
+            messagesSent.Add();
+            sendQueueDepth.Subtract();
+            sendQueueDepths[(size_t)buffer.priority].Subtract();
+            virtualTime = buffer.startTag;
+            sendQueueResidency.Record(now - buffer.enqueued);
+            if (buffer.zeroCopy) {
+                zeroCopyPending.push_back(std::move(buffer));
+            }
+            buffersToSend.pop_front();
+        }
+
+        // Release messages which were sent without copying, as the
+        // operating system reports that it no longer needs them.
+        void ReadZeroCopyCompletions() {
+            uint32_t first, last;
+            bool copied;
+            while (ReadZeroCopyCompletion(socket, first, last, copied)) {
+                if ((int32_t)(last - first) < 0) {
+                    continue;
+                }
+                const auto count = (uint64_t)(last - first) + 1;
+                zeroCopyCompletions.Add(count);
+                if (copied) {
+                    zeroCopyCopied.Add(count);
+                }
+                zeroCopyOutstanding -= std::min(count, zeroCopyOutstanding);
+                while (
+                    !zeroCopyPending.empty()
+                    && ((int32_t)(zeroCopyPending.front().zeroCopySequence - last) <= 0)
+                ) {
+                    zeroCopyPending.pop_front();
+                }
+            }
+        }
+
+        // Returns true if there's more to write right away.
+        bool FinishWriting() {
+            if (!buffersToSend.empty()) {
+                return true;
+            }
+            flushRequested = false;
+            if (writeClosed) {
+                (void)shutdown(socket, SD_SEND);
+            }
+            return false;
+        }
+
+        // Check the idle timers, closing the connection if any have expired
+        // and queuing a heartbeat if one is due.  Afterwards, tell the event
+        // loop how long it may wait before the next timer needs attention.
+        //
+        // Returns true if a heartbeat was queued and needs to be sent.
+        bool UpdateTimers(
+            const OnClosed& onClosed,
+            std::unique_lock< decltype(mutex) >& lock
+        ) {
+            const auto now = Clock::now();
+            const auto lastActivity = std::max(lastReceived, lastSent);
+            if (
+                (
+                    (readTimeout.count() > 0)
+                    && !readClosed
+                    && (now - lastReceived >= readTimeout)
+                )
+                || (
+                    (writeTimeout.count() > 0)
+                    && !buffersToSend.empty()
+                    && (now - lastSendProgress >= writeTimeout)
+                )
+                || (
+                    (idleTimeout.count() > 0)
+                    && (now - lastActivity >= idleTimeout)
+                )
+            ) {
+                error = true;
+                TraceEvent(Trace::EventType::Close, (int64_t)socket);
+                (void)shutdown(socket, SD_BOTH);
+                lock.unlock();
+                onClosed();
+                lock.lock();
+                return false;
+            }
+            bool heartbeatQueued = false;
+            if (
+                (heartbeatInterval.count() > 0)
+                && !writeClosed
+                && buffersToSend.empty()
+                && (now - lastSent >= heartbeatInterval)
+            ) {
+                Buffer buffer;
+                buffer.priority = SendPriority::High;
+                if (IsFraming()) {
+                    buffer.message = MakeFrames(
+                        heartbeatMessage.data(),
+                        heartbeatMessage.length(),
+                        false
+                    );
+                } else {
+                    buffer.message = heartbeatMessage;
+                }
+                Enqueue(std::move(buffer));
+                heartbeatQueued = true;
+            }
+            ScheduleTimers(now);
+            return heartbeatQueued;
+        }
+
+        void ScheduleTimers(Clock::time_point now) {
+            auto nextDeadline = Clock::time_point::max();
+            if (
+                (readTimeout.count() > 0)
+                && !readClosed
+            ) {
+                nextDeadline = std::min(nextDeadline, lastReceived + readTimeout);
+            }
+            if (
+                (writeTimeout.count() > 0)
+                && !buffersToSend.empty()
+            ) {
+                nextDeadline = std::min(nextDeadline, lastSendProgress + writeTimeout);
+            }
+            if (idleTimeout.count() > 0) {
+                nextDeadline = std::min(
+                    nextDeadline,
+                    std::max(lastReceived, lastSent) + idleTimeout
+                );
+            }
+            if (
+                (heartbeatInterval.count() > 0)
+                && !writeClosed
+            ) {
+                nextDeadline = std::min(nextDeadline, lastSent + heartbeatInterval);
+            }
+            if (IsCoalescing(now)) {
+                nextDeadline = std::min(
+                    nextDeadline,
+                    sendQueueStarted + coalesceWindow
+                );
+            }
+            if (IsWaitingForPipe(now)) {
+                nextDeadline = std::min(nextDeadline, buffersToSend.front().retryAt);
+            }
+            if (IsPacing(now)) {
+                nextDeadline = std::min(nextDeadline, pacing.GetNextAllowance(now));
+            }
+            if (nextDeadline == Clock::time_point::max()) {
+                socketEventLoop.SetTimeout(std::chrono::microseconds(0));
+            } else {
+                const auto remaining = std::chrono::duration_cast< std::chrono::microseconds >(
+                    nextDeadline - now
+                ) + std::chrono::microseconds(1);
+                socketEventLoop.SetTimeout(
+                    std::max(remaining, std::chrono::microseconds(1))
+                );
+            }
+        }
+    };
+
+    template< class Policies >
+    BasicConnection< Policies >::BasicConnection()
+        : impl_(new Impl())
+    {
+    }
+
+    template< class Policies >
+    BasicConnection< Policies >::BasicConnection(const std::shared_ptr< SlabPool >& pool)
+        : impl_(std::allocate_shared< Impl >(SlabAllocator< Impl >(pool)))
+    {
+    }
+
+    template< class Policies >
+    bool BasicConnection< Policies >::BeginRelease() {
+        std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+        if (
+            IS_INVALID_SOCKET(impl_->socket)
+            || impl_->error
+            || impl_->readClosed
+            || impl_->writeClosed
+            || impl_->IsFraming()
+        ) {
+            return false;
+        }
+        impl_->releasing = true;
+        impl_->socketEventLoop.StopReading();
+        impl_->socketEventLoop.UserEvent();
+        return true;
+    }
+
+    template< class Policies >
+    void BasicConnection< Policies >::Close() {
+        std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+        impl_->writeClosed = true;
+        if (impl_->buffersToSend.empty()) {
+            (void)shutdown(impl_->socket, SD_SEND);
+        } else {
+            impl_->socketEventLoop.UserEvent();
+        }
+    }
+
+    template< class Policies >
+    SOCKET BasicConnection< Policies >::EndRelease(Clock::time_point deadline) {
+        // The worker thread says when the socket is ready, and the lock may
+        // not be one which can be waited on, so check back now and then.
+        for (;;) {
+            {
+                std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+                if (!impl_->releasing) {
+                    return INVALID_SOCKET;
+                }
+                if (impl_->released) {
+                    break;
+                }
+                if (
+                    impl_->error
+                    || (Clock::now() >= deadline)
+                ) {
+                    impl_->releasing = false;
+                    if (!impl_->error) {
+                        impl_->socketEventLoop.StartReading();
+                    }
+                    return INVALID_SOCKET;
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        impl_->socketEventLoop.Join();
+        std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+        const auto socket = impl_->socket;
+        impl_->socket = INVALID_SOCKET;
+        impl_->releasing = false;
+        return socket;
+    }
+
+    template< class Policies >
+    void BasicConnection< Policies >::Flush() {
+        std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+        if (impl_->buffersToSend.empty()) {
+            return;
+        }
+        impl_->flushRequested = true;
+        impl_->socketEventLoop.UserEvent();
+    }
+
+    template< class Policies >
+    LatencyHistograms BasicConnection< Policies >::GetLatencyHistograms() const {
+        LatencyHistograms histograms;
+        histograms.sendQueueResidency = impl_->sendQueueResidency.GetHistogram();
+        histograms.wakeupDelay = impl_->socketEventLoop.GetWakeupDelay();
+        histograms.receiveHandlerTime = impl_->receiveHandlerTime.GetHistogram();
+        return histograms;
+    }
+
+    template< class Policies >
+    size_t BasicConnection< Policies >::GetSendQueueBytes() const {
+        return (size_t)impl_->sendQueueBytes.Get();
+    }
+
+    template< class Policies >
+    ConnectionStatistics BasicConnection< Policies >::GetStatistics() const {
+        ConnectionStatistics statistics;
+        statistics.bytesReceived = impl_->bytesReceived.Get();
+        statistics.bytesSent = impl_->bytesSent.Get();
+        statistics.messagesReceived = impl_->messagesReceived.Get();
+        statistics.messagesSent = impl_->messagesSent.Get();
+        statistics.receiveCalls = impl_->receiveCalls.Get();
+        statistics.sendCalls = impl_->sendCalls.Get();
+        statistics.partialWrites = impl_->partialWrites.Get();
+        statistics.receiveWouldBlock = impl_->receiveWouldBlock.Get();
+        statistics.sendWouldBlock = impl_->sendWouldBlock.Get();
+        statistics.sendQueueDepth = impl_->sendQueueDepth.Get();
+        statistics.sendQueueBytes = impl_->sendQueueBytes.Get();
+        statistics.zeroCopySends = impl_->zeroCopySends.Get();
+        statistics.zeroCopyCompletions = impl_->zeroCopyCompletions.Get();
+        statistics.zeroCopyCopied = impl_->zeroCopyCopied.Get();
+        statistics.compressionInputBytes = impl_->compressionInputBytes.Get();
+        statistics.compressionOutputBytes = impl_->compressionOutputBytes.Get();
+        statistics.compressionNanoseconds = impl_->compressionNanoseconds.Get();
+        statistics.decompressionInputBytes = impl_->decompressionInputBytes.Get();
+        statistics.decompressionOutputBytes = impl_->decompressionOutputBytes.Get();
+        statistics.decompressionNanoseconds = impl_->decompressionNanoseconds.Get();
+        statistics.throttleStalls = impl_->throttleStalls.Get();
+        statistics.throttledNanoseconds = impl_->throttledNanoseconds.Get();
+        statistics.sendQueueDepthHigh = impl_->sendQueueDepths[(size_t)SendPriority::High].Get();
+        statistics.sendQueueDepthNormal = impl_->sendQueueDepths[(size_t)SendPriority::Normal].Get();
+        statistics.sendQueueDepthBulk = impl_->sendQueueDepths[(size_t)SendPriority::Bulk].Get();
+        statistics.eventLoop = impl_->socketEventLoop.GetStatistics();
+        return statistics;
+    }
+
+    template< class Policies >
+    bool BasicConnection< Policies >::IsSending() const {
+        std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+        return (
+            !impl_->error
+            && !impl_->buffersToSend.empty()
+        );
+    }
+
+    template< class Policies >
+    void BasicConnection< Policies >::SendMessage(
+        const std::string& message,
+        SendPriority priority
+    ) {
+        if (impl_->IsFraming()) {
+            std::lock_guard< decltype(impl_->compressionMutex) > compressionLock(impl_->compressionMutex);
+            typename Impl::Buffer buffer;
+            buffer.priority = priority;
+            buffer.message = impl_->MakeFrames(message.data(), message.length(), true);
+            std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+            if (!impl_->CanSend()) {
+                return;
+            }
+            impl_->CaptureOutbound(message);
+            impl_->Enqueue(std::move(buffer));
+            impl_->socketEventLoop.UserEvent();
+            return;
+        }
+        std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+        if (!impl_->CanSend()) {
+            return;
+        }
+        impl_->CaptureOutbound(message);
+        typename Impl::Buffer buffer;
+        buffer.priority = priority;
+        buffer.message = message;
+        impl_->Enqueue(std::move(buffer));
+        impl_->socketEventLoop.UserEvent();
+    }
+
+    template< class Policies >
+    void BasicConnection< Policies >::SendMessage(
+        const std::shared_ptr< const std::string >& message,
+        SendPriority priority
+    ) {
+        if (impl_->IsFraming()) {
+            SendMessage(*message, priority);
+            return;
+        }
+        std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+        if (!impl_->CanSend()) {
+            return;
+        }
+        impl_->CaptureOutbound(*message);
+        typename Impl::Buffer buffer;
+        buffer.priority = priority;
+        buffer.sharedMessage = message;
+        impl_->Enqueue(std::move(buffer));
+        impl_->socketEventLoop.UserEvent();
+    }
+
+    template< class Policies >
+    bool BasicConnection< Policies >::SendFile(
+        int file,
+        uint64_t offset,
+        size_t length
+    ) {
+        if (impl_->IsFraming()) {
+            fprintf(stderr, "error: files can't be sent with compression enabled\n");
+            return false;
+        }
+        typename Impl::Buffer buffer;
+        buffer.file.handle = DuplicateFile(file, buffer.isPipe);
+        if (buffer.file.handle < 0) {
+            fprintf(stderr, "error: unable to use file for sending\n");
+            return false;
+        }
+        buffer.fileOffset = offset;
+        buffer.fileLength = length;
+        std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+        if (!impl_->CanSend()) {
+            return false;
+        }
+        impl_->Enqueue(std::move(buffer));
+        impl_->socketEventLoop.UserEvent();
+        return true;
+    }
+
+    template< class Policies >
+    void BasicConnection< Policies >::SendMessages(
+        const std::vector< std::string >& messages,
+        SendPriority priority
+    ) {
+        if (messages.empty()) {
+            return;
+        }
+
+        // With compression, the whole batch is compressed together, which
+        // helps when the messages are small and alike.
+        if (impl_->IsFraming()) {
+            std::string batch;
+            size_t batchLength = 0;
+            for (const auto& message: messages) {
+                batchLength += message.length();
+            }
+            batch.reserve(batchLength);
+            for (const auto& message: messages) {
+                (void)batch.append(message);
+            }
+            std::lock_guard< decltype(impl_->compressionMutex) > compressionLock(impl_->compressionMutex);
+            typename Impl::Buffer buffer;
+            buffer.priority = priority;
+            buffer.message = impl_->MakeFrames(batch.data(), batch.length(), true);
+            std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+            if (!impl_->CanSend()) {
+                return;
+            }
+            for (const auto& message: messages) {
+                impl_->CaptureOutbound(message);
+            }
+            impl_->Enqueue(std::move(buffer));
+            impl_->socketEventLoop.UserEvent();
+            return;
+        }
+        std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+        if (!impl_->CanSend()) {
+            return;
+        }
+        for (const auto& message: messages) {
+            impl_->CaptureOutbound(message);
+            typename Impl::Buffer buffer;
+            buffer.priority = priority;
+            buffer.message = message;
+            impl_->Enqueue(std::move(buffer));
+        }
+        impl_->socketEventLoop.UserEvent();
+    }
+
+    template< class Policies >
+    void BasicConnection< Policies >::SetBatchedReceive(bool batchedReceive) {
+        std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+        impl_->batchedReceive = batchedReceive;
+    }
+
+    template< class Policies >
+    void BasicConnection< Policies >::SetCapture(const std::shared_ptr< Capture >& capture) {
+        std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+        impl_->capture = capture;
+        impl_->captureStream = capture ? capture->NewStream() : 0;
+    }
+
+    template< class Policies >
+    bool BasicConnection< Policies >::SetCompression(bool compression, size_t threshold) {
+        std::lock_guard< decltype(impl_->compressionMutex) > compressionLock(impl_->compressionMutex);
+        std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+        if (
+            !IS_INVALID_SOCKET(impl_->socket)
+            || !impl_->buffersToSend.empty()
+        ) {
+            fprintf(stderr, "error: compression must be set up before anything is sent\n");
+            return false;
+        }
+        if (!compression) {
+            return true;
+        }
+        if (!Policies::framing) {
+            fprintf(stderr, "error: compression isn't supported by this connection\n");
+            return false;
+        }
+        impl_->compressor.reset(new LzCompressor());
+        impl_->compressionThreshold = threshold;
+        impl_->framing = true;
+
+        // Say hello first, so the other side knows what we can decompress.
+        typename Impl::Buffer buffer;
+        buffer.priority = SendPriority::High;
+        AppendFrameHeader(FrameType::Hello, helloSize, buffer.message);
+        buffer.message.push_back((char)compressionVersion);
+        buffer.message.push_back((char)compressionCodecLz);
+        impl_->Enqueue(std::move(buffer));
+        return true;
+    }
+
+    template< class Policies >
+    void BasicConnection< Policies >::SetHeartbeat(
+        std::chrono::milliseconds interval,
+        const std::string& message
+    ) {
+        std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+        impl_->heartbeatInterval = interval;
+        impl_->heartbeatMessage = message;
+        impl_->socketEventLoop.UserEvent();
+    }
+
+    template< class Policies >
+    void BasicConnection< Policies >::SetIdleTimeouts(
+        std::chrono::milliseconds readTimeout,
+        std::chrono::milliseconds writeTimeout,
+        std::chrono::milliseconds idleTimeout
+    ) {
+        std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+        impl_->readTimeout = readTimeout;
+        impl_->writeTimeout = writeTimeout;
+        impl_->idleTimeout = idleTimeout;
+        impl_->socketEventLoop.UserEvent();
+    }
+
+    template< class Policies >
+    bool BasicConnection< Policies >::SetKeepAlive(
+        std::chrono::seconds idle,
+        std::chrono::seconds interval,
+        unsigned int count
+    ) {
+        std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+        impl_->keepAliveConfigured = true;
+        impl_->keepAliveIdle = idle;
+        impl_->keepAliveInterval = interval;
+        impl_->keepAliveCount = count;
+        if (IS_INVALID_SOCKET(impl_->socket)) {
+            return true;
+        }
+        return impl_->ApplyKeepAlive();
+    }
+
+    template< class Policies >
+    void BasicConnection< Policies >::SetRateLimit(uint64_t bytesPerSecond, size_t burst) {
+        std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+        impl_->rateLimit = bytesPerSecond;
+        impl_->pacing.Configure(bytesPerSecond, burst, Clock::now());
+        impl_->socketEventLoop.UserEvent();
+        if (!IS_INVALID_SOCKET(impl_->socket)) {
+            (void)SetPacingRate(impl_->socket, bytesPerSecond);
+        }
+    }
+
+    template< class Policies >
+    bool BasicConnection< Policies >::SetUserTimeout(std::chrono::milliseconds timeout) {
+        std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+        impl_->userTimeoutConfigured = true;
+        impl_->userTimeout = timeout;
+        if (IS_INVALID_SOCKET(impl_->socket)) {
+            return true;
+        }
+        return impl_->ApplyUserTimeout();
+    }
+
+    template< class Policies >
+    bool BasicConnection< Policies >::SetWritePolicy(
+        WritePolicy writePolicy,
+        std::chrono::microseconds coalesceWindow
+    ) {
+        std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+        impl_->writePolicy = writePolicy;
+        impl_->coalesceWindow = coalesceWindow;
+        impl_->socketEventLoop.UserEvent();
+        if (IS_INVALID_SOCKET(impl_->socket)) {
+            return true;
+        }
+        return impl_->ApplyWritePolicy();
+    }
+
+    template< class Policies >
+    bool BasicConnection< Policies >::SetZeroCopyThreshold(size_t threshold) {
+        std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+        impl_->zeroCopyThreshold = threshold;
+        if (threshold == 0) {
+            impl_->zeroCopyEnabled = false;
+            return true;
+        }
+        if (IS_INVALID_SOCKET(impl_->socket)) {
+            return true;
+        }
+        impl_->zeroCopyEnabled = EnableZeroCopy(impl_->socket);
+        return impl_->zeroCopyEnabled;
+    }
+
+    template< class Policies >
+    bool BasicConnection< Policies >::Start(
+        SOCKET socket,
+        OnReceived onReceived,
+        OnClosed onClosed
+    ) {
+        {
+            std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+            impl_->socket = socket;
+            struct sockaddr_storage socketAddress;
+            auto socketAddressLength = (SOCKADDR_LENGTH_TYPE)sizeof(socketAddress);
+            impl_->isLocal = (
+                (getsockname(socket, (struct sockaddr*)&socketAddress, &socketAddressLength) == 0)
+                && (socketAddress.ss_family == AF_UNIX)
+            );
+            if (impl_->keepAliveConfigured) {
+                (void)impl_->ApplyKeepAlive();
+            }
+            if (impl_->userTimeoutConfigured) {
+                (void)impl_->ApplyUserTimeout();
+            }
+            if (impl_->writePolicy != WritePolicy::Default) {
+                (void)impl_->ApplyWritePolicy();
+            }
+            if (impl_->zeroCopyThreshold > 0) {
+                impl_->zeroCopyEnabled = EnableZeroCopy(socket);
+            }
+            if (impl_->rateLimit > 0) {
+                (void)SetPacingRate(socket, impl_->rateLimit);
+            }
+            const auto now = Clock::now();
+            impl_->lastReceived = now;
+            impl_->lastSent = now;
+            impl_->lastSendProgress = now;
+            impl_->ScheduleTimers(now);
+        }
+        std::weak_ptr< Impl > implWeak(impl_);
+        return impl_->socketEventLoop.Start(
+            impl_->socket,
+
+            // isReadyToSend
+            SocketEventLoop::IsReadyToSend::BindWeak< Impl, &Impl::IsReadyToSend >(
+                implWeak,
+                false
+            ),
+
+            // onSocketReady
+            [
+                implWeak,
+                onReceived,
+                onClosed
+            ]{
+                const auto impl = implWeak.lock();
+                if (!impl) {
+                    return true;
+                }
+                return impl->OnSocketReady(onReceived, onClosed);
+            }
+        );
+    }
+
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <Sockets/Statistics.hpp>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+namespace Sockets {
+
+    /**
+     * This accepts connections from clients and passes messages among them
+     * by topic: each message published to a topic is sent to every client
+     * subscribed to it.  A message is encoded once when it's published, and
+     * then queued on every subscriber's connection without being copied.
+     *
+     * Clients talk to the broker in frames (see Encode and Decoder), each
+     * holding a command (subscribe, unsubscribe or publish), a topic and,
+     * for publish, a payload.  Messages are delivered to subscribers as
+     * publish frames.
+     *
+     * A subscriber falls behind when more than a set amount of data is
+     * queued up to be sent to it.  What happens to new messages for it then
+     * depends on the slow subscriber policy: they can be dropped, or
+     * conflated so that only the latest message for each topic is sent once
+     * the subscriber catches up, or the subscriber can be disconnected.
+     */
+    class Broker {
+    public:
+        // Types
+        enum class Command : uint8_t {
+            Subscribe = 1,
+            Unsubscribe = 2,
+            Publish = 3,
+        };
+
+        enum class SlowSubscriberPolicy {
+            Drop,
+            Conflate,
+            Disconnect,
+        };
+
+        using OnFrame = std::function<
+            void(
+                Command command,
+                const std::string& topic,
+                const std::string& payload
+            )
+        >;
+
+        /**
+         * This takes apart the frames exchanged with a broker, which may
+         * arrive in any number of pieces.
+         */
+        class Decoder {
+        public:
+            // Methods
+
+            /**
+             * Take in the next piece of data, calling the given function
+             * for each frame completed by it.
+             *
+             * Returns false if the data isn't valid, including when a
+             * frame's payload is longer than maximumPayloadLength.
+             */
+            bool Decode(const std::string& data, const OnFrame& onFrame);
+
+        private:
+            // Properties
+            std::string buffer_;
+        };
+
+        // Constants
+        static constexpr size_t defaultMaximumQueueBytes = 1048576;
+        static constexpr size_t maximumTopicLength = 65535;
+
+        // Frames with longer payloads are rejected, so that a client can't
+        // make the broker buffer an arbitrary amount of data.
+        static constexpr size_t maximumPayloadLength = 16777216;
+
+        // Constructor
+        Broker();
+
+        // Methods
+
+        /**
+         * Make a frame to send to a broker.
+         *
+         * Returns an empty string if the topic is longer than
+         * maximumTopicLength or the payload is longer than
+         * maximumPayloadLength.
+         */
+        static std::string Encode(
+            Command command,
+            const std::string& topic,
+            const std::string& payload = std::string()
+        );
+        BrokerStatistics GetStatistics() const;
+        bool Listen(uint16_t port);
+        bool Listen(const std::string& path);
+
+        /**
+         * Send the given message to every client subscribed to the given
+         * topic.  Messages whose topic or payload is too long (see Encode)
+         * are rejected.
+         */
+        void Publish(const std::string& topic, const std::string& payload);
+
+        void SetSlowSubscriberPolicy(
+            SlowSubscriberPolicy policy,
+            size_t maximumQueueBytes = defaultMaximumQueueBytes
+        );
+
+    private:
+        // Properties
+        struct Impl;
+        std::shared_ptr< Impl > impl_;
+    };
+
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <memory>
+#include <Sockets/Statistics.hpp>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+namespace Sockets {
+
+    /**
+     * This records the messages sent and received by connections and
+     * datagram sockets into an append-only, memory-mapped log file, so that
+     * real traffic can be replayed later (for example, by the Replay
+     * program).  Hand a capture to the SetCapture method of each connection
+     * or datagram socket to be recorded; many may share one capture.
+     *
+     * The file is made as big as the given capacity up front and
+     * trimmed to what was recorded when the capture is closed.  Recording
+     * a message takes a slot in the file with a single atomic operation and
+     * copies the message into it; once the file is full, further messages
+     * are dropped (and counted).
+     *
+     * A capture file consists of a FileHeader followed by records, each a
+     * RecordHeader followed by the message and padded to a multiple of
+     * eight bytes, in native byte order.  A record whose direction is zero
+     * marks the end of the data, in case the program ended before the
+     * capture was closed.
+     */
+    class Capture {
+    public:
+        // Types
+        enum class Direction : uint8_t {
+            Inbound = 1,
+            Outbound = 2,
+        };
+        enum class Transport : uint8_t {
+            Stream = 1,
+            Datagram = 2,
+        };
+        struct FileHeader {
+            char magic[8];
+            uint32_t version;
+            uint32_t recordHeaderSize;
+
+            // This is when the capture was opened, in nanoseconds since the
+            // UNIX epoch.  Record timestamps count from here.
+            uint64_t startTime;
+        };
+        struct RecordHeader {
+            // This is when the message was sent or received, in nanoseconds
+            // since the capture was opened.
+            uint64_t timestamp;
+
+            // This identifies the connection or datagram socket which sent
+            // or received the message (see NewStream).
+            uint64_t stream;
+
+            uint32_t length;
+
+            // For datagrams, this is the IPv4 address and port of the other
+            // end, where known.
+            uint32_t address;
+            uint16_t port;
+
+            uint8_t direction;
+            uint8_t transport;
+            uint32_t reserved;
+        };
+        struct Record {
+            uint64_t timestamp = 0;
+            uint64_t stream = 0;
+            Direction direction = Direction::Inbound;
+            Transport transport = Transport::Stream;
+            uint32_t address = 0;
+            uint16_t port = 0;
+            std::string message;
+        };
+
+        /**
+         * This reads back the records of a capture file, in the order in
+         * which they were recorded.
+         */
+        class Reader {
+        public:
+            // Lifecycle
+            ~Reader() noexcept;
+            Reader(const Reader&) = delete;
+            Reader(Reader&&) noexcept = delete;
+            Reader& operator=(const Reader&) = delete;
+            Reader& operator=(Reader&&) noexcept = delete;
+
+            // Constructor
+            Reader() = default;
+
+            // Methods
+            const FileHeader& GetFileHeader() const;
+
+            /**
+             * Read the next record.
+             *
+             * Returns false at the end of the capture.
+             */
+            bool Next(Record& record);
+
+            bool Open(const std::string& path);
+
+        private:
+            // Properties
+            FILE* file_ = nullptr;
+            FileHeader fileHeader_;
+        };
+
+        // Constants
+        static constexpr char magic[8] = {'S', 'K', 'T', 'C', 'A', 'P', 'T', 'R'};
+        static constexpr uint32_t version = 1;
+        static constexpr size_t defaultCapacity = 1073741824;
+
+        // Constructor
+        Capture();
+
+        // Methods
+
+        /**
+         * Record the given message, unless the capture isn't open or is
+         * full.
+         */
+        void Append(
+            uint64_t stream,
+            Direction direction,
+            Transport transport,
+            const std::string& message,
+            uint32_t address = 0,
+            uint16_t port = 0
+        );
+
+        /**
+         * Stop recording, wait for any messages being recorded, and trim
+         * the file to what was recorded.  This is also done when the
+         * capture is destroyed.
+         */
+        void Close();
+
+        CaptureStatistics GetStatistics() const;
+
+        /**
+         * Return a new number to identify a connection or datagram socket
+         * in the capture.
+         */
+        uint64_t NewStream();
+
+        /**
+         * Create the capture file at the given path, replacing any file
+         * already there, and start recording.  No more than the given
+         * capacity of bytes will be recorded.
+         */
+        bool Open(
+            const std::string& path,
+            size_t capacity = defaultCapacity
+        );
+
+    private:
+        // Properties
+        struct Impl;
+        std::shared_ptr< Impl > impl_;
+    };
+
+}
@@ -1,9 +1,17 @@
 #pragma once
 
+#include <chrono>
 #include <functional>
 #include <memory>
+#include <Sockets/Capture.hpp>
+#include <Sockets/LatencyHistogram.hpp>
+#include <Sockets/SendPriority.hpp>
+#include <Sockets/Statistics.hpp>
+#include <Sockets/WritePolicy.hpp>
+#include <stddef.h>
 #include <stdint.h>
 #include <string>
+#include <vector>
 
 namespace Sockets {
 
@@ -18,14 +26,205 @@ namespace Sockets {
 
         // Methods
         bool Bind(uint16_t port = 0);
+
+        /**
+         * Bind to the given local address and port, rather than to any
+         * address, before connecting.
+         */
+        bool Bind(uint32_t address, uint16_t port);
+
         bool Connect(
             uint32_t address,
             uint16_t port,
             OnReceived onReceived,
             OnClosed onClosed
         );
+
+        /**
+         * Connect to a local (Unix domain) socket at the given path, such
+         * as one bound by ServerSocket, instead of a TCP port.  There's no
+         * need to call Bind first; if it was called, the socket it made is
+         * replaced.
+         */
+        bool Connect(
+            const std::string& path,
+            OnReceived onReceived,
+            OnClosed onClosed
+        );
+
         void Close();
-        void SendMessage(const std::string& message);
+
+        /**
+         * Write what's queued right away, rather than holding it back for
+         * the rest of the coalescing window (see SetWritePolicy).
+         */
+        void Flush();
+
+        /**
+         * Return histograms of how long messages waited in the send queue,
+         * how late the connection's thread woke up, and how long the
+         * receive callback took.
+         */
+        LatencyHistograms GetLatencyHistograms() const;
+
+        /**
+         * Return the number of bytes queued to be sent but not yet written
+         * to the socket.
+         */
+        size_t GetSendQueueBytes() const;
+
+        /**
+         * Return counts of what the connection has sent and received, and
+         * of how it went about it, since it was made.
+         */
+        ConnectionStatistics GetStatistics() const;
+
+        /**
+         * Queue a message to be sent.  Messages of higher priority go out
+         * ahead of those of lower priority already queued, and busy
+         * priorities share the connection by weight.
+         */
+        void SendMessage(
+            const std::string& message,
+            SendPriority priority = SendPriority::Normal
+        );
+
+        /**
+         * Send a message which may also be sent on other connections.  The
+         * message is queued without being copied, and must not be changed
+         * afterwards.
+         */
+        void SendMessage(
+            const std::shared_ptr< const std::string >& message,
+            SendPriority priority = SendPriority::Normal
+        );
+
+        /**
+         * Queue the given number of bytes from the given file, starting at
+         * the given offset, to be sent after what's already queued, without
+         * reading them into the program where the operating system allows.
+         * The file is duplicated, so it may be closed once this returns.  A
+         * pipe may be given instead of a file (on Linux only), in which
+         * case the offset is ignored.  Sending stops early, without error,
+         * if the file ends first.
+         *
+         * Returns false if the file can't be used, or compression is on.
+         */
+        bool SendFile(
+            int file,
+            uint64_t offset,
+            size_t length
+        );
+
+        /**
+         * Queue several messages to be sent, more cheaply than sending each
+         * one separately.
+         */
+        void SendMessages(
+            const std::vector< std::string >& messages,
+            SendPriority priority = SendPriority::Normal
+        );
+
+        /**
+         * Choose whether to keep reading until the socket has nothing more
+         * (up to a limit) and deliver everything read in a single call to
+         * the receive callback, rather than delivering each read.
+         */
+        void SetBatchedReceive(bool batchedReceive);
+
+        /**
+         * Record the messages sent and received on the connection in the
+         * given capture, or stop recording them if it's null.  Files sent
+         * with SendFile, heartbeats and compression framing aren't
+         * recorded.
+         */
+        void SetCapture(const std::shared_ptr< Capture >& capture);
+
+        /**
+         * Turn compression on or off.  With it on, messages at least as
+         * big as the threshold are compressed, and everything is sent in
+         * frames, so both sides must turn it on, and before anything is
+         * sent.
+         *
+         * Returns false if it's too late to change.
+         */
+        bool SetCompression(bool compression, size_t threshold = 256);
+
+        /**
+         * Send the given message whenever nothing else has been sent for
+         * the given interval, to keep the connection busy.  An interval of
+         * zero turns heartbeats off.
+         */
+        void SetHeartbeat(
+            std::chrono::milliseconds interval,
+            const std::string& message
+        );
+
+        /**
+         * Close the connection if nothing is received for the read
+         * timeout, if queued data makes no progress for the write timeout,
+         * or if nothing is sent or received for the idle timeout.  A
+         * timeout of zero is never reached.
+         */
+        void SetIdleTimeouts(
+            std::chrono::milliseconds readTimeout,
+            std::chrono::milliseconds writeTimeout,
+            std::chrono::milliseconds idleTimeout
+        );
+
+        /**
+         * Have the operating system probe the connection once it's been
+         * idle for the given time, at the given interval, and give up on
+         * it after the given number of probes go unanswered.
+         *
+         * Returns false if the operating system refuses the settings.
+         */
+        bool SetKeepAlive(
+            std::chrono::seconds idle,
+            std::chrono::seconds interval,
+            unsigned int count
+        );
+
+        /**
+         * Limit the rate at which data is sent, in bytes per second, to
+         * smooth out bursts.  Up to the given burst of bytes (by default,
+         * ten milliseconds' worth) may be written at once; after that,
+         * writes are held back until the rate allows more.  Where it can,
+         * the operating system is also asked to pace packets at the same
+         * rate.  A rate of zero removes the limit.
+         */
+        void SetRateLimit(uint64_t bytesPerSecond, size_t burst = 0);
+
+        /**
+         * Have the operating system give up on the connection if data sent
+         * goes unacknowledged for the given time, where it supports this.
+         *
+         * Returns false if the operating system refuses the setting.
+         */
+        bool SetUserTimeout(std::chrono::milliseconds timeout);
+
+        /**
+         * Choose how to trade off latency against efficiency when writing
+         * (see WritePolicy).  With AutoCork, writes may be held back for
+         * up to the given window after the send queue stops being empty,
+         * to gather more messages.
+         *
+         * Returns false if the operating system refuses the setting.
+         */
+        bool SetWritePolicy(
+            WritePolicy writePolicy,
+            std::chrono::microseconds coalesceWindow = std::chrono::microseconds(0)
+        );
+
+        /**
+         * Send messages at least as big as the given threshold without
+         * copying them into the operating system, where it supports this
+         * (MSG_ZEROCOPY on Linux).  Messages are held until the operating
+         * system is done with them.  A threshold of zero turns this off.
+         *
+         * Returns false if the operating system doesn't support it.
+         */
+        bool SetZeroCopyThreshold(size_t threshold);
 
     private:
         // Properties
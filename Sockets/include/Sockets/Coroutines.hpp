@@ -0,0 +1,414 @@
+#pragma once
+
+/**
+ * This is an optional layer over ClientSocket and ServerSocket for C++20
+ * coroutines, so that code handling a connection can be written as a
+ * straight line of co_await expressions rather than as callbacks.  It's
+ * only available when compiling with coroutine support; the rest of the
+ * library doesn't need it.
+ *
+ * A coroutine waiting on a connection or listener is resumed directly on
+ * the thread which delivered what it was waiting for, inside the
+ * library's callback, so it should hand off anything long-running rather
+ * than holding up that connection.  Waiting allocates nothing: each
+ * operation's state lives in the coroutine frame, and each connection or
+ * listener sets up its callbacks only once.
+ */
+
+#if defined(__cpp_impl_coroutine) && (__cpp_impl_coroutine >= 201902L)
+
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <Sockets/ClientSocket.hpp>
+#include <Sockets/ServerSocket.hpp>
+#include <stdint.h>
+#include <string>
+#include <utility>
+
+namespace Sockets {
+
+    /**
+     * This is the return type for coroutines which run on their own once
+     * called, until they finish, with nothing waiting for them.
+     */
+    class Task {
+    public:
+        // Types
+        struct promise_type {
+            Task get_return_object() noexcept { return Task(); }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() noexcept {}
+            void unhandled_exception() noexcept { std::terminate(); }
+        };
+    };
+
+    /**
+     * This is a connection, either made by connecting to a server or
+     * accepted by a CoroutineListener, which coroutines can wait on to
+     * receive messages.
+     *
+     * Only one coroutine may wait to receive at a time, and the connection
+     * must outlive any coroutine waiting on it.
+     */
+    class CoroutineConnection {
+    private:
+        // Types
+        struct State {
+            // Properties
+
+            // This is used to serialize access to the rest of the state.
+            std::mutex mutex;
+
+            // This holds messages received while no coroutine was waiting.
+            std::deque< std::string > received;
+
+            bool closed = false;
+
+            // This is the coroutine waiting to receive, if any, where to
+            // put what it receives, and where to note that it received
+            // something rather than seeing the connection close.
+            std::coroutine_handle<> waiter;
+            std::string* result = nullptr;
+            bool* resultReceived = nullptr;
+
+            // Methods
+
+            void OnClosed() {
+                std::unique_lock< decltype(mutex) > lock(mutex);
+                closed = true;
+                const auto resumeWaiter = std::exchange(waiter, nullptr);
+                lock.unlock();
+                if (resumeWaiter) {
+                    resumeWaiter.resume();
+                }
+            }
+
+            void OnReceived(const std::string& message) {
+                std::unique_lock< decltype(mutex) > lock(mutex);
+                if (!waiter) {
+                    received.push_back(message);
+                    return;
+                }
+                *result = message;
+                *resultReceived = true;
+                const auto resumeWaiter = std::exchange(waiter, nullptr);
+                lock.unlock();
+                resumeWaiter.resume();
+            }
+        };
+
+    public:
+        // Types
+
+        /**
+         * This is what's awaited to connect.  It results in whether or not
+         * the connection was made.  Connecting is done without suspending,
+         * since ClientSocket connects synchronously.
+         */
+        class ConnectAwaiter {
+        public:
+            // Constructors
+            ConnectAwaiter(
+                CoroutineConnection& connection,
+                uint32_t address,
+                uint16_t port
+            )
+                : connection_(connection)
+                , address_(address)
+                , port_(port)
+            {
+            }
+
+            ConnectAwaiter(
+                CoroutineConnection& connection,
+                const std::string& path
+            )
+                : connection_(connection)
+                , path_(path)
+            {
+            }
+
+            // Methods
+            bool await_ready() const noexcept { return true; }
+            void await_suspend(std::coroutine_handle<>) const noexcept {}
+
+            bool await_resume() {
+                const auto state = connection_.state_;
+                ClientSocket::OnReceived onReceived = [state](const std::string& message){
+                    state->OnReceived(message);
+                };
+                ClientSocket::OnClosed onClosed = [state]{
+                    state->OnClosed();
+                };
+                auto& clientSocket = connection_.clientSocket_;
+                if (path_.empty()) {
+                    return (
+                        clientSocket.Bind()
+                        && clientSocket.Connect(
+                            address_,
+                            port_,
+                            std::move(onReceived),
+                            std::move(onClosed)
+                        )
+                    );
+                } else {
+                    return clientSocket.Connect(
+                        path_,
+                        std::move(onReceived),
+                        std::move(onClosed)
+                    );
+                }
+            }
+
+        private:
+            // Properties
+            CoroutineConnection& connection_;
+            uint32_t address_ = 0;
+            uint16_t port_ = 0;
+            std::string path_;
+        };
+
+        /**
+         * This is what's awaited to receive.  It results in true once the
+         * next message has been put in the string given to Receive, or
+         * false if the connection was closed instead.
+         */
+        class ReceiveAwaiter {
+        public:
+            // Constructor
+            ReceiveAwaiter(State& state, std::string& message)
+                : state_(state)
+                , message_(message)
+            {
+            }
+
+            // Methods
+            bool await_ready() const noexcept { return false; }
+
+            bool await_suspend(std::coroutine_handle<> coroutine) {
+                std::lock_guard< decltype(state_.mutex) > lock(state_.mutex);
+                if (!state_.received.empty()) {
+                    message_.swap(state_.received.front());
+                    state_.received.pop_front();
+                    received_ = true;
+                    return false;
+                }
+                if (state_.closed) {
+                    return false;
+                }
+                state_.waiter = coroutine;
+                state_.result = &message_;
+                state_.resultReceived = &received_;
+                return true;
+            }
+
+            bool await_resume() const noexcept { return received_; }
+
+        private:
+            // Properties
+            State& state_;
+            std::string& message_;
+            bool received_ = false;
+        };
+
+        // Constructors
+
+        /**
+         * Make a connection which isn't connected yet; await Connect to
+         * connect it.
+         */
+        CoroutineConnection()
+            : state_(std::make_shared< State >())
+        {
+        }
+
+        /**
+         * Take over a connection accepted by a ServerSocket.
+         */
+        explicit CoroutineConnection(std::shared_ptr< ServerSocket::Client > client)
+            : state_(std::make_shared< State >())
+            , client_(std::move(client))
+        {
+            const auto state = state_;
+            (void)client_->Start(
+                [state](const std::string& message){
+                    state->OnReceived(message);
+                },
+                [state]{
+                    state->OnClosed();
+                }
+            );
+        }
+
+        // Methods
+
+        void Close() {
+            if (client_) {
+                client_->Close();
+            } else {
+                clientSocket_.Close();
+            }
+        }
+
+        ConnectAwaiter Connect(uint32_t address, uint16_t port) {
+            return ConnectAwaiter(*this, address, port);
+        }
+
+        ConnectAwaiter Connect(const std::string& path) {
+            return ConnectAwaiter(*this, path);
+        }
+
+        /**
+         * Wait for the next message, putting it in the given string, which
+         * must remain valid until the wait is over.
+         */
+        ReceiveAwaiter Receive(std::string& message) {
+            return ReceiveAwaiter(*state_, message);
+        }
+
+        /**
+         * Queue a message to be sent.  Since sending never waits, this
+         * completes without suspending; it's awaitable so that coroutines
+         * can treat sending and receiving alike.
+         */
+        std::suspend_never Send(
+            const std::string& message,
+            SendPriority priority = SendPriority::Normal
+        ) {
+            if (client_) {
+                client_->SendMessage(message, priority);
+            } else {
+                clientSocket_.SendMessage(message, priority);
+            }
+            return {};
+        }
+
+    private:
+        // Properties
+        std::shared_ptr< State > state_;
+        ClientSocket clientSocket_;
+        std::shared_ptr< ServerSocket::Client > client_;
+    };
+
+    /**
+     * This accepts connections which coroutines can wait for.  Connections
+     * accepted while no coroutine is waiting are held until one is.
+     *
+     * Only one coroutine may wait to accept at a time, and the listener
+     * must outlive any coroutine waiting on it.
+     */
+    class CoroutineListener {
+    private:
+        // Types
+        struct State {
+            // Properties
+
+            // This is used to serialize access to the rest of the state.
+            std::mutex mutex;
+
+            // This holds connections accepted while no coroutine was
+            // waiting.
+            std::deque< std::shared_ptr< ServerSocket::Client > > clients;
+
+            // This is the coroutine waiting to accept, if any, and where to
+            // put what it accepts.
+            std::coroutine_handle<> waiter;
+            std::shared_ptr< ServerSocket::Client >* result = nullptr;
+
+            // Methods
+
+            void OnAcceptClient(std::shared_ptr< ServerSocket::Client >&& client) {
+                std::unique_lock< decltype(mutex) > lock(mutex);
+                if (!waiter) {
+                    clients.push_back(std::move(client));
+                    return;
+                }
+                *result = std::move(client);
+                const auto resumeWaiter = std::exchange(waiter, nullptr);
+                lock.unlock();
+                resumeWaiter.resume();
+            }
+        };
+
+    public:
+        // Types
+
+        /**
+         * This is what's awaited to accept.  It results in the next
+         * connection accepted.
+         */
+        class AcceptAwaiter {
+        public:
+            // Constructor
+            explicit AcceptAwaiter(State& state)
+                : state_(state)
+            {
+            }
+
+            // Methods
+            bool await_ready() const noexcept { return false; }
+
+            bool await_suspend(std::coroutine_handle<> coroutine) {
+                std::lock_guard< decltype(state_.mutex) > lock(state_.mutex);
+                if (!state_.clients.empty()) {
+                    result_ = std::move(state_.clients.front());
+                    state_.clients.pop_front();
+                    return false;
+                }
+                state_.waiter = coroutine;
+                state_.result = &result_;
+                return true;
+            }
+
+            CoroutineConnection await_resume() {
+                return CoroutineConnection(std::move(result_));
+            }
+
+        private:
+            // Properties
+            State& state_;
+            std::shared_ptr< ServerSocket::Client > result_;
+        };
+
+        // Constructor
+        CoroutineListener()
+            : state_(std::make_shared< State >())
+        {
+        }
+
+        // Methods
+
+        AcceptAwaiter Accept() {
+            return AcceptAwaiter(*state_);
+        }
+
+        bool Bind(uint16_t port = 0) {
+            return server_.Bind(port);
+        }
+
+        bool Bind(const std::string& path) {
+            return server_.Bind(path);
+        }
+
+        bool Listen() {
+            const auto state = state_;
+            return server_.Listen(
+                [state](std::shared_ptr< ServerSocket::Client >&& client){
+                    state->OnAcceptClient(std::move(client));
+                }
+            );
+        }
+
+    private:
+        // Properties
+        std::shared_ptr< State > state_;
+        ServerSocket server_;
+    };
+
+}
+
+#endif /* __cpp_impl_coroutine */
@@ -2,8 +2,12 @@
 
 #include <functional>
 #include <memory>
+#include <Sockets/Capture.hpp>
+#include <Sockets/LatencyHistogram.hpp>
+#include <Sockets/Statistics.hpp>
 #include <stdint.h>
 #include <string>
+#include <vector>
 
 namespace Sockets {
 
@@ -11,6 +15,9 @@ namespace Sockets {
     public:
         // Types
         using OnReceived = std::function< void(const std::string&) >;
+
+        // This is called once a datagram is done with: either sent, or
+        // dropped because it couldn't be sent to its destination.
         using OnSent = std::function< void() >;
 
         // Constructor
@@ -18,12 +25,60 @@ namespace Sockets {
 
         // Methods
         bool Bind(uint16_t port = 0);
+
+        /**
+         * Bind to a local (Unix domain) socket at the given path, instead
+         * of a UDP port, to exchange datagrams with other programs on the
+         * same host.  Send to such sockets with the overloads of
+         * SendMessage and SendMessages which take a path; datagrams for an
+         * invalid path, or one nobody is bound to, are dropped, with an
+         * error printed.  A socket left behind at the path is replaced,
+         * and the path is removed again when this object is destroyed.
+         */
+        bool Bind(const std::string& path);
+
+        LatencyHistograms GetLatencyHistograms() const;
+        DatagramStatistics GetStatistics() const;
         void SendMessage(
             const std::string& message,
             uint32_t address,
             uint16_t port,
             OnSent onSent = nullptr
         );
+        void SendMessages(
+            const std::vector< std::string >& messages,
+            uint32_t address,
+            uint16_t port,
+            OnSent onSent = nullptr
+        );
+        void SendMessage(
+            const std::string& message,
+            const std::string& path,
+            OnSent onSent = nullptr
+        );
+        void SendMessages(
+            const std::vector< std::string >& messages,
+            const std::string& path,
+            OnSent onSent = nullptr
+        );
+
+        /**
+         * Record the datagrams sent and received by the socket in the
+         * given capture, or stop recording them if it's null.
+         */
+        void SetCapture(const std::shared_ptr< Capture >& capture);
+
+        /**
+         * Limit the rate at which datagrams are sent, in bytes per second,
+         * to smooth out bursts.  Datagrams are sent as long as no more than
+         * the given burst of bytes (by default, ten milliseconds' worth)
+         * has gone out ahead of the rate; after that, they're held back
+         * until the rate catches up.  Where it can, the operating system is
+         * also asked to pace packets at the same rate.  A rate of zero
+         * removes the limit.
+         */
+        void SetRateLimit(uint64_t bytesPerSecond, size_t burst = 0);
+
         void Start(OnReceived onReceived);
 
     private:
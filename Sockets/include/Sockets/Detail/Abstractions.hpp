@@ -0,0 +1,308 @@
+#pragma once
+
+#ifdef _WIN32
+/**
+ * WinSock2.h should always be included first because if Windows.h is
+ * included before it, WinSock.h gets included which conflicts
+ * with WinSock2.h.
+ *
+ * Windows.h should always be included next because other Windows header
+ * files, such as KnownFolders.h, don't always define things properly if
+ * you don't include Windows.h beforehand.
+ */
+#include <WinSock2.h>
+#include <Windows.h>
+#include <WS2tcpip.h>
+#include <IPHlpApi.h>
+#pragma comment(lib, "ws2_32")
+#pragma comment(lib, "IPHlpApi")
+#undef ERROR
+#undef SendMessage
+#undef min
+#undef max
+#define IPV4_ADDRESS_IN_SOCKADDR sin_addr.S_un.S_addr
+#define SOCKADDR_LENGTH_TYPE int
+#define IS_SOCKET_ERROR(x) (x == SOCKET_ERROR)
+#define IS_INVALID_SOCKET(s) (s == INVALID_SOCKET)
+#define MSG_NOSIGNAL 0
+#define LAST_SOCKET_OPERATION_WOULD_BLOCK (WSAGetLastError() == WSAEWOULDBLOCK)
+#define LAST_SOCKET_OPERATION_WAS_RESET (WSAGetLastError() == WSAECONNRESET)
+#define LAST_SOCKET_OPERATION_BROKE_SOCKET ( \
+    (WSAGetLastError() == WSAENOTSOCK) \
+    || (WSAGetLastError() == WSAESHUTDOWN) \
+    || (WSAGetLastError() == WSAEINVAL) \
+)
+#define SOCKET_DATAGRAM_LENGTH_TYPE int
+
+#else /* POSIX */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#define IPV4_ADDRESS_IN_SOCKADDR sin_addr.s_addr
+#define SOCKADDR_LENGTH_TYPE socklen_t
+#define IS_SOCKET_ERROR(x) (x < 0)
+#define INVALID_SOCKET -1
+#define IS_INVALID_SOCKET(s) (s < 0)
+#ifdef __APPLE__
+#define MSG_NOSIGNAL 0
+#endif /* __APPLE__ */
+#define LAST_SOCKET_OPERATION_WOULD_BLOCK (errno == EWOULDBLOCK)
+#define LAST_SOCKET_OPERATION_WAS_RESET (errno == ECONNRESET)
+#define LAST_SOCKET_OPERATION_BROKE_SOCKET ( \
+    (errno == EBADF) \
+    || (errno == ENOTSOCK) \
+    || (errno == EPIPE) \
+)
+#define SOCKET int
+#define closesocket close
+#define SD_SEND SHUT_WR
+#define SD_BOTH SHUT_RDWR
+#define SOCKET_DATAGRAM_LENGTH_TYPE size_t
+
+#endif /* _WIN32 or POSIX */
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <Sockets/Detail/Delegate.hpp>
+#include <Sockets/LatencyHistogram.hpp>
+#include <Sockets/Statistics.hpp>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace Sockets {
+
+    // This is one piece of data to be sent by SendBuffers.
+    struct SendBuffer {
+        const char* data;
+        size_t length;
+    };
+
+    // This is the most pieces of data SendBuffers will send at once.
+    constexpr size_t maximumSendBuffers = 64;
+
+    /**
+     * Send the given pieces of data on a socket in a single operation,
+     * so that they can share network segments.  If "more" is set, the
+     * operating system is told that more data will follow right away, so
+     * that it may hold back a final partial segment.
+     *
+     * Returns the number of bytes sent, or a negative number on error.
+     */
+    long long SendBuffers(
+        SOCKET socket,
+        const SendBuffer* buffers,
+        size_t count,
+        bool more
+    );
+
+    /**
+     * Ask the operating system to allow sending data on the given socket
+     * without copying it (see SendZeroCopy).
+     *
+     * Returns false if this isn't supported.
+     */
+    bool EnableZeroCopy(SOCKET socket);
+
+    /**
+     * Ask the operating system to pace the packets sent on the given socket
+     * so that they go out no faster than the given number of bytes per
+     * second (zero meaning no limit).  On Linux this takes effect for TCP
+     * sockets, and for other sockets when the fq queuing discipline is in
+     * use on the interface.
+     *
+     * Returns false if this isn't supported.
+     */
+    bool SetPacingRate(SOCKET socket, uint64_t bytesPerSecond);
+
+    /**
+     * Send data on a socket without copying it into the operating system.
+     * The data must be left alone until a completion covering this send
+     * is read with ReadZeroCopyCompletion.  Each send which doesn't fail
+     * is numbered, counting up from zero.
+     *
+     * Returns the number of bytes sent, or a negative number on error.
+     */
+    long long SendZeroCopy(
+        SOCKET socket,
+        const char* data,
+        size_t length
+    );
+
+    /**
+     * Read one notification that zero-copy sends have completed, giving
+     * the range of send numbers covered, and whether the operating system
+     * ended up copying the data anyway.  The range is empty (first is
+     * after last) if the notification was about something else.
+     *
+     * Returns false if no notification was ready.
+     */
+    bool ReadZeroCopyCompletion(
+        SOCKET socket,
+        uint32_t& first,
+        uint32_t& last,
+        bool& copied
+    );
+
+    /**
+     * Make a private duplicate of the given open file descriptor, so that
+     * its contents can be sent later with SendFileData regardless of what
+     * the caller does with the original.  The isPipe flag is set if the
+     * file is a pipe, which can only be read in order.
+     *
+     * Returns the duplicate, or a negative number on error (including
+     * when the file is a pipe and this platform can't send from pipes).
+     */
+    int DuplicateFile(int file, bool& isPipe);
+
+    // Close a file made by DuplicateFile.
+    void CloseFile(int file);
+
+    /**
+     * Send up to the given amount of data from a file (at the given offset)
+     * or pipe (from its current position) on a socket, without copying it
+     * through user space where the operating system supports this.
+     *
+     * Returns the number of bytes sent, zero if the file or pipe has
+     * ended, or a negative number on error.
+     */
+    long long SendFileData(
+        SOCKET socket,
+        int file,
+        bool isPipe,
+        uint64_t offset,
+        size_t length
+    );
+
+    // This holds the address of a local (Unix domain) socket.
+    struct LocalAddress {
+        struct sockaddr_storage storage;
+        SOCKADDR_LENGTH_TYPE length = 0;
+    };
+
+    /**
+     * Make the address of a local (Unix domain) socket from the given
+     * path.  On Linux, a path starting with "@" names a socket in the
+     * abstract namespace, which has no file and goes away with the socket.
+     *
+     * Returns false if the path is empty or too long.
+     */
+    bool MakeLocalAddress(const std::string& path, LocalAddress& address);
+
+    /**
+     * Return the path to which the given local (Unix domain) socket is
+     * bound, in the form taken by MakeLocalAddress, or an empty string if
+     * it isn't a local socket or isn't bound to a path.
+     */
+    std::string GetLocalPath(SOCKET socket);
+
+    /**
+     * Remove the file left behind by a local socket bound to the given
+     * path, if there is one.
+     */
+    void RemoveLocalAddress(const std::string& path);
+
+    // This is the most sockets SendSockets will send at once.
+    constexpr size_t maximumSocketsPerTransfer = 64;
+
+    /**
+     * Send copies of the given sockets to another process over a connected
+     * local socket, to be picked up there with ReceiveSockets.  Sending no
+     * sockets is allowed, for example to mark the end of a series of
+     * transfers.
+     *
+     * Returns false if this isn't supported or the sockets couldn't be
+     * sent.
+     */
+    bool SendSockets(SOCKET channel, const SOCKET* sockets, size_t count);
+
+    /**
+     * Receive one transfer of sockets sent with SendSockets, adding them
+     * to the end of the given list, and setting the count to how many
+     * there were.
+     *
+     * Returns false if this isn't supported or the transfer couldn't be
+     * received.
+     */
+    bool ReceiveSockets(
+        SOCKET channel,
+        std::vector< SOCKET >& sockets,
+        size_t& count
+    );
+
+    /**
+     * Wait up to the given time for there to be something to read from
+     * the given socket (or, for a listening socket, a connection to
+     * accept).
+     *
+     * Returns false if the time ran out or the socket couldn't be waited
+     * on.
+     */
+    bool WaitUntilReadable(SOCKET socket, std::chrono::milliseconds timeout);
+
+    class UsesSockets {
+    public:
+        UsesSockets();
+
+    private:
+        struct Impl;
+        std::shared_ptr< Impl > impl_;
+    };
+
+    class SocketEventLoop {
+    public:
+        // Types
+        //
+        // These never allocate.  There's room for a weak pointer to the
+        // owner and two of the library's user callbacks, which is the most
+        // that any user of this class binds.
+        static constexpr size_t CallbackCapacity = (
+            sizeof(std::weak_ptr< void >)
+            + 2 * sizeof(std::function< void() >)
+        );
+        using IsReadyToSend = Delegate< bool(), CallbackCapacity >;
+        using OnSocketReady = Delegate< bool(), CallbackCapacity >;
+
+        // Lifecycle
+        ~SocketEventLoop() noexcept;
+        SocketEventLoop(const SocketEventLoop&);
+        SocketEventLoop(SocketEventLoop&&) noexcept;
+        SocketEventLoop& operator=(const SocketEventLoop&);
+        SocketEventLoop& operator=(SocketEventLoop&&) noexcept;
+
+        // Constructor
+        SocketEventLoop();
+
+        // Methods
+        EventLoopStatistics GetStatistics() const;
+        LatencyHistogram GetWakeupDelay() const;
+
+        /**
+         * Stop the event loop and wait for its worker thread to finish,
+         * unless called on the worker thread itself.
+         */
+        void Join();
+
+        bool Start(
+            SOCKET socket,
+            IsReadyToSend isReadyToSend,
+            OnSocketReady onSocketReady
+        );
+        void SetTimeout(std::chrono::microseconds timeout);
+        void Stop();
+        void StartReading();
+        void StopReading();
+        void UserEvent();
+
+    private:
+        struct Impl;
+        std::shared_ptr< Impl > impl_;
+    };
+
+}
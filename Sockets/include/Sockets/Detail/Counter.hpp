@@ -0,0 +1,40 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+namespace Sockets {
+
+    /**
+     * This is a statistics counter which is cheap to update on hot paths.
+     *
+     * Updates must be serialized by the owner (for example, by only being
+     * made from an event loop worker thread, or only while holding a mutex),
+     * which lets them avoid locked read-modify-write instructions.  Reads
+     * may come from any thread at any time.
+     */
+    class Counter {
+    public:
+        void Add(uint64_t amount = 1) {
+            value_.store(
+                value_.load(std::memory_order_relaxed) + amount,
+                std::memory_order_relaxed
+            );
+        }
+
+        void Subtract(uint64_t amount = 1) {
+            value_.store(
+                value_.load(std::memory_order_relaxed) - amount,
+                std::memory_order_relaxed
+            );
+        }
+
+        uint64_t Get() const {
+            return value_.load(std::memory_order_relaxed);
+        }
+
+    private:
+        std::atomic< uint64_t > value_{0};
+    };
+
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <string.h>
+#include <type_traits>
+#include <utility>
+
+namespace Sockets {
+
+    template< typename Signature, size_t Capacity = 3 * sizeof(void*) >
+    class Delegate;
+
+    /**
+     * This is a move-only replacement for std::function which never
+     * allocates memory: the callable object is always stored inline, and a
+     * callable which doesn't fit in the given capacity is a compile-time
+     * error rather than a trip to the heap.
+     *
+     * Handlers known at compile time can be bound with Bind or BindWeak,
+     * in which case the member function is called directly from the
+     * delegate's invoker, rather than through a stored pointer.
+     */
+    template< typename R, typename... Args, size_t Capacity >
+    class Delegate< R(Args...), Capacity > {
+    public:
+        // Lifecycle
+        ~Delegate() noexcept {
+            Reset();
+        }
+        Delegate(const Delegate&) = delete;
+        Delegate(Delegate&& other) noexcept {
+            MoveFrom(other);
+        }
+        Delegate& operator=(const Delegate&) = delete;
+        Delegate& operator=(Delegate&& other) noexcept {
+            if (this != &other) {
+                Reset();
+                MoveFrom(other);
+            }
+            return *this;
+        }
+
+        // Constructors
+        Delegate() noexcept = default;
+
+        Delegate(std::nullptr_t) noexcept {
+        }
+
+        template<
+            typename F,
+            typename = typename std::enable_if<
+                !std::is_same< typename std::decay< F >::type, Delegate >::value
+            >::type
+        > Delegate(F&& f) {
+            using Callable = typename std::decay< F >::type;
+            static_assert(
+                sizeof(Callable) <= Capacity,
+                "callable is too large for this delegate's storage"
+            );
+            static_assert(
+                alignof(Callable) <= alignof(Storage),
+                "callable is too strictly aligned for this delegate's storage"
+            );
+            new (&storage_) Callable(std::forward< F >(f));
+            invoke_ = &Invoke< Callable >;
+            if (!std::is_trivially_copyable< Callable >::value) {
+                manage_ = &Manage< Callable >;
+            }
+        }
+
+        // Methods
+
+        /**
+         * Make a delegate which calls the given member function on the
+         * given object, which must outlive the delegate.
+         */
+        template< typename T, R (T::*Method)(Args...) >
+        static Delegate Bind(T* object) {
+            Delegate delegate;
+            new (&delegate.storage_) T*(object);
+            delegate.invoke_ = &InvokeMethod< T, Method >;
+            return delegate;
+        }
+
+        /**
+         * Make a delegate which calls the given member function on the
+         * given object if it still exists, and otherwise returns the given
+         * value.
+         */
+        template< typename T, R (T::*Method)(Args...) >
+        static Delegate BindWeak(std::weak_ptr< T > object, R ifExpired) {
+            return Delegate(WeakMethod< T, Method >{std::move(object), ifExpired});
+        }
+
+        explicit operator bool() const noexcept {
+            return (invoke_ != nullptr);
+        }
+
+        R operator()(Args... args) {
+            return invoke_(&storage_, std::forward< Args >(args)...);
+        }
+
+    private:
+        // Types
+        using Storage = typename std::aligned_storage< Capacity, alignof(std::max_align_t) >::type;
+        using Invoker = R (*)(void*, Args&&...);
+        using Manager = void (*)(void* to, void* from);
+
+        template< typename T, R (T::*Method)(Args...) > struct WeakMethod {
+            std::weak_ptr< T > object;
+            R ifExpired;
+
+            R operator()(Args... args) {
+                const auto locked = object.lock();
+                if (!locked) {
+                    return ifExpired;
+                }
+                return ((*locked).*Method)(std::forward< Args >(args)...);
+            }
+        };
+
+        // Properties
+        Storage storage_;
+        Invoker invoke_ = nullptr;
+
+        // This is only set for callables which need more than a memory copy
+        // to move them.  It moves the callable from the second argument to
+        // the first (if given) and destroys the original.
+        Manager manage_ = nullptr;
+
+        // Methods
+
+        template< typename Callable > static R Invoke(void* storage, Args&&... args) {
+            return (*static_cast< Callable* >(storage))(std::forward< Args >(args)...);
+        }
+
+        template< typename T, R (T::*Method)(Args...) > static R InvokeMethod(
+            void* storage,
+            Args&&... args
+        ) {
+            return ((*static_cast< T** >(storage))->*Method)(std::forward< Args >(args)...);
+        }
+
+        template< typename Callable > static void Manage(void* to, void* from) {
+            const auto callable = static_cast< Callable* >(from);
+            if (to != nullptr) {
+                new (to) Callable(std::move(*callable));
+            }
+            callable->~Callable();
+        }
+
+        void MoveFrom(Delegate& other) noexcept {
+            if (other.manage_ == nullptr) {
+                (void)memcpy(&storage_, &other.storage_, sizeof(storage_));
+            } else {
+                other.manage_(&storage_, &other.storage_);
+            }
+            invoke_ = other.invoke_;
+            manage_ = other.manage_;
+            other.invoke_ = nullptr;
+            other.manage_ = nullptr;
+        }
+
+        void Reset() noexcept {
+            if (manage_ != nullptr) {
+                manage_(nullptr, &storage_);
+            }
+            invoke_ = nullptr;
+            manage_ = nullptr;
+        }
+    };
+
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <chrono>
+#include <Sockets/Detail/Counter.hpp>
+#include <Sockets/LatencyHistogram.hpp>
+
+namespace Sockets {
+
+    /**
+     * This records durations into the buckets of a latency histogram on a
+     * hot path, while allowing snapshots of the histogram to be taken from
+     * other threads.  As with Counter, recording must be serialized by the
+     * owner.
+     */
+    class LatencyRecorder {
+    public:
+        template< typename Duration > void Record(Duration duration) {
+            const auto nanoseconds = std::chrono::duration_cast< std::chrono::nanoseconds >(
+                duration
+            ).count();
+            buckets_[
+                LatencyHistogram::GetBucketIndex(
+                    (nanoseconds < 0) ? 0 : (uint64_t)nanoseconds
+                )
+            ].Add();
+        }
+
+        LatencyHistogram GetHistogram() const {
+            LatencyHistogram histogram;
+            for (size_t i = 0; i < LatencyHistogram::numberOfBuckets; ++i) {
+                const auto count = buckets_[i].Get();
+                if (count != 0) {
+                    histogram.Record(LatencyHistogram::GetBucketLowerBound(i), count);
+                }
+            }
+            return histogram;
+        }
+
+    private:
+        Counter buckets_[LatencyHistogram::numberOfBuckets];
+    };
+
+}
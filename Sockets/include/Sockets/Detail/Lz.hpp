@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace Sockets {
+
+    /**
+     * This compresses blocks of data with a fast LZ77-family codec, in
+     * the style of LZ4: the output is a series of sequences, each a run of
+     * literal bytes followed by a copy of earlier output (up to 64 KiB
+     * back), and the data is only ever compared against itself, with no
+     * entropy coding.  It trades ratio for speed, which suits data going
+     * out over a network link.
+     *
+     * The hash table used to find matches is kept between calls, so that
+     * compressing doesn't allocate or clear any memory.  Stale entries do
+     * no harm, since every candidate match is checked before it's used.
+     */
+    class LzCompressor {
+    public:
+        // Constants
+        static constexpr unsigned int hashBits = 12;
+
+        // Constructor
+        LzCompressor();
+
+        // Methods
+
+        /**
+         * Compress the given data into the given output buffer.
+         *
+         * Returns the length of the compressed data, or zero if it
+         * wouldn't fit in the output buffer (so giving a buffer shorter
+         * than the input means only compression which saves space will
+         * succeed).
+         */
+        size_t Compress(
+            const uint8_t* input,
+            size_t length,
+            uint8_t* output,
+            size_t capacity
+        );
+
+    private:
+        // Properties
+        uint32_t table_[1 << hashBits];
+    };
+
+    /**
+     * Decompress data made by LzCompressor, which must come out to exactly
+     * the given length.  The input is checked as it's decoded, so corrupt
+     * or malicious data can't cause reads or writes out of bounds.
+     *
+     * Returns false if the input is invalid.
+     */
+    bool LzDecompress(
+        const uint8_t* input,
+        size_t length,
+        uint8_t* output,
+        size_t outputLength
+    );
+
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+namespace Sockets {
+
+    /**
+     * This hands out memory blocks of a single size, carved from larger
+     * slabs which are kept until the pool is destroyed.  Freed blocks are
+     * recycled for later allocations, so that objects which are created
+     * and destroyed at a high rate, such as accepted connections, don't
+     * keep going back to the general-purpose allocator.
+     *
+     * The block size is fixed by the first allocation; requests of any
+     * other size are passed on to the general-purpose allocator.  Blocks
+     * may be allocated and freed from any thread.
+     */
+    class SlabPool {
+    public:
+        // Lifecycle
+        ~SlabPool() noexcept;
+        SlabPool(const SlabPool&) = delete;
+        SlabPool(SlabPool&&) noexcept = delete;
+        SlabPool& operator=(const SlabPool&) = delete;
+        SlabPool& operator=(SlabPool&&) noexcept = delete;
+
+        // Constructor
+        SlabPool();
+
+        // Methods
+        void* Allocate(size_t size);
+        void Deallocate(void* block, size_t size);
+        size_t GetBlockCount() const;
+        size_t GetBlocksInUse() const;
+        void Reserve(size_t blocks);
+
+    private:
+        struct Impl;
+        std::unique_ptr< Impl > impl_;
+    };
+
+    /**
+     * This is a standard allocator which takes memory from a SlabPool,
+     * for use with std::allocate_shared.  It keeps the pool alive, so
+     * objects (and their control blocks, which may outlive the objects
+     * while weak pointers remain) can safely outlive their creator.
+     */
+    template< typename T > struct SlabAllocator {
+        // Types
+        using value_type = T;
+
+        // Properties
+        std::shared_ptr< SlabPool > pool;
+
+        // Constructors
+        explicit SlabAllocator(const std::shared_ptr< SlabPool >& pool)
+            : pool(pool)
+        {
+        }
+
+        template< typename U > SlabAllocator(const SlabAllocator< U >& other)
+            : pool(other.pool)
+        {
+        }
+
+        // Methods
+
+        T* allocate(size_t n) {
+            static_assert(
+                alignof(T) <= alignof(std::max_align_t),
+                "over-aligned types can't be allocated from a slab pool"
+            );
+            return static_cast< T* >(pool->Allocate(n * sizeof(T)));
+        }
+
+        void deallocate(T* p, size_t n) {
+            pool->Deallocate(p, n * sizeof(T));
+        }
+    };
+
+    template< typename T, typename U > bool operator==(
+        const SlabAllocator< T >& lhs,
+        const SlabAllocator< U >& rhs
+    ) {
+        return (lhs.pool == rhs.pool);
+    }
+
+    template< typename T, typename U > bool operator!=(
+        const SlabAllocator< T >& lhs,
+        const SlabAllocator< U >& rhs
+    ) {
+        return (lhs.pool != rhs.pool);
+    }
+
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace Sockets {
+
+    /**
+     * This limits the rate at which data is sent.  It holds up to a burst
+     * worth of bytes which may be sent right away, and refills at a steady
+     * rate.  Sending more than it holds is allowed, but puts it in debt,
+     * which has to be paid back before anything more can be sent.  Once it
+     * runs low, nothing is allowed until it has refilled by at least a
+     * quantum, so that data doesn't trickle out a few bytes at a time.
+     *
+     * It also keeps track of when sending is held back, so that the owner
+     * can report how much it was throttled.
+     *
+     * Access must be serialized by the owner (for example, by only using
+     * it while holding a mutex).
+     */
+    class TokenBucket {
+    public:
+        // Types
+        using Clock = std::chrono::steady_clock;
+
+        // Constants
+
+        // This is the smallest burst used when none is given, so that slow
+        // rates don't end up sending tiny pieces.
+        static constexpr size_t minimumBurst = 4096;
+
+        // This is the most that has to build up before sending again.
+        static constexpr size_t quantum = 4096;
+
+        // Methods
+
+        /**
+         * Set the rate, in bytes per second, at which data may be sent,
+         * and how much may be sent at once.  A rate of zero means no limit.
+         * A burst of zero picks one worth ten milliseconds at the given
+         * rate.
+         */
+        void Configure(uint64_t rate, size_t burst, Clock::time_point now) {
+            rate_ = rate;
+            if (burst == 0) {
+                burst = (size_t)std::max(rate / 100, (uint64_t)minimumBurst);
+            }
+            burst_ = burst;
+            threshold_ = (double)std::min(burst, (size_t)quantum);
+            tokens_ = (double)burst;
+            refilled_ = now;
+        }
+
+        bool IsLimited() const {
+            return (rate_ > 0);
+        }
+
+        /**
+         * Return how many bytes may be sent right now.
+         */
+        size_t GetAllowance(Clock::time_point now) const {
+            if (rate_ == 0) {
+                return SIZE_MAX;
+            }
+            const auto tokens = GetTokens(now);
+            return (tokens < threshold_) ? 0 : (size_t)tokens;
+        }
+
+        /**
+         * Return when sending may go ahead again.
+         */
+        Clock::time_point GetNextAllowance(Clock::time_point now) const {
+            const auto tokens = GetTokens(now);
+            if (tokens >= threshold_) {
+                return now;
+            }
+            return now + std::chrono::duration_cast< Clock::duration >(
+                std::chrono::duration< double >((threshold_ - tokens) / (double)rate_)
+            );
+        }
+
+        /**
+         * Take the given number of bytes, which were just sent, out of the
+         * bucket.
+         */
+        void Consume(size_t amount, Clock::time_point now) {
+            if (rate_ == 0) {
+                return;
+            }
+            tokens_ = GetTokens(now) - (double)amount;
+            refilled_ = now;
+        }
+
+        /**
+         * Note that sending is being held back.
+         *
+         * Returns true if it wasn't already.
+         */
+        bool Stall(Clock::time_point now) {
+            if (stalled_) {
+                return false;
+            }
+            stalled_ = true;
+            stalledSince_ = now;
+            return true;
+        }
+
+        /**
+         * Note that sending is going ahead.
+         *
+         * Returns how long it was held back.
+         */
+        Clock::duration Resume(Clock::time_point now) {
+            if (!stalled_) {
+                return Clock::duration::zero();
+            }
+            stalled_ = false;
+            return now - stalledSince_;
+        }
+
+    private:
+        // Properties
+        uint64_t rate_ = 0;
+        size_t burst_ = 0;
+        double threshold_ = 0.0;
+        double tokens_ = 0.0;
+        Clock::time_point refilled_;
+        bool stalled_ = false;
+        Clock::time_point stalledSince_;
+
+        // Methods
+
+        double GetTokens(Clock::time_point now) const {
+            return std::min(
+                (double)burst_,
+                tokens_ + std::chrono::duration< double >(now - refilled_).count() * (double)rate_
+            );
+        }
+    };
+
+}
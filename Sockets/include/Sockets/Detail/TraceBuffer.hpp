@@ -0,0 +1,31 @@
+#pragma once
+
+#include <atomic>
+#include <Sockets/Trace.hpp>
+#include <stdint.h>
+
+namespace Sockets {
+
+    extern std::atomic< bool > traceEnabled;
+
+    void RecordTraceEvent(
+        Trace::EventType type,
+        int64_t socket,
+        uint64_t bytes
+    );
+
+    /**
+     * Record an event into the calling thread's trace ring buffer, if
+     * tracing is enabled.  When it isn't, this costs a single relaxed load.
+     */
+    inline void TraceEvent(
+        Trace::EventType type,
+        int64_t socket,
+        uint64_t bytes = 0
+    ) {
+        if (traceEnabled.load(std::memory_order_relaxed)) {
+            RecordTraceEvent(type, socket, bytes);
+        }
+    }
+
+}
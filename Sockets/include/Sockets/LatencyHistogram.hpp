@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace Sockets {
+
+    /**
+     * This is a histogram of durations, in nanoseconds, using logarithmic
+     * buckets which are each subdivided linearly, in the style of an HDR
+     * histogram.  Every value is kept to within 12.5% of its true value,
+     * from one nanosecond up to several days.
+     */
+    class LatencyHistogram {
+    public:
+        // Constants
+        static constexpr unsigned int subBucketBits = 3;
+        static constexpr unsigned int largestExponent = 47;
+        static constexpr size_t numberOfBuckets = (
+            (2 << subBucketBits)
+            + (largestExponent - subBucketBits) * (1 << subBucketBits)
+        );
+
+        // Constructor
+        LatencyHistogram();
+
+        // Methods
+        static size_t GetBucketIndex(uint64_t value);
+        static uint64_t GetBucketLowerBound(size_t index);
+        static uint64_t GetBucketUpperBound(size_t index);
+        uint64_t GetBucketCount(size_t index) const;
+        uint64_t GetCount() const;
+        uint64_t GetMinimum() const;
+        uint64_t GetMaximum() const;
+        double GetMean() const;
+        uint64_t GetPercentile(double percentile) const;
+        void Merge(const LatencyHistogram& other);
+        void Record(uint64_t value, uint64_t count = 1);
+        void Reset();
+
+    private:
+        // Properties
+        std::vector< uint64_t > buckets_;
+        uint64_t count_ = 0;
+    };
+
+    struct LatencyHistograms {
+        // Properties
+        LatencyHistogram sendQueueResidency;
+        LatencyHistogram wakeupDelay;
+        LatencyHistogram receiveHandlerTime;
+
+        // Methods
+        void Merge(const LatencyHistograms& other);
+    };
+
+}
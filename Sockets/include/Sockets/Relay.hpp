@@ -0,0 +1,55 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <Sockets/ServerSocket.hpp>
+#include <Sockets/Statistics.hpp>
+#include <stdint.h>
+
+namespace Sockets {
+
+    /**
+     * This forwards data in both directions between a connection accepted
+     * by a ServerSocket and a new connection which it makes to an upstream
+     * server, until both directions are closed.  On Linux, data is moved
+     * between the sockets with splice, through a pipe for each direction,
+     * so that it never has to be copied into the program.  Each direction
+     * stops reading while its pipe is full, so a slow receiver holds back
+     * its sender.
+     *
+     * This is only available on POSIX targets.  Data is written to sockets
+     * without suppressing SIGPIPE, so programs using this should ignore
+     * that signal.
+     */
+    class Relay {
+    public:
+        // Types
+        using OnClosed = std::function< void() >;
+
+        // Lifecycle
+        ~Relay() noexcept;
+        Relay(const Relay&) = delete;
+        Relay(Relay&&) noexcept = delete;
+        Relay& operator=(const Relay&) = delete;
+        Relay& operator=(Relay&&) noexcept = delete;
+
+        // Constructor
+        Relay();
+
+        // Methods
+        RelayStatistics GetStatistics() const;
+        bool Start(
+            std::shared_ptr< ServerSocket::Client >&& client,
+            uint32_t upstreamAddress,
+            uint16_t upstreamPort,
+            OnClosed onClosed
+        );
+        void Stop();
+
+    private:
+        // Properties
+        struct Impl;
+        std::shared_ptr< Impl > impl_;
+    };
+
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+namespace Sockets {
+
+    /**
+     * These are the classes of messages a connection can send, so that
+     * urgent ones don't have to wait behind a lot of bulk data.  Messages
+     * of the same class are sent in order, but a message may be sent ahead
+     * of others of a lower class which were queued before it (never in the
+     * middle of one, though).  Classes share the connection by weight, so
+     * lower classes still make progress while higher ones are busy: High
+     * gets four times the share of Normal, which gets four times the share
+     * of Bulk.
+     */
+    enum class SendPriority {
+        // Control messages, heartbeats and anything else which is small
+        // and time-critical.
+        High,
+
+        // Ordinary messages; this is the default.
+        Normal,
+
+        // Large transfers which can afford to wait.
+        Bulk,
+    };
+
+}
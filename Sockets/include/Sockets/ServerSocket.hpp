@@ -1,9 +1,17 @@
 #pragma once
 
+#include <chrono>
 #include <functional>
 #include <memory>
+#include <Sockets/Capture.hpp>
+#include <Sockets/LatencyHistogram.hpp>
+#include <Sockets/SendPriority.hpp>
+#include <Sockets/Statistics.hpp>
+#include <Sockets/WritePolicy.hpp>
+#include <stddef.h>
 #include <stdint.h>
 #include <string>
+#include <vector>
 
 namespace Sockets {
 
@@ -12,11 +20,179 @@ namespace Sockets {
         // Types
         using OnReceived = std::function< void(const std::string&) >;
         using OnClosed = std::function< void() >;
+        /**
+         * This is a connection accepted by a ServerSocket.  It works just
+         * like a ClientSocket which has connected, and its methods do the
+         * same as the ClientSocket methods of the same names.
+         */
         class Client {
         public:
             virtual void Close() = 0;
-            virtual void SendMessage(const std::string& message) = 0;
-            virtual void Start(
+
+            /**
+             * Write what's queued right away, rather than holding it back
+             * for the rest of the coalescing window.
+             */
+            virtual void Flush() = 0;
+
+            /**
+             * Return histograms of how long messages waited in the send
+             * queue, how late the connection's thread woke up, and how long
+             * the receive callback took.
+             */
+            virtual LatencyHistograms GetLatencyHistograms() const = 0;
+
+            /**
+             * Return the number of bytes queued to be sent but not yet
+             * written to the socket.
+             */
+            virtual size_t GetSendQueueBytes() const = 0;
+
+            /**
+             * Return counts of what the connection has sent and received
+             * since it was accepted.
+             */
+            virtual ConnectionStatistics GetStatistics() const = 0;
+
+            /**
+             * Queue a message to be sent, ahead of queued messages of lower
+             * priority.
+             */
+            virtual void SendMessage(
+                const std::string& message,
+                SendPriority priority = SendPriority::Normal
+            ) = 0;
+
+            /**
+             * Queue a message shared with other connections, without
+             * copying it.  It must not be changed afterwards.
+             */
+            virtual void SendMessage(
+                const std::shared_ptr< const std::string >& message,
+                SendPriority priority = SendPriority::Normal
+            ) = 0;
+
+            /**
+             * Queue part of a file (or, on Linux, a pipe) to be sent
+             * without reading it into the program where possible.  The
+             * file may be closed once this returns.
+             *
+             * Returns false if the file can't be used, or compression is
+             * on.
+             */
+            virtual bool SendFile(
+                int file,
+                uint64_t offset,
+                size_t length
+            ) = 0;
+
+            /**
+             * Queue several messages to be sent, more cheaply than sending
+             * each one separately.
+             */
+            virtual void SendMessages(
+                const std::vector< std::string >& messages,
+                SendPriority priority = SendPriority::Normal
+            ) = 0;
+
+            /**
+             * Choose whether to deliver everything readable in a single
+             * call to the receive callback, rather than each read.
+             */
+            virtual void SetBatchedReceive(bool batchedReceive) = 0;
+
+            /**
+             * Record the messages sent and received in the given capture,
+             * or stop recording them if it's null.
+             */
+            virtual void SetCapture(const std::shared_ptr< Capture >& capture) = 0;
+
+            /**
+             * Turn compression on or off.  The client must do the same,
+             * and both before anything is sent.
+             *
+             * Returns false if it's too late to change.
+             */
+            virtual bool SetCompression(bool compression, size_t threshold = 256) = 0;
+
+            /**
+             * Send the given message whenever nothing else has been sent
+             * for the given interval.  An interval of zero turns
+             * heartbeats off.
+             */
+            virtual void SetHeartbeat(
+                std::chrono::milliseconds interval,
+                const std::string& message
+            ) = 0;
+
+            /**
+             * Close the connection once the read, write or idle timeout
+             * is reached.  A timeout of zero is never reached.
+             */
+            virtual void SetIdleTimeouts(
+                std::chrono::milliseconds readTimeout,
+                std::chrono::milliseconds writeTimeout,
+                std::chrono::milliseconds idleTimeout
+            ) = 0;
+
+            /**
+             * Have the operating system probe the connection when it's
+             * idle, and give up on it if the probes go unanswered.  This
+             * does nothing on a local connection.
+             *
+             * Returns false if the operating system refuses the settings.
+             */
+            virtual bool SetKeepAlive(
+                std::chrono::seconds idle,
+                std::chrono::seconds interval,
+                unsigned int count
+            ) = 0;
+
+            /**
+             * Limit the rate at which data is sent, in bytes per second,
+             * allowing bursts of up to the given size.  A rate of zero
+             * removes the limit.
+             */
+            virtual void SetRateLimit(uint64_t bytesPerSecond, size_t burst = 0) = 0;
+
+            /**
+             * Have the operating system give up on the connection if data
+             * sent goes unacknowledged for the given time.  This does
+             * nothing on a local connection.
+             *
+             * Returns false if the operating system refuses the setting.
+             */
+            virtual bool SetUserTimeout(std::chrono::milliseconds timeout) = 0;
+
+            /**
+             * Choose how to trade off latency against efficiency when
+             * writing (see WritePolicy).
+             *
+             * Returns false if the operating system refuses the setting.
+             */
+            virtual bool SetWritePolicy(
+                WritePolicy writePolicy,
+                std::chrono::microseconds coalesceWindow = std::chrono::microseconds(0)
+            ) = 0;
+
+            /**
+             * Send messages at least as big as the given threshold without
+             * copying them into the operating system.  A threshold of zero
+             * turns this off.
+             *
+             * Returns false if the operating system doesn't support it.
+             */
+            virtual bool SetZeroCopyThreshold(size_t threshold) = 0;
+
+            /**
+             * Begin operating the connection, delivering what's received
+             * to the given callback, and calling the other one when the
+             * connection closes.  Nothing is received until this is
+             * called, so options such as compression should be set first.
+             *
+             * Returns false if the connection couldn't be started.
+             */
+            virtual bool Start(
                 OnReceived onReceived,
                 OnClosed onClosed
             ) = 0;
@@ -32,7 +208,82 @@ namespace Sockets {
 
         // Methods
         bool Bind(uint16_t port = 0);
+
+        /**
+         * Bind to a local (Unix domain) socket at the given path, instead
+         * of a TCP port, for connections from other programs on the same
+         * host.  A socket left behind at the path is replaced, and the
+         * path is removed again when this object is destroyed.  On Linux,
+         * a path starting with "@" names a socket in the abstract
+         * namespace, which has no file.
+         */
+        bool Bind(const std::string& path);
+
+        /**
+         * Stop accepting connections, and close every connection accepted,
+         * once what's queued to be sent on it has been sent, so that a
+         * program can exit without cutting off what it was sending.  This
+         * waits for the queues to empty, but no longer than the given
+         * timeout.  Connections which have failed aren't waited for, since
+         * their queues will never empty.
+         *
+         * Returns false if some queues still weren't empty in time.
+         */
+        bool Drain(std::chrono::milliseconds timeout);
+
+        ListenerStatistics GetStatistics() const;
+
+        /**
+         * Hand the listening socket, along with the connections accepted
+         * by it, to another program which is waiting in TakeOver on the
+         * local socket at the given path, and stop accepting connections
+         * here.  This lets a new version of a server take over from an old
+         * one without refusing or dropping any connections.
+         *
+         * Accepting stops before the listening socket is handed off, and
+         * the connections are gathered after that, so none accepted in
+         * between are missed.  Each connection is handed off once what's
+         * queued to be sent on it has been sent, which is waited for no
+         * longer than the given timeout.  On return, the list holds the
+         * connections which were handed off, which should be dropped;
+         * their callbacks aren't called again.  The rest (those which were
+         * closing, had negotiated compression, or didn't finish sending in
+         * time) stay here and can be drained with Drain.
+         *
+         * Stop sending on the connections before calling this: anything
+         * sent on one once its hand-off has begun is dropped, with an
+         * error printed.
+         *
+         * Returns false if the other program couldn't be reached, in which
+         * case nothing changes, or if the hand-off failed partway, in
+         * which case connections are no longer accepted here.
+         *
+         * This is only supported on POSIX targets.
+         */
+        bool HandOff(
+            const std::string& path,
+            std::vector< std::shared_ptr< Client > >& handedOff,
+            std::chrono::milliseconds timeout
+        );
+
         bool Listen(OnAcceptClient onAcceptClient);
+        void ReserveConnections(size_t count);
+
+        /**
+         * Instead of binding, wait up to the given timeout for another
+         * program to hand over its listening socket and connections with
+         * HandOff, on a local socket made at the given path.  Call Listen
+         * as usual afterwards; the connections handed over are given to
+         * its callback first, as if they'd just been accepted.  If the
+         * listening socket is a local one, its path is removed when this
+         * object is destroyed, just as if it had been bound here.
+         *
+         * This is only supported on POSIX targets.
+         */
+        bool TakeOver(
+            const std::string& path,
+            std::chrono::milliseconds timeout
+        );
 
     private:
         // Properties
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <Sockets/ServerSocket.hpp>
+#include <Sockets/Statistics.hpp>
+#include <stddef.h>
+#include <string>
+
+namespace Sockets {
+
+    /**
+     * This exchanges messages with another program on the same host
+     * through a pair of single-producer, single-consumer rings in shared
+     * memory, one for each direction, instead of through the operating
+     * system's socket buffers.  Sending a message copies it into the ring,
+     * and receiving it copies it out, with no system calls in between
+     * unless the other side is asleep waiting for data (or for space),
+     * in which case it's woken up through an eventfd.
+     *
+     * The channel is set up over a local (Unix domain) socket: one side
+     * accepts a connection with ServerSocket and hands it to Start, which
+     * makes the shared memory and passes it across; the other side calls
+     * Connect with the socket's path.  The socket stays open to tell each
+     * side when the other goes away.  The side calling Start picks the
+     * size of each ring, which is rounded up to a power of two.
+     *
+     * This is only available on Linux.
+     */
+    class SharedMemoryChannel {
+    public:
+        // Types
+        using OnReceived = std::function< void(const std::string&) >;
+        using OnClosed = std::function< void() >;
+
+        // Constants
+        static constexpr size_t defaultRingSize = 1048576;
+
+        // Lifecycle
+        ~SharedMemoryChannel() noexcept;
+        SharedMemoryChannel(const SharedMemoryChannel&) = delete;
+        SharedMemoryChannel(SharedMemoryChannel&&) noexcept = delete;
+        SharedMemoryChannel& operator=(const SharedMemoryChannel&) = delete;
+        SharedMemoryChannel& operator=(SharedMemoryChannel&&) noexcept = delete;
+
+        // Constructor
+        SharedMemoryChannel();
+
+        // Methods
+        void Close();
+        bool Connect(
+            const std::string& path,
+            OnReceived onReceived,
+            OnClosed onClosed
+        );
+        SharedMemoryStatistics GetStatistics() const;
+        void SendMessage(const std::string& message);
+        bool Start(
+            std::shared_ptr< ServerSocket::Client >&& client,
+            OnReceived onReceived,
+            OnClosed onClosed,
+            size_t ringSize = defaultRingSize
+        );
+
+    private:
+        // Properties
+        struct Impl;
+        std::shared_ptr< Impl > impl_;
+    };
+
+}
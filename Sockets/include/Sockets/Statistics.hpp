@@ -0,0 +1,105 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace Sockets {
+
+    struct EventLoopStatistics {
+        uint64_t wakeups = 0;
+        uint64_t userEventWakeups = 0;
+        uint64_t timeoutWakeups = 0;
+    };
+
+    struct ConnectionStatistics {
+        uint64_t bytesReceived = 0;
+        uint64_t bytesSent = 0;
+        uint64_t messagesReceived = 0;
+        uint64_t messagesSent = 0;
+        uint64_t receiveCalls = 0;
+        uint64_t sendCalls = 0;
+        uint64_t partialWrites = 0;
+        uint64_t receiveWouldBlock = 0;
+        uint64_t sendWouldBlock = 0;
+        uint64_t sendQueueDepth = 0;
+        uint64_t sendQueueBytes = 0;
+        uint64_t zeroCopySends = 0;
+        uint64_t zeroCopyCompletions = 0;
+        uint64_t zeroCopyCopied = 0;
+        uint64_t compressionInputBytes = 0;
+        uint64_t compressionOutputBytes = 0;
+        uint64_t compressionNanoseconds = 0;
+        uint64_t decompressionInputBytes = 0;
+        uint64_t decompressionOutputBytes = 0;
+        uint64_t decompressionNanoseconds = 0;
+        uint64_t throttleStalls = 0;
+        uint64_t throttledNanoseconds = 0;
+        uint64_t sendQueueDepthHigh = 0;
+        uint64_t sendQueueDepthNormal = 0;
+        uint64_t sendQueueDepthBulk = 0;
+        EventLoopStatistics eventLoop;
+    };
+
+    struct DatagramStatistics {
+        uint64_t bytesReceived = 0;
+        uint64_t bytesSent = 0;
+        uint64_t datagramsReceived = 0;
+        uint64_t datagramsSent = 0;
+        uint64_t datagramsDropped = 0;
+        uint64_t receiveCalls = 0;
+        uint64_t sendCalls = 0;
+        uint64_t receiveWouldBlock = 0;
+        uint64_t sendWouldBlock = 0;
+        uint64_t sendQueueDepth = 0;
+        uint64_t sendQueueBytes = 0;
+        uint64_t throttleStalls = 0;
+        uint64_t throttledNanoseconds = 0;
+        EventLoopStatistics eventLoop;
+    };
+
+    struct BrokerStatistics {
+        uint64_t subscribers = 0;
+        uint64_t topics = 0;
+        uint64_t messagesPublished = 0;
+        uint64_t messagesDelivered = 0;
+        uint64_t bytesDelivered = 0;
+        uint64_t messagesDropped = 0;
+        uint64_t messagesConflated = 0;
+        uint64_t subscribersDisconnected = 0;
+    };
+
+    struct CaptureStatistics {
+        uint64_t recordsCaptured = 0;
+        uint64_t bytesCaptured = 0;
+        uint64_t recordsDropped = 0;
+    };
+
+    struct RelayStatistics {
+        uint64_t bytesToUpstream = 0;
+        uint64_t bytesToDownstream = 0;
+        uint64_t transferCalls = 0;
+        uint64_t wouldBlock = 0;
+        uint64_t wakeups = 0;
+    };
+
+    struct SharedMemoryStatistics {
+        uint64_t bytesReceived = 0;
+        uint64_t bytesSent = 0;
+        uint64_t messagesReceived = 0;
+        uint64_t messagesSent = 0;
+        uint64_t sendQueueDepth = 0;
+        uint64_t ringFullStalls = 0;
+        uint64_t doorbellsRung = 0;
+        uint64_t wakeups = 0;
+    };
+
+    struct ListenerStatistics {
+        uint64_t acceptCalls = 0;
+        uint64_t accepted = 0;
+        uint64_t acceptWouldBlock = 0;
+        uint64_t acceptErrors = 0;
+        uint64_t connectionBlocks = 0;
+        uint64_t connectionBlocksInUse = 0;
+        EventLoopStatistics eventLoop;
+    };
+
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+namespace Sockets {
+
+    /**
+     * This controls the recording of socket events into fixed-size,
+     * per-thread ring buffers, which can be dumped to a binary file for
+     * post-mortem performance analysis (for example, by converting it with
+     * the TraceToChrome program).
+     *
+     * A trace file consists of a FileHeader followed by Event records,
+     * in native byte order.
+     */
+    class Trace {
+    public:
+        // Types
+        enum class EventType : uint16_t {
+            Accept,
+            Receive,
+            Send,
+            PartialWrite,
+            WouldBlock,
+            Wakeup,
+            Close,
+            Error,
+        };
+        struct FileHeader {
+            char magic[8];
+            uint32_t version;
+            uint32_t eventSize;
+        };
+        struct Event {
+            uint64_t timestamp;
+            uint64_t bytes;
+            int64_t socket;
+            uint32_t thread;
+            uint16_t type;
+            uint16_t reserved;
+        };
+
+        // Constants
+        static constexpr char magic[8] = {'S', 'K', 'T', 'T', 'R', 'A', 'C', 'E'};
+        static constexpr uint32_t version = 1;
+
+        // Methods
+        static bool Dump(const std::string& path);
+        static const char* GetEventTypeName(EventType type);
+        static bool InstallDumpSignalHandler(
+            int signalNumber,
+            const std::string& path
+        );
+        static bool IsEnabled();
+        static void SetEnabled(bool enabled, size_t eventsPerThread = 4096);
+    };
+
+}
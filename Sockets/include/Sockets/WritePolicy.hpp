@@ -0,0 +1,27 @@
+#pragma once
+
+namespace Sockets {
+
+    /**
+     * These are the ways a connection can trade off latency against
+     * efficiency when writing data to its socket.
+     */
+    enum class WritePolicy {
+        // Each message is written as soon as possible, and the operating
+        // system's defaults (including Nagle's algorithm) apply.
+        Default,
+
+        // Nagle's algorithm is disabled (TCP_NODELAY), so small messages go
+        // out right away instead of waiting for earlier data to be
+        // acknowledged.
+        LowLatency,
+
+        // Nagle's algorithm is disabled, and all messages which are queued
+        // when the socket is ready are written together in a single
+        // operation, so they share segments.  Optionally, writes may be
+        // held back for a short window after a message is queued, to
+        // gather more messages, unless the connection is flushed.
+        AutoCork,
+    };
+
+}
@@ -1,13 +1,379 @@
-#include "Abstractions.hpp"
 #include "PipeSignal.hpp"
 
 #include <algorithm>
+#include <atomic>
 #include <fcntl.h>
+#include <poll.h>
+#include <Sockets/Detail/Abstractions.hpp>
+#include <Sockets/Detail/Counter.hpp>
+#include <Sockets/Detail/LatencyRecorder.hpp>
+#include <Sockets/Detail/TraceBuffer.hpp>
+#include <stddef.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <system_error>
 #include <thread>
+#include <time.h>
+
+#ifdef __linux__
+#include <linux/errqueue.h>
+#include <sys/sendfile.h>
+#endif /* __linux__ */
 
 namespace Sockets {
 
+    long long SendBuffers(
+        SOCKET socket,
+        const SendBuffer* buffers,
+        size_t count,
+        bool more
+    ) {
+        int flags = MSG_NOSIGNAL;
+#ifdef MSG_MORE
+        if (more) {
+            flags |= MSG_MORE;
+        }
+#else /* MSG_MORE */
+        (void)more;
+#endif /* MSG_MORE */
+        if (count == 1) {
+            return (long long)send(socket, buffers[0].data, buffers[0].length, flags);
+        }
+        struct iovec vectors[maximumSendBuffers];
+        count = std::min(count, maximumSendBuffers);
+        for (size_t i = 0; i < count; ++i) {
+            vectors[i].iov_base = (void*)buffers[i].data;
+            vectors[i].iov_len = buffers[i].length;
+        }
+        struct msghdr header = {};
+        header.msg_iov = vectors;
+        header.msg_iovlen = count;
+        return (long long)sendmsg(socket, &header, flags);
+    }
+
+    bool EnableZeroCopy(SOCKET socket) {
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY) && defined(__linux__)
+        int enable = 1;
+        return (
+            setsockopt(
+                socket,
+                SOL_SOCKET,
+                SO_ZEROCOPY,
+                &enable,
+                sizeof(enable)
+            ) == 0
+        );
+#else
+        (void)socket;
+        return false;
+#endif
+    }
+
+    bool SetPacingRate(SOCKET socket, uint64_t bytesPerSecond) {
+#if defined(SO_MAX_PACING_RATE) && defined(__linux__)
+        // Older kernels only take a 32-bit rate, with all bits set meaning
+        // no limit, which is also what anything too big for that becomes.
+        const uint32_t rate = (
+            ((bytesPerSecond == 0) || (bytesPerSecond > UINT32_MAX))
+            ? UINT32_MAX
+            : (uint32_t)bytesPerSecond
+        );
+        return (
+            setsockopt(
+                socket,
+                SOL_SOCKET,
+                SO_MAX_PACING_RATE,
+                &rate,
+                sizeof(rate)
+            ) == 0
+        );
+#else
+        (void)socket;
+        (void)bytesPerSecond;
+        return false;
+#endif
+    }
+
+    long long SendZeroCopy(
+        SOCKET socket,
+        const char* data,
+        size_t length
+    ) {
+#if defined(MSG_ZEROCOPY)
+        return (long long)send(socket, data, length, MSG_NOSIGNAL | MSG_ZEROCOPY);
+#else
+        return (long long)send(socket, data, length, MSG_NOSIGNAL);
+#endif
+    }
+
+    bool ReadZeroCopyCompletion(
+        SOCKET socket,
+        uint32_t& first,
+        uint32_t& last,
+        bool& copied
+    ) {
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY) && defined(__linux__)
+        char control[128];
+        struct msghdr header = {};
+        header.msg_control = control;
+        header.msg_controllen = sizeof(control);
+        if (recvmsg(socket, &header, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            return false;
+        }
+        for (
+            auto message = CMSG_FIRSTHDR(&header);
+            message != NULL;
+            message = CMSG_NXTHDR(&header, message)
+        ) {
+            const auto error = (const struct sock_extended_err*)CMSG_DATA(message);
+            if (
+                (error->ee_errno != 0)
+                || (error->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+            ) {
+                continue;
+            }
+            first = error->ee_info;
+            last = error->ee_data;
+            copied = ((error->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0);
+            return true;
+        }
+
+        // Something other than a zero-copy completion was queued; report
+        // an empty range so that the caller keeps reading.
+        first = 1;
+        last = 0;
+        copied = false;
+        return true;
+#else
+        (void)socket;
+        (void)first;
+        (void)last;
+        (void)copied;
+        return false;
+#endif
+    }
+
+    int DuplicateFile(int file, bool& isPipe) {
+        struct stat status;
+        if (fstat(file, &status) != 0) {
+            return -1;
+        }
+        isPipe = S_ISFIFO(status.st_mode);
+#ifndef __linux__
+        if (isPipe) {
+            return -1;
+        }
+#endif /* __linux__ */
+        return fcntl(file, F_DUPFD_CLOEXEC, 0);
+    }
+
+    void CloseFile(int file) {
+        (void)close(file);
+    }
+
+    long long SendFileData(
+        SOCKET socket,
+        int file,
+        bool isPipe,
+        uint64_t offset,
+        size_t length
+    ) {
+#ifdef __linux__
+        if (isPipe) {
+            return (long long)splice(
+                file,
+                NULL,
+                socket,
+                NULL,
+                length,
+                SPLICE_F_MOVE | SPLICE_F_NONBLOCK
+            );
+        }
+        off_t fileOffset = (off_t)offset;
+        return (long long)sendfile(socket, file, &fileOffset, length);
+#else /* __linux__ */
+        // Without sendfile, the data has to come through user space, but
+        // positional reads at least leave the file's position alone.
+        (void)isPipe;
+        char buffer[65536];
+        const auto amountRead = pread(
+            file,
+            buffer,
+            std::min(length, sizeof(buffer)),
+            (off_t)offset
+        );
+        if (amountRead <= 0) {
+            return (long long)amountRead;
+        }
+        return (long long)send(socket, buffer, (size_t)amountRead, MSG_NOSIGNAL);
+#endif /* __linux__ */
+    }
+
+    bool MakeLocalAddress(const std::string& path, LocalAddress& address) {
+        struct sockaddr_un localAddress;
+        if (
+            path.empty()
+            || (path.length() >= sizeof(localAddress.sun_path))
+        ) {
+            return false;
+        }
+        (void)memset(&localAddress, 0, sizeof(localAddress));
+        localAddress.sun_family = AF_UNIX;
+        (void)memcpy(localAddress.sun_path, path.data(), path.length());
+        address.length = (SOCKADDR_LENGTH_TYPE)(
+            offsetof(struct sockaddr_un, sun_path)
+            + path.length()
+        );
+#ifdef __linux__
+        // Abstract names are marked by a leading null character, and
+        // their length is exactly what's given, with no terminator.
+        if (path[0] == '@') {
+            localAddress.sun_path[0] = '\0';
+        } else {
+            ++address.length;
+        }
+#else /* __linux__ */
+        ++address.length;
+#endif /* __linux__ */
+        (void)memcpy(&address.storage, &localAddress, sizeof(localAddress));
+        return true;
+    }
+
+    std::string GetLocalPath(SOCKET socket) {
+        struct sockaddr_un localAddress;
+        auto localAddressLength = (SOCKADDR_LENGTH_TYPE)sizeof(localAddress);
+        if (
+            (getsockname(socket, (struct sockaddr*)&localAddress, &localAddressLength) != 0)
+            || (localAddress.sun_family != AF_UNIX)
+            || (localAddressLength <= (SOCKADDR_LENGTH_TYPE)offsetof(struct sockaddr_un, sun_path))
+        ) {
+            return "";
+        }
+        const auto pathLength = std::min(
+            (size_t)localAddressLength - offsetof(struct sockaddr_un, sun_path),
+            sizeof(localAddress.sun_path)
+        );
+#ifdef __linux__
+        if (localAddress.sun_path[0] == '\0') {
+            return "@" + std::string(localAddress.sun_path + 1, pathLength - 1);
+        }
+#endif /* __linux__ */
+        return std::string(localAddress.sun_path, strnlen(localAddress.sun_path, pathLength));
+    }
+
+    void RemoveLocalAddress(const std::string& path) {
+#ifdef __linux__
+        if (
+            !path.empty()
+            && (path[0] == '@')
+        ) {
+            return;
+        }
+#endif /* __linux__ */
+
+        // Only sockets are removed, so that a mistaken path can't take out
+        // some other file.
+        struct stat status;
+        if (
+            (lstat(path.c_str(), &status) == 0)
+            && S_ISSOCK(status.st_mode)
+        ) {
+            (void)unlink(path.c_str());
+        }
+    }
+
+    bool SendSockets(SOCKET channel, const SOCKET* sockets, size_t count) {
+        if (count > maximumSocketsPerTransfer) {
+            return false;
+        }
+
+        // The number of sockets goes along as data, both because something
+        // has to be sent to carry them and so that the receiver can tell
+        // if any went missing.
+        uint32_t header = (uint32_t)count;
+        struct iovec data;
+        data.iov_base = &header;
+        data.iov_len = sizeof(header);
+        union {
+            char buffer[CMSG_SPACE(sizeof(int) * maximumSocketsPerTransfer)];
+            struct cmsghdr alignment;
+        } control;
+        struct msghdr message;
+        (void)memset(&message, 0, sizeof(message));
+        message.msg_iov = &data;
+        message.msg_iovlen = 1;
+        if (count > 0) {
+            (void)memset(control.buffer, 0, sizeof(control.buffer));
+            message.msg_control = control.buffer;
+            message.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+            const auto rights = CMSG_FIRSTHDR(&message);
+            rights->cmsg_level = SOL_SOCKET;
+            rights->cmsg_type = SCM_RIGHTS;
+            rights->cmsg_len = CMSG_LEN(sizeof(int) * count);
+            (void)memcpy(CMSG_DATA(rights), sockets, sizeof(int) * count);
+        }
+        return (sendmsg(channel, &message, MSG_NOSIGNAL) == (ssize_t)sizeof(header));
+    }
+
+    bool ReceiveSockets(
+        SOCKET channel,
+        std::vector< SOCKET >& sockets,
+        size_t& count
+    ) {
+        uint32_t header = 0;
+        struct iovec data;
+        data.iov_base = &header;
+        data.iov_len = sizeof(header);
+        union {
+            char buffer[CMSG_SPACE(sizeof(int) * maximumSocketsPerTransfer)];
+            struct cmsghdr alignment;
+        } control;
+        struct msghdr message;
+        (void)memset(&message, 0, sizeof(message));
+        message.msg_iov = &data;
+        message.msg_iovlen = 1;
+        message.msg_control = control.buffer;
+        message.msg_controllen = sizeof(control.buffer);
+        const auto amountReceived = recvmsg(channel, &message, MSG_WAITALL);
+        if (amountReceived != (ssize_t)sizeof(header)) {
+            return false;
+        }
+        count = 0;
+        for (
+            auto rights = CMSG_FIRSTHDR(&message);
+            rights != NULL;
+            rights = CMSG_NXTHDR(&message, rights)
+        ) {
+            if (
+                (rights->cmsg_level != SOL_SOCKET)
+                || (rights->cmsg_type != SCM_RIGHTS)
+            ) {
+                continue;
+            }
+            const auto received = (rights->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (size_t i = 0; i < received; ++i) {
+                int socket;
+                (void)memcpy(&socket, CMSG_DATA(rights) + i * sizeof(int), sizeof(int));
+                sockets.push_back(socket);
+                ++count;
+            }
+        }
+        return (
+            (count == header)
+            && ((message.msg_flags & MSG_CTRUNC) == 0)
+        );
+    }
+
+    bool WaitUntilReadable(SOCKET socket, std::chrono::milliseconds timeout) {
+        struct pollfd pollfds[1];
+        pollfds[0].fd = socket;
+        pollfds[0].events = POLLIN;
+        return (poll(pollfds, 1, (int)timeout.count()) > 0);
+    }
+
     struct UsesSockets::Impl {
     };
 
@@ -18,6 +384,13 @@ namespace Sockets {
 
     struct SocketEventLoop::Impl {
         bool stop = false;
+        std::atomic< long long > timeoutMicroseconds{0};
+        std::atomic< bool > reading{true};
+        Counter wakeups;
+        Counter userEventWakeups;
+        Counter timeoutWakeups;
+        std::atomic< long long > userEventSignaledAt{0};
+        LatencyRecorder wakeupDelay;
         PipeSignal userEvent;
         std::thread worker;
 
@@ -40,6 +413,19 @@ namespace Sockets {
 
         Impl() = default;
 
+        static long long Now() {
+            return (long long)std::chrono::duration_cast< std::chrono::nanoseconds >(
+                std::chrono::steady_clock::now().time_since_epoch()
+            ).count();
+        }
+
+        void RecordWakeupDelay() {
+            const auto signaledAt = userEventSignaledAt.exchange(0);
+            if (signaledAt != 0) {
+                wakeupDelay.Record(std::chrono::nanoseconds(Now() - signaledAt));
+            }
+        }
+
         static void Worker(
             std::weak_ptr< Impl > implWeak,
             SOCKET socket,
@@ -56,19 +442,52 @@ namespace Sockets {
                     return;
                 }
                 if (wait) {
-                    const int userEventSelectHandle = impl->userEvent.GetSelectHandle();
-                    const int nfds = std::max(userEventSelectHandle, socket) + 1;
-                    fd_set readfds, writefds;
-                    FD_ZERO(&readfds);
-                    FD_ZERO(&writefds);
-                    FD_SET(socket, &readfds);
+                    // Use poll rather than select, since select can't
+                    // handle descriptors at or above FD_SETSIZE, which are
+                    // common once there are many connections.
+                    struct pollfd pollfds[2];
+                    pollfds[0].fd = socket;
+                    pollfds[0].events = impl->reading ? POLLIN : 0;
                     if (isReadyToSend()) {
-                        FD_SET(socket, &writefds);
+                        pollfds[0].events |= POLLOUT;
                     }
-                    FD_SET(userEventSelectHandle, &readfds);
-                    (void)select(nfds, &readfds, &writefds, NULL, NULL);
-                    if (FD_ISSET(userEventSelectHandle, &readfds) != 0) {
+                    pollfds[1].fd = impl->userEvent.GetSelectHandle();
+                    pollfds[1].events = POLLIN;
+                    const auto timeoutMicroseconds = impl->timeoutMicroseconds.load();
+#ifdef __linux__
+                    // Use ppoll where we have it, since its timeout has
+                    // better than millisecond resolution.
+                    struct timespec timeout;
+                    timeout.tv_sec = (time_t)(timeoutMicroseconds / 1000000);
+                    timeout.tv_nsec = (long)(timeoutMicroseconds % 1000000) * 1000;
+                    const int pollResult = ppoll(
+                        pollfds,
+                        2,
+                        (timeoutMicroseconds > 0) ? &timeout : NULL,
+                        NULL
+                    );
+#else /* __linux__ */
+                    const int pollResult = poll(
+                        pollfds,
+                        2,
+                        (
+                            (timeoutMicroseconds > 0)
+                            ? (int)((timeoutMicroseconds + 999) / 1000)
+                            : -1
+                        )
+                    );
+#endif /* __linux__ */
+                    impl->wakeups.Add();
+                    TraceEvent(Trace::EventType::Wakeup, socket);
+                    if (pollResult == 0) {
+                        impl->timeoutWakeups.Add();
+                    } else if (
+                        (pollResult > 0)
+                        && ((pollfds[1].revents & POLLIN) != 0)
+                    ) {
+                        impl->userEventWakeups.Add();
                         impl->userEvent.Clear();
+                        impl->RecordWakeupDelay();
                     }
                 }
                 wait = onSocketReady();
@@ -90,7 +509,29 @@ namespace Sockets {
     {
     }
 
-    void SocketEventLoop::Start(
+    EventLoopStatistics SocketEventLoop::GetStatistics() const {
+        EventLoopStatistics statistics;
+        statistics.wakeups = impl_->wakeups.Get();
+        statistics.userEventWakeups = impl_->userEventWakeups.Get();
+        statistics.timeoutWakeups = impl_->timeoutWakeups.Get();
+        return statistics;
+    }
+
+    LatencyHistogram SocketEventLoop::GetWakeupDelay() const {
+        return impl_->wakeupDelay.GetHistogram();
+    }
+
+    void SocketEventLoop::Join() {
+        Stop();
+        if (
+            impl_->worker.joinable()
+            && (impl_->worker.get_id() != std::this_thread::get_id())
+        ) {
+            impl_->worker.join();
+        }
+    }
+
+    bool SocketEventLoop::Start(
         SOCKET socket,
         IsReadyToSend isReadyToSend,
         OnSocketReady onSocketReady
@@ -100,17 +541,27 @@ namespace Sockets {
         (void)fcntl(socket, F_SETFL, flags);
         if (!impl_->userEvent.Initialize()) {
             fprintf(stderr, "error: unable to create user event\n");
-            return;
+            return false;
         }
         impl_->userEvent.Clear();
         std::weak_ptr< Impl > implWeak(impl_);
-        impl_->worker = std::thread(
-            &Impl::Worker,
-            implWeak,
-            socket,
-            isReadyToSend,
-            onSocketReady
-        );
+        try {
+            impl_->worker = std::thread(
+                &Impl::Worker,
+                implWeak,
+                socket,
+                std::move(isReadyToSend),
+                std::move(onSocketReady)
+            );
+        } catch (const std::system_error&) {
+            fprintf(stderr, "error: unable to create worker thread\n");
+            return false;
+        }
+        return true;
+    }
+
+    void SocketEventLoop::SetTimeout(std::chrono::microseconds timeout) {
+        impl_->timeoutMicroseconds = (long long)timeout.count();
     }
 
     void SocketEventLoop::Stop() {
@@ -118,7 +569,21 @@ namespace Sockets {
         impl_->userEvent.Set();
     }
 
+    void SocketEventLoop::StartReading() {
+        impl_->reading = true;
+        impl_->userEvent.Set();
+    }
+
+    void SocketEventLoop::StopReading() {
+        impl_->reading = false;
+    }
+
     void SocketEventLoop::UserEvent() {
+        long long notSignaled = 0;
+        (void)impl_->userEventSignaledAt.compare_exchange_strong(
+            notSignaled,
+            Impl::Now()
+        );
         impl_->userEvent.Set();
     }
 
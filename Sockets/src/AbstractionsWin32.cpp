@@ -1,10 +1,202 @@
-#include "Abstractions.hpp"
-
+#include <afunix.h>
+#include <algorithm>
+#include <atomic>
+#include <io.h>
+#include <Sockets/Detail/Abstractions.hpp>
+#include <Sockets/Detail/Counter.hpp>
+#include <Sockets/Detail/LatencyRecorder.hpp>
+#include <Sockets/Detail/TraceBuffer.hpp>
+#include <stddef.h>
 #include <stdio.h>
+#include <string.h>
+#include <system_error>
 #include <thread>
 
 namespace Sockets {
 
+    long long SendBuffers(
+        SOCKET socket,
+        const SendBuffer* buffers,
+        size_t count,
+        bool /* more */
+    ) {
+        WSABUF wsaBuffers[maximumSendBuffers];
+        count = std::min(count, maximumSendBuffers);
+        for (size_t i = 0; i < count; ++i) {
+            wsaBuffers[i].buf = (CHAR*)buffers[i].data;
+            wsaBuffers[i].len = (ULONG)buffers[i].length;
+        }
+        DWORD amountSent = 0;
+        if (
+            WSASend(
+                socket,
+                wsaBuffers,
+                (DWORD)count,
+                &amountSent,
+                0,
+                NULL,
+                NULL
+            ) == SOCKET_ERROR
+        ) {
+            return SOCKET_ERROR;
+        }
+        return (long long)amountSent;
+    }
+
+    bool EnableZeroCopy(SOCKET /* socket */) {
+        return false;
+    }
+
+    bool SetPacingRate(SOCKET /* socket */, uint64_t /* bytesPerSecond */) {
+        return false;
+    }
+
+    long long SendZeroCopy(
+        SOCKET socket,
+        const char* data,
+        size_t length
+    ) {
+        return (long long)send(socket, data, (int)length, 0);
+    }
+
+    bool ReadZeroCopyCompletion(
+        SOCKET /* socket */,
+        uint32_t& /* first */,
+        uint32_t& /* last */,
+        bool& /* copied */
+    ) {
+        return false;
+    }
+
+    int DuplicateFile(int file, bool& isPipe) {
+        const auto handle = (HANDLE)_get_osfhandle(file);
+        if (handle == INVALID_HANDLE_VALUE) {
+            return -1;
+        }
+
+        // Sending from pipes isn't supported, since there's no way to put
+        // data back into a pipe when a socket only takes some of it.
+        isPipe = (GetFileType(handle) == FILE_TYPE_PIPE);
+        if (isPipe) {
+            return -1;
+        }
+        return _dup(file);
+    }
+
+    void CloseFile(int file) {
+        (void)_close(file);
+    }
+
+    long long SendFileData(
+        SOCKET socket,
+        int file,
+        bool /* isPipe */,
+        uint64_t offset,
+        size_t length
+    ) {
+        // TransmitFile blocks (or needs overlapped I/O), so read the file
+        // through user space instead, at the given offset so the file's
+        // position is left alone.
+        char buffer[65536];
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = (DWORD)offset;
+        overlapped.OffsetHigh = (DWORD)(offset >> 32);
+        DWORD amountRead = 0;
+        if (
+            !ReadFile(
+                (HANDLE)_get_osfhandle(file),
+                buffer,
+                (DWORD)std::min(length, sizeof(buffer)),
+                &amountRead,
+                &overlapped
+            )
+        ) {
+            if (GetLastError() == ERROR_HANDLE_EOF) {
+                return 0;
+            }
+            return SOCKET_ERROR;
+        }
+        if (amountRead == 0) {
+            return 0;
+        }
+        return (long long)send(socket, buffer, (int)amountRead, 0);
+    }
+
+    bool MakeLocalAddress(const std::string& path, LocalAddress& address) {
+        // Windows has no abstract namespace, so names are always paths.
+        struct sockaddr_un localAddress;
+        if (
+            path.empty()
+            || (path.length() >= sizeof(localAddress.sun_path))
+        ) {
+            return false;
+        }
+        (void)memset(&localAddress, 0, sizeof(localAddress));
+        localAddress.sun_family = AF_UNIX;
+        (void)memcpy(localAddress.sun_path, path.data(), path.length());
+        address.length = (SOCKADDR_LENGTH_TYPE)(
+            offsetof(struct sockaddr_un, sun_path)
+            + path.length()
+            + 1
+        );
+        (void)memcpy(&address.storage, &localAddress, sizeof(localAddress));
+        return true;
+    }
+
+    std::string GetLocalPath(SOCKET socket) {
+        struct sockaddr_un localAddress;
+        auto localAddressLength = (SOCKADDR_LENGTH_TYPE)sizeof(localAddress);
+        if (
+            (getsockname(socket, (struct sockaddr*)&localAddress, &localAddressLength) != 0)
+            || (localAddress.sun_family != AF_UNIX)
+            || (localAddressLength <= (SOCKADDR_LENGTH_TYPE)offsetof(struct sockaddr_un, sun_path))
+        ) {
+            return "";
+        }
+        const auto pathLength = std::min(
+            (size_t)localAddressLength - offsetof(struct sockaddr_un, sun_path),
+            sizeof(localAddress.sun_path)
+        );
+        return std::string(localAddress.sun_path, strnlen(localAddress.sun_path, pathLength));
+    }
+
+    void RemoveLocalAddress(const std::string& path) {
+        // Local sockets show up as reparse points, and only those are
+        // removed, so that a mistaken path can't take out some other file.
+        const auto attributes = GetFileAttributesA(path.c_str());
+        if (
+            (attributes != INVALID_FILE_ATTRIBUTES)
+            && ((attributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0)
+        ) {
+            (void)DeleteFileA(path.c_str());
+        }
+    }
+
+    bool SendSockets(
+        SOCKET /* channel */,
+        const SOCKET* /* sockets */,
+        size_t /* count */
+    ) {
+        // Sockets can't be passed over local sockets on Windows.
+        return false;
+    }
+
+    bool ReceiveSockets(
+        SOCKET /* channel */,
+        std::vector< SOCKET >& /* sockets */,
+        size_t& /* count */
+    ) {
+        return false;
+    }
+
+    bool WaitUntilReadable(SOCKET socket, std::chrono::milliseconds timeout) {
+        WSAPOLLFD pollfds[1];
+        pollfds[0].fd = socket;
+        pollfds[0].events = POLLRDNORM;
+        pollfds[0].revents = 0;
+        return (WSAPoll(pollfds, 1, (INT)timeout.count()) > 0);
+    }
+
     struct UsesSockets::Impl {
         bool wsaStartedUp = false;
 
@@ -34,6 +226,12 @@ namespace Sockets {
 
     struct SocketEventLoop::Impl {
         bool stop = false;
+        std::atomic< long long > timeoutMicroseconds{0};
+        Counter wakeups;
+        Counter userEventWakeups;
+        Counter timeoutWakeups;
+        std::atomic< long long > userEventSignaledAt{0};
+        LatencyRecorder wakeupDelay;
         HANDLE socketEvent = NULL;
         HANDLE userEvent = NULL;
         std::thread worker;
@@ -63,6 +261,19 @@ namespace Sockets {
 
         Impl() = default;
 
+        static long long Now() {
+            return (long long)std::chrono::duration_cast< std::chrono::nanoseconds >(
+                std::chrono::steady_clock::now().time_since_epoch()
+            ).count();
+        }
+
+        void RecordWakeupDelay() {
+            const auto signaledAt = userEventSignaledAt.exchange(0);
+            if (signaledAt != 0) {
+                wakeupDelay.Record(std::chrono::nanoseconds(Now() - signaledAt));
+            }
+        }
+
         static void Worker(
             std::weak_ptr< Impl > implWeak,
             SOCKET socket,
@@ -82,16 +293,27 @@ namespace Sockets {
                         impl->userEvent,
                         impl->socketEvent
                     };
-                    if (
-                        WaitForMultipleObjects(
-                            sizeof(handles) / sizeof(*handles),
-                            handles,
-                            FALSE,
-                            INFINITE
-                        ) == WAIT_OBJECT_0 + 1
-                    ) {
+                    const auto timeoutMicroseconds = impl->timeoutMicroseconds.load();
+                    const auto waitResult = WaitForMultipleObjects(
+                        sizeof(handles) / sizeof(*handles),
+                        handles,
+                        FALSE,
+                        (
+                            (timeoutMicroseconds > 0)
+                            ? (DWORD)((timeoutMicroseconds + 999) / 1000)
+                            : INFINITE
+                        )
+                    );
+                    impl->wakeups.Add();
+                    TraceEvent(Trace::EventType::Wakeup, (int64_t)socket);
+                    if (waitResult == WAIT_OBJECT_0) {
+                        impl->userEventWakeups.Add();
+                        impl->RecordWakeupDelay();
+                    } else if (waitResult == WAIT_OBJECT_0 + 1) {
                         WSANETWORKEVENTS networkEvents;
                         (void)WSAEnumNetworkEvents(socket, impl->socketEvent, &networkEvents);
+                    } else if (waitResult == WAIT_TIMEOUT) {
+                        impl->timeoutWakeups.Add();
                     }
                 }
                 wait = onSocketReady();
@@ -113,7 +335,29 @@ namespace Sockets {
     {
     }
 
-    void SocketEventLoop::Start(
+    EventLoopStatistics SocketEventLoop::GetStatistics() const {
+        EventLoopStatistics statistics;
+        statistics.wakeups = impl_->wakeups.Get();
+        statistics.userEventWakeups = impl_->userEventWakeups.Get();
+        statistics.timeoutWakeups = impl_->timeoutWakeups.Get();
+        return statistics;
+    }
+
+    LatencyHistogram SocketEventLoop::GetWakeupDelay() const {
+        return impl_->wakeupDelay.GetHistogram();
+    }
+
+    void SocketEventLoop::Join() {
+        Stop();
+        if (
+            impl_->worker.joinable()
+            && (impl_->worker.get_id() != std::this_thread::get_id())
+        ) {
+            impl_->worker.join();
+        }
+    }
+
+    bool SocketEventLoop::Start(
         SOCKET socket,
         IsReadyToSend /* isReadyToSend */,
         OnSocketReady onSocketReady
@@ -121,7 +365,7 @@ namespace Sockets {
         impl_->socketEvent = WSACreateEvent();
         if (impl_->socketEvent == NULL) {
             fprintf(stderr, "error: unable to create socket event\n");
-            return;
+            return false;
         }
         if (
             WSAEventSelect(
@@ -131,15 +375,30 @@ namespace Sockets {
             ) != 0
         ) {
             fprintf(stderr, "error: unable to configure socket event\n");
-            return;
+            return false;
         }
         impl_->userEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
         if (impl_->userEvent == NULL) {
             fprintf(stderr, "error: unable to create user event\n");
-            return;
+            return false;
         }
         std::weak_ptr< Impl > implWeak(impl_);
-        impl_->worker = std::thread(&Impl::Worker, implWeak, socket, onSocketReady);
+        try {
+            impl_->worker = std::thread(
+                &Impl::Worker,
+                implWeak,
+                socket,
+                std::move(onSocketReady)
+            );
+        } catch (const std::system_error&) {
+            fprintf(stderr, "error: unable to create worker thread\n");
+            return false;
+        }
+        return true;
+    }
+
+    void SocketEventLoop::SetTimeout(std::chrono::microseconds timeout) {
+        impl_->timeoutMicroseconds = (long long)timeout.count();
     }
 
     void SocketEventLoop::Stop() {
@@ -147,7 +406,22 @@ namespace Sockets {
         (void)SetEvent(impl_->userEvent);
     }
 
+    void SocketEventLoop::StartReading() {
+        // Reading is never stopped (see StopReading), so there is nothing
+        // to do here.
+    }
+
+    void SocketEventLoop::StopReading() {
+        // Network events are only signaled again after the socket is read,
+        // so there is nothing to do here.
+    }
+
     void SocketEventLoop::UserEvent() {
+        long long notSignaled = 0;
+        (void)impl_->userEventSignaledAt.compare_exchange_strong(
+            notSignaled,
+            Impl::Now()
+        );
         (void)SetEvent(impl_->userEvent);
     }
 
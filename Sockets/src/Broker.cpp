@@ -0,0 +1,602 @@
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <Sockets/Broker.hpp>
+#include <Sockets/ServerSocket.hpp>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace {
+
+    // Each frame starts with a command, the length of the topic (two bytes)
+    // and the length of the payload (four bytes), least significant byte
+    // first, followed by the topic and then the payload.
+    constexpr size_t frameHeaderSize = 7;
+
+    // Subscribers and topics are each spread over this many tables, each
+    // with its own lock, so that connections coming and going, and
+    // messages being published, on different topics rarely contend.
+    constexpr size_t numShards = 16;
+
+    // This is how often subscribers holding conflated messages are checked
+    // to see if they've caught up, and disconnected subscribers are
+    // cleaned up.
+    constexpr auto maintenanceInterval = std::chrono::milliseconds(10);
+
+}
+
+namespace Sockets {
+
+    constexpr size_t Broker::defaultMaximumQueueBytes;
+    constexpr size_t Broker::maximumTopicLength;
+    constexpr size_t Broker::maximumPayloadLength;
+
+    bool Broker::Decoder::Decode(const std::string& data, const OnFrame& onFrame) {
+        (void)buffer_.append(data);
+        size_t offset = 0;
+        while (buffer_.length() - offset >= frameHeaderSize) {
+            const auto header = (const uint8_t*)buffer_.data() + offset;
+            const auto command = (Command)header[0];
+            if (
+                (command != Command::Subscribe)
+                && (command != Command::Unsubscribe)
+                && (command != Command::Publish)
+            ) {
+                buffer_.clear();
+                return false;
+            }
+            const size_t topicLength = (
+                (size_t)header[1]
+                | ((size_t)header[2] << 8)
+            );
+            const size_t payloadLength = (
+                (size_t)header[3]
+                | ((size_t)header[4] << 8)
+                | ((size_t)header[5] << 16)
+                | ((size_t)header[6] << 24)
+            );
+            if (payloadLength > maximumPayloadLength) {
+                buffer_.clear();
+                return false;
+            }
+            const auto frameLength = frameHeaderSize + topicLength + payloadLength;
+            if (buffer_.length() - offset < frameLength) {
+                break;
+            }
+            const std::string topic(buffer_, offset + frameHeaderSize, topicLength);
+            const std::string payload(buffer_, offset + frameHeaderSize + topicLength, payloadLength);
+            offset += frameLength;
+            onFrame(command, topic, payload);
+        }
+        (void)buffer_.erase(0, offset);
+        return true;
+    }
+
+    struct Broker::Impl {
+        // Types
+
+        // This is what the broker keeps for each connected client.
+        struct Subscriber {
+            // Properties
+
+            // This is only used by the client's connection, as data is
+            // received from it.
+            Decoder decoder;
+
+            // This is used to serialize access to the rest of the
+            // subscriber's state.
+            std::mutex mutex;
+
+            // This is released when the subscriber is removed.
+            std::shared_ptr< ServerSocket::Client > client;
+
+            std::unordered_set< std::string > topics;
+
+            // These are the latest messages for each topic which were held
+            // back, under the conflate policy, until the subscriber catches
+            // up, in the order in which their topics were first held back.
+            std::vector< std::pair< std::string, std::shared_ptr< const std::string > > > conflated;
+
+            bool removed = false;
+        };
+
+        using SubscriberList = std::vector< std::shared_ptr< Subscriber > >;
+
+        struct SubscriberShard {
+            std::mutex mutex;
+            std::unordered_set< std::shared_ptr< Subscriber > > subscribers;
+        };
+
+        // Each topic's list of subscribers is replaced rather than changed,
+        // so that publishers can take the list and fan out a message
+        // without holding the lock.
+        struct TopicShard {
+            std::mutex mutex;
+            std::unordered_map< std::string, std::shared_ptr< const SubscriberList > > topics;
+        };
+
+        // Properties
+        ServerSocket server;
+        SubscriberShard subscriberShards[numShards];
+        TopicShard topicShards[numShards];
+        std::atomic< SlowSubscriberPolicy > policy{SlowSubscriberPolicy::Drop};
+        std::atomic< size_t > maximumQueueBytes{defaultMaximumQueueBytes};
+        std::thread maintainer;
+
+        // This is used to serialize access to the following, which are
+        // taken care of by the maintainer.
+        std::mutex maintenanceMutex;
+        std::vector< std::shared_ptr< Subscriber > > subscribersToFlush;
+        std::vector< std::shared_ptr< ServerSocket::Client > > clientsToRelease;
+
+        // Statistics
+        //
+        // These are updated from every subscriber's connection, so they
+        // can't use Counter, which needs updates to be serialized.
+        std::atomic< uint64_t > messagesPublished{0};
+        std::atomic< uint64_t > messagesDelivered{0};
+        std::atomic< uint64_t > bytesDelivered{0};
+        std::atomic< uint64_t > messagesDropped{0};
+        std::atomic< uint64_t > messagesConflated{0};
+        std::atomic< uint64_t > subscribersDisconnected{0};
+
+        // Lifecycle
+
+        ~Impl() noexcept {
+            if (maintainer.joinable()) {
+                if (maintainer.get_id() == std::this_thread::get_id()) {
+                    maintainer.detach();
+                } else {
+                    maintainer.join();
+                }
+            }
+        }
+
+        Impl(const Impl&) = delete;
+        Impl(Impl&&) noexcept = delete;
+        Impl& operator=(const Impl&) = delete;
+        Impl& operator=(Impl&&) noexcept = delete;
+
+        // Constructor
+        Impl() = default;
+
+        // Methods
+
+        SubscriberShard& GetSubscriberShard(const Subscriber* subscriber) {
+            return subscriberShards[
+                (std::hash< const Subscriber* >()(subscriber) / sizeof(Subscriber)) % numShards
+            ];
+        }
+
+        TopicShard& GetTopicShard(const std::string& topic) {
+            return topicShards[std::hash< std::string >()(topic) % numShards];
+        }
+
+        void OnAcceptClient(
+            const std::shared_ptr< Impl >& self,
+            std::shared_ptr< ServerSocket::Client >&& client
+        ) {
+            const auto subscriber = std::make_shared< Subscriber >();
+            subscriber->client = std::move(client);
+            {
+                auto& shard = GetSubscriberShard(subscriber.get());
+                std::lock_guard< decltype(shard.mutex) > lock(shard.mutex);
+                (void)shard.subscribers.insert(subscriber);
+            }
+            std::weak_ptr< Impl > implWeak(self);
+            std::weak_ptr< Subscriber > subscriberWeak(subscriber);
+            const auto started = subscriber->client->Start(
+                // onReceived
+                [implWeak, subscriberWeak](const std::string& message){
+                    const auto impl = implWeak.lock();
+                    const auto subscriber = subscriberWeak.lock();
+                    if (!impl || !subscriber) {
+                        return;
+                    }
+                    impl->OnReceived(subscriber, message);
+                },
+
+                // onClosed
+                [implWeak, subscriberWeak]{
+                    const auto impl = implWeak.lock();
+                    const auto subscriber = subscriberWeak.lock();
+                    if (!impl || !subscriber) {
+                        return;
+                    }
+                    impl->RemoveSubscriber(subscriber);
+                }
+            );
+            if (!started) {
+                RemoveSubscriber(subscriber);
+            }
+        }
+
+        void OnReceived(
+            const std::shared_ptr< Subscriber >& subscriber,
+            const std::string& message
+        ) {
+            const auto valid = subscriber->decoder.Decode(
+                message,
+                [this, &subscriber](
+                    Command command,
+                    const std::string& topic,
+                    const std::string& payload
+                ){
+                    switch (command) {
+                        case Command::Subscribe: {
+                            Subscribe(subscriber, topic);
+                        } break;
+
+                        case Command::Unsubscribe: {
+                            Unsubscribe(subscriber, topic);
+                        } break;
+
+                        case Command::Publish: {
+                            Publish(topic, payload);
+                        } break;
+
+                        default: break;
+                    }
+                }
+            );
+            if (!valid) {
+                fprintf(stderr, "error: invalid frame received from broker client\n");
+                RemoveSubscriber(subscriber);
+            }
+        }
+
+        void Subscribe(
+            const std::shared_ptr< Subscriber >& subscriber,
+            const std::string& topic
+        ) {
+            if (topic.length() > maximumTopicLength) {
+                return;
+            }
+            std::lock_guard< decltype(subscriber->mutex) > subscriberLock(subscriber->mutex);
+            if (
+                subscriber->removed
+                || !subscriber->topics.insert(topic).second
+            ) {
+                return;
+            }
+            auto& shard = GetTopicShard(topic);
+            std::lock_guard< decltype(shard.mutex) > shardLock(shard.mutex);
+            auto& subscribers = shard.topics[topic];
+            std::shared_ptr< SubscriberList > newSubscribers;
+            if (subscribers) {
+                newSubscribers = std::make_shared< SubscriberList >(*subscribers);
+            } else {
+                newSubscribers = std::make_shared< SubscriberList >();
+            }
+            newSubscribers->push_back(subscriber);
+            subscribers = std::move(newSubscribers);
+        }
+
+        void Unsubscribe(
+            const std::shared_ptr< Subscriber >& subscriber,
+            const std::string& topic
+        ) {
+            std::lock_guard< decltype(subscriber->mutex) > subscriberLock(subscriber->mutex);
+            if (subscriber->topics.erase(topic) == 0) {
+                return;
+            }
+            RemoveFromTopic(subscriber, topic);
+        }
+
+        void RemoveFromTopic(
+            const std::shared_ptr< Subscriber >& subscriber,
+            const std::string& topic
+        ) {
+            auto& shard = GetTopicShard(topic);
+            std::lock_guard< decltype(shard.mutex) > shardLock(shard.mutex);
+            const auto subscribersEntry = shard.topics.find(topic);
+            if (subscribersEntry == shard.topics.end()) {
+                return;
+            }
+            const auto& subscribers = *subscribersEntry->second;
+            if (subscribers.size() == 1) {
+                (void)shard.topics.erase(subscribersEntry);
+                return;
+            }
+            const auto newSubscribers = std::make_shared< SubscriberList >();
+            newSubscribers->reserve(subscribers.size() - 1);
+            for (const auto& otherSubscriber: subscribers) {
+                if (otherSubscriber != subscriber) {
+                    newSubscribers->push_back(otherSubscriber);
+                }
+            }
+            subscribersEntry->second = std::move(newSubscribers);
+        }
+
+        // Take a subscriber out of all the tables.  Its client is handed to
+        // the maintainer to be released, because releasing it waits for its
+        // connection's thread to finish, which may be busy calling us.
+        void RemoveSubscriber(const std::shared_ptr< Subscriber >& subscriber) {
+            std::shared_ptr< ServerSocket::Client > client;
+            {
+                std::lock_guard< decltype(subscriber->mutex) > subscriberLock(subscriber->mutex);
+                if (subscriber->removed) {
+                    return;
+                }
+                subscriber->removed = true;
+                for (const auto& topic: subscriber->topics) {
+                    RemoveFromTopic(subscriber, topic);
+                }
+                subscriber->topics.clear();
+                subscriber->conflated.clear();
+                client = std::move(subscriber->client);
+            }
+            {
+                auto& shard = GetSubscriberShard(subscriber.get());
+                std::lock_guard< decltype(shard.mutex) > lock(shard.mutex);
+                (void)shard.subscribers.erase(subscriber);
+            }
+            std::lock_guard< decltype(maintenanceMutex) > lock(maintenanceMutex);
+            clientsToRelease.push_back(std::move(client));
+        }
+
+        void Publish(const std::string& topic, const std::string& payload) {
+            if (topic.length() > maximumTopicLength) {
+                fprintf(stderr, "error: broker topic is too long\n");
+                return;
+            }
+            if (payload.length() > maximumPayloadLength) {
+                fprintf(stderr, "error: broker payload is too long\n");
+                return;
+            }
+            std::shared_ptr< const SubscriberList > subscribers;
+            {
+                auto& shard = GetTopicShard(topic);
+                std::lock_guard< decltype(shard.mutex) > lock(shard.mutex);
+                const auto subscribersEntry = shard.topics.find(topic);
+                if (subscribersEntry != shard.topics.end()) {
+                    subscribers = subscribersEntry->second;
+                }
+            }
+            (void)messagesPublished.fetch_add(1, std::memory_order_relaxed);
+            if (!subscribers) {
+                return;
+            }
+            const std::shared_ptr< const std::string > message = std::make_shared< std::string >(
+                Encode(Command::Publish, topic, payload)
+            );
+            const auto limit = maximumQueueBytes.load(std::memory_order_relaxed);
+            const auto slowSubscriberPolicy = policy.load(std::memory_order_relaxed);
+            uint64_t delivered = 0;
+            uint64_t dropped = 0;
+            uint64_t conflated = 0;
+            for (const auto& subscriber: *subscribers) {
+                std::unique_lock< decltype(subscriber->mutex) > lock(subscriber->mutex);
+                if (subscriber->removed) {
+                    continue;
+                }
+                if (
+                    subscriber->conflated.empty()
+                    && (subscriber->client->GetSendQueueBytes() < limit)
+                ) {
+                    subscriber->client->SendMessage(message);
+                    ++delivered;
+                    continue;
+                }
+                switch (slowSubscriberPolicy) {
+                    case SlowSubscriberPolicy::Drop: {
+                        ++dropped;
+                    } break;
+
+                    case SlowSubscriberPolicy::Conflate: {
+                        if (Conflate(*subscriber, topic, message)) {
+                            ++conflated;
+                        } else if (subscriber->conflated.size() == 1) {
+                            lock.unlock();
+                            std::lock_guard< decltype(maintenanceMutex) > maintenanceLock(maintenanceMutex);
+                            subscribersToFlush.push_back(subscriber);
+                        }
+                    } break;
+
+                    case SlowSubscriberPolicy::Disconnect: {
+                        lock.unlock();
+                        (void)subscribersDisconnected.fetch_add(1, std::memory_order_relaxed);
+                        RemoveSubscriber(subscriber);
+                    } break;
+
+                    default: break;
+                }
+            }
+            (void)messagesDelivered.fetch_add(delivered, std::memory_order_relaxed);
+            (void)bytesDelivered.fetch_add(delivered * message->length(), std::memory_order_relaxed);
+            (void)messagesDropped.fetch_add(dropped, std::memory_order_relaxed);
+            (void)messagesConflated.fetch_add(conflated, std::memory_order_relaxed);
+        }
+
+        // Hold back a message for a subscriber which has fallen behind,
+        // replacing any held back earlier for the same topic.
+        //
+        // Returns true if an earlier message was replaced.
+        bool Conflate(
+            Subscriber& subscriber,
+            const std::string& topic,
+            const std::shared_ptr< const std::string >& message
+        ) {
+            for (auto& heldBack: subscriber.conflated) {
+                if (heldBack.first == topic) {
+                    heldBack.second = message;
+                    return true;
+                }
+            }
+            subscriber.conflated.emplace_back(topic, message);
+            return false;
+        }
+
+        // Send the messages held back for a subscriber, if it's caught up.
+        //
+        // Returns false if it's still behind.
+        bool Flush(Subscriber& subscriber) {
+            std::lock_guard< decltype(subscriber.mutex) > lock(subscriber.mutex);
+            if (subscriber.removed) {
+                return true;
+            }
+            if (
+                subscriber.client->GetSendQueueBytes()
+                >= maximumQueueBytes.load(std::memory_order_relaxed)
+            ) {
+                return false;
+            }
+            uint64_t bytes = 0;
+            for (const auto& heldBack: subscriber.conflated) {
+                subscriber.client->SendMessage(heldBack.second);
+                bytes += heldBack.second->length();
+            }
+            (void)messagesDelivered.fetch_add(subscriber.conflated.size(), std::memory_order_relaxed);
+            (void)bytesDelivered.fetch_add(bytes, std::memory_order_relaxed);
+            subscriber.conflated.clear();
+            return true;
+        }
+
+        void Maintain() {
+            decltype(subscribersToFlush) subscribers;
+            decltype(clientsToRelease) clients;
+            {
+                std::lock_guard< decltype(maintenanceMutex) > lock(maintenanceMutex);
+                subscribers.swap(subscribersToFlush);
+                clients.swap(clientsToRelease);
+            }
+            clients.clear();
+            decltype(subscribers) subscribersStillBehind;
+            for (const auto& subscriber: subscribers) {
+                if (!Flush(*subscriber)) {
+                    subscribersStillBehind.push_back(subscriber);
+                }
+            }
+            if (!subscribersStillBehind.empty()) {
+                std::lock_guard< decltype(maintenanceMutex) > lock(maintenanceMutex);
+                subscribersToFlush.insert(
+                    subscribersToFlush.end(),
+                    subscribersStillBehind.begin(),
+                    subscribersStillBehind.end()
+                );
+            }
+        }
+
+        // This is the body of the maintainer thread.  It doesn't hold onto
+        // the broker while waiting, so it never keeps the broker from being
+        // destroyed, and it stops once the broker is gone.
+        static void Maintainer(std::weak_ptr< Impl > implWeak) {
+            for (;;) {
+                std::this_thread::sleep_for(maintenanceInterval);
+                const auto impl = implWeak.lock();
+                if (!impl) {
+                    break;
+                }
+                impl->Maintain();
+            }
+        }
+
+        bool Listen(std::weak_ptr< Impl > implWeak) {
+            if (!maintainer.joinable()) {
+                try {
+                    maintainer = std::thread(&Impl::Maintainer, implWeak);
+                } catch (const std::system_error&) {
+                    fprintf(stderr, "error: unable to create maintainer thread\n");
+                    return false;
+                }
+            }
+            return server.Listen(
+                [implWeak](std::shared_ptr< ServerSocket::Client >&& client){
+                    const auto impl = implWeak.lock();
+                    if (!impl) {
+                        return;
+                    }
+                    impl->OnAcceptClient(impl, std::move(client));
+                }
+            );
+        }
+    };
+
+    Broker::Broker()
+        : impl_(new Impl())
+    {
+    }
+
+    std::string Broker::Encode(
+        Command command,
+        const std::string& topic,
+        const std::string& payload
+    ) {
+        if (topic.length() > maximumTopicLength) {
+            fprintf(stderr, "error: broker topic is too long\n");
+            return std::string();
+        }
+        if (payload.length() > maximumPayloadLength) {
+            fprintf(stderr, "error: broker payload is too long\n");
+            return std::string();
+        }
+        std::string frame;
+        frame.reserve(frameHeaderSize + topic.length() + payload.length());
+        frame.push_back((char)command);
+        frame.push_back((char)(topic.length() & 0xff));
+        frame.push_back((char)(topic.length() >> 8));
+        const auto payloadLength = (uint32_t)payload.length();
+        for (int i = 0; i < 4; ++i) {
+            frame.push_back((char)(payloadLength >> (8 * i)));
+        }
+        (void)frame.append(topic);
+        (void)frame.append(payload);
+        return frame;
+    }
+
+    BrokerStatistics Broker::GetStatistics() const {
+        BrokerStatistics statistics;
+        for (auto& shard: impl_->subscriberShards) {
+            std::lock_guard< decltype(shard.mutex) > lock(shard.mutex);
+            statistics.subscribers += shard.subscribers.size();
+        }
+        for (auto& shard: impl_->topicShards) {
+            std::lock_guard< decltype(shard.mutex) > lock(shard.mutex);
+            statistics.topics += shard.topics.size();
+        }
+        statistics.messagesPublished = impl_->messagesPublished.load(std::memory_order_relaxed);
+        statistics.messagesDelivered = impl_->messagesDelivered.load(std::memory_order_relaxed);
+        statistics.bytesDelivered = impl_->bytesDelivered.load(std::memory_order_relaxed);
+        statistics.messagesDropped = impl_->messagesDropped.load(std::memory_order_relaxed);
+        statistics.messagesConflated = impl_->messagesConflated.load(std::memory_order_relaxed);
+        statistics.subscribersDisconnected = impl_->subscribersDisconnected.load(std::memory_order_relaxed);
+        return statistics;
+    }
+
+    bool Broker::Listen(uint16_t port) {
+        return (
+            impl_->server.Bind(port)
+            && impl_->Listen(impl_)
+        );
+    }
+
+    bool Broker::Listen(const std::string& path) {
+        return (
+            impl_->server.Bind(path)
+            && impl_->Listen(impl_)
+        );
+    }
+
+    void Broker::Publish(const std::string& topic, const std::string& payload) {
+        impl_->Publish(topic, payload);
+    }
+
+    void Broker::SetSlowSubscriberPolicy(
+        SlowSubscriberPolicy policy,
+        size_t maximumQueueBytes
+    ) {
+        impl_->policy = policy;
+        impl_->maximumQueueBytes = maximumQueueBytes;
+    }
+
+}
@@ -0,0 +1,377 @@
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <Sockets/Capture.hpp>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else /* POSIX */
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif /* _WIN32 or POSIX */
+
+namespace {
+
+    // Records start on multiples of this many bytes, so that their headers
+    // are aligned.
+    constexpr size_t recordAlignment = 8;
+
+    size_t AlignRecordSize(size_t size) {
+        return (size + recordAlignment - 1) & ~(recordAlignment - 1);
+    }
+
+}
+
+namespace Sockets {
+
+    constexpr char Capture::magic[8];
+    constexpr uint32_t Capture::version;
+    constexpr size_t Capture::defaultCapacity;
+
+    struct Capture::Impl {
+        // Properties
+
+        // This is used to serialize opening and closing the capture.
+        std::mutex mutex;
+
+#ifdef _WIN32
+        HANDLE file = INVALID_HANDLE_VALUE;
+        HANDLE mapping = NULL;
+#else /* POSIX */
+        int file = -1;
+#endif /* _WIN32 or POSIX */
+        uint8_t* data = nullptr;
+        size_t capacity = 0;
+        std::chrono::steady_clock::time_point start;
+
+        // Messages are only recorded while the capture is open.  Each one
+        // being recorded is counted, so that the capture can wait for them
+        // to finish before it's closed.
+        std::atomic< bool > open{false};
+        std::atomic< size_t > writers{0};
+
+        // This is where the next record goes.
+        std::atomic< size_t > tail{0};
+
+        std::atomic< uint64_t > nextStream{1};
+
+        // Statistics
+        //
+        // These are updated from every connection and datagram socket
+        // sharing the capture, so they can't use Counter, which needs
+        // updates to be serialized.
+        std::atomic< uint64_t > recordsCaptured{0};
+        std::atomic< uint64_t > bytesCaptured{0};
+        std::atomic< uint64_t > recordsDropped{0};
+
+        // Lifecycle
+
+        ~Impl() noexcept {
+            Close();
+        }
+
+        Impl(const Impl&) = delete;
+        Impl(Impl&&) noexcept = delete;
+        Impl& operator=(const Impl&) = delete;
+        Impl& operator=(Impl&&) noexcept = delete;
+
+        // Constructor
+        Impl() = default;
+
+        // Methods
+
+        void Append(
+            uint64_t stream,
+            Direction direction,
+            Transport transport,
+            const std::string& message,
+            uint32_t address,
+            uint16_t port
+        ) {
+            const auto timestamp = std::chrono::steady_clock::now();
+            (void)writers.fetch_add(1);
+            if (!open.load()) {
+                (void)writers.fetch_sub(1);
+                return;
+            }
+            const auto recordSize = AlignRecordSize(sizeof(RecordHeader) + message.length());
+            auto offset = tail.load(std::memory_order_relaxed);
+            do {
+                if (
+                    (message.length() > UINT32_MAX)
+                    || (recordSize > capacity)
+                    || (offset > capacity - recordSize)
+                ) {
+                    (void)recordsDropped.fetch_add(1, std::memory_order_relaxed);
+                    (void)writers.fetch_sub(1, std::memory_order_release);
+                    return;
+                }
+            } while (
+                !tail.compare_exchange_weak(
+                    offset,
+                    offset + recordSize,
+                    std::memory_order_relaxed
+                )
+            );
+
+            // The direction is filled in last, since a record with no
+            // direction marks the end of the data.
+            RecordHeader header;
+            header.timestamp = (uint64_t)std::chrono::duration_cast< std::chrono::nanoseconds >(
+                timestamp - start
+            ).count();
+            header.stream = stream;
+            header.length = (uint32_t)message.length();
+            header.address = address;
+            header.port = port;
+            header.direction = 0;
+            header.transport = (uint8_t)transport;
+            header.reserved = 0;
+            const auto record = data + sizeof(FileHeader) + offset;
+            (void)memcpy(record, &header, sizeof(header));
+            (void)memcpy(record + sizeof(header), message.data(), message.length());
+            std::atomic_thread_fence(std::memory_order_release);
+            record[offsetof(RecordHeader, direction)] = (uint8_t)direction;
+            (void)recordsCaptured.fetch_add(1, std::memory_order_relaxed);
+            (void)bytesCaptured.fetch_add(message.length(), std::memory_order_relaxed);
+            (void)writers.fetch_sub(1, std::memory_order_release);
+        }
+
+        void Close() {
+            std::lock_guard< decltype(mutex) > lock(mutex);
+            if (data == nullptr) {
+                return;
+            }
+            open = false;
+            while (writers.load() > 0) {
+                std::this_thread::yield();
+            }
+            const auto length = sizeof(FileHeader) + tail.load();
+#ifdef _WIN32
+            (void)UnmapViewOfFile(data);
+            (void)CloseHandle(mapping);
+            mapping = NULL;
+            LARGE_INTEGER end;
+            end.QuadPart = (LONGLONG)length;
+            if (
+                !SetFilePointerEx(file, end, NULL, FILE_BEGIN)
+                || !SetEndOfFile(file)
+            ) {
+                fprintf(stderr, "error: unable to trim capture file\n");
+            }
+            (void)CloseHandle(file);
+            file = INVALID_HANDLE_VALUE;
+#else /* POSIX */
+            (void)munmap(data, sizeof(FileHeader) + capacity);
+            if (ftruncate(file, (off_t)length) != 0) {
+                fprintf(stderr, "error: unable to trim capture file\n");
+            }
+            (void)close(file);
+            file = -1;
+#endif /* _WIN32 or POSIX */
+            data = nullptr;
+        }
+
+        bool Map(const std::string& path, size_t fileSize) {
+#ifdef _WIN32
+            file = CreateFileA(
+                path.c_str(),
+                GENERIC_READ | GENERIC_WRITE,
+                FILE_SHARE_READ,
+                NULL,
+                CREATE_ALWAYS,
+                FILE_ATTRIBUTE_NORMAL,
+                NULL
+            );
+            if (file == INVALID_HANDLE_VALUE) {
+                fprintf(stderr, "error: unable to create capture file\n");
+                return false;
+            }
+            mapping = CreateFileMappingA(
+                file,
+                NULL,
+                PAGE_READWRITE,
+                (DWORD)((uint64_t)fileSize >> 32),
+                (DWORD)((uint64_t)fileSize & 0xffffffff),
+                NULL
+            );
+            if (mapping == NULL) {
+                fprintf(stderr, "error: unable to map capture file\n");
+                (void)CloseHandle(file);
+                file = INVALID_HANDLE_VALUE;
+                return false;
+            }
+            data = (uint8_t*)MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, fileSize);
+            if (data == nullptr) {
+                fprintf(stderr, "error: unable to map capture file\n");
+                (void)CloseHandle(mapping);
+                mapping = NULL;
+                (void)CloseHandle(file);
+                file = INVALID_HANDLE_VALUE;
+                return false;
+            }
+#else /* POSIX */
+            file = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (file < 0) {
+                fprintf(stderr, "error: unable to create capture file\n");
+                return false;
+            }
+            if (ftruncate(file, (off_t)fileSize) != 0) {
+                fprintf(stderr, "error: unable to size capture file\n");
+                (void)close(file);
+                file = -1;
+                return false;
+            }
+            const auto mapped = mmap(NULL, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+            if (mapped == MAP_FAILED) {
+                fprintf(stderr, "error: unable to map capture file\n");
+                (void)close(file);
+                file = -1;
+                return false;
+            }
+            data = (uint8_t*)mapped;
+#endif /* _WIN32 or POSIX */
+            return true;
+        }
+
+        bool Open(const std::string& path, size_t newCapacity) {
+            std::lock_guard< decltype(mutex) > lock(mutex);
+            if (data != nullptr) {
+                fprintf(stderr, "error: capture already open\n");
+                return false;
+            }
+            newCapacity = newCapacity & ~(recordAlignment - 1);
+            if (!Map(path, sizeof(FileHeader) + newCapacity)) {
+                return false;
+            }
+            capacity = newCapacity;
+            tail = 0;
+            start = std::chrono::steady_clock::now();
+            FileHeader header;
+            (void)memcpy(header.magic, magic, sizeof(header.magic));
+            header.version = version;
+            header.recordHeaderSize = (uint32_t)sizeof(RecordHeader);
+            header.startTime = (uint64_t)std::chrono::duration_cast< std::chrono::nanoseconds >(
+                std::chrono::system_clock::now().time_since_epoch()
+            ).count();
+            (void)memcpy(data, &header, sizeof(header));
+            open = true;
+            return true;
+        }
+    };
+
+    Capture::Reader::~Reader() noexcept {
+        if (file_ != nullptr) {
+            (void)fclose(file_);
+        }
+    }
+
+    const Capture::FileHeader& Capture::Reader::GetFileHeader() const {
+        return fileHeader_;
+    }
+
+    bool Capture::Reader::Next(Record& record) {
+        if (file_ == nullptr) {
+            return false;
+        }
+        RecordHeader header;
+        if (
+            (fread(&header, sizeof(header), 1, file_) != 1)
+            || (header.direction == 0)
+        ) {
+            return false;
+        }
+        record.timestamp = header.timestamp;
+        record.stream = header.stream;
+        record.direction = (Direction)header.direction;
+        record.transport = (Transport)header.transport;
+        record.address = header.address;
+        record.port = header.port;
+        record.message.resize(header.length);
+        const auto padding = AlignRecordSize(sizeof(header) + header.length) - sizeof(header) - header.length;
+        if (
+            (
+                (header.length > 0)
+                && (fread(&record.message[0], header.length, 1, file_) != 1)
+            )
+            || (
+                (padding > 0)
+                && (fseek(file_, (long)padding, SEEK_CUR) != 0)
+            )
+        ) {
+            fprintf(stderr, "error: capture file is truncated\n");
+            return false;
+        }
+        return true;
+    }
+
+    bool Capture::Reader::Open(const std::string& path) {
+        if (file_ != nullptr) {
+            (void)fclose(file_);
+        }
+        file_ = fopen(path.c_str(), "rb");
+        if (file_ == nullptr) {
+            fprintf(stderr, "error: unable to open capture file\n");
+            return false;
+        }
+        if (
+            (fread(&fileHeader_, sizeof(fileHeader_), 1, file_) != 1)
+            || (memcmp(fileHeader_.magic, magic, sizeof(magic)) != 0)
+            || (fileHeader_.version != version)
+            || (fileHeader_.recordHeaderSize != sizeof(RecordHeader))
+        ) {
+            fprintf(stderr, "error: not a capture file\n");
+            (void)fclose(file_);
+            file_ = nullptr;
+            return false;
+        }
+        return true;
+    }
+
+    Capture::Capture()
+        : impl_(new Impl())
+    {
+    }
+
+    void Capture::Append(
+        uint64_t stream,
+        Direction direction,
+        Transport transport,
+        const std::string& message,
+        uint32_t address,
+        uint16_t port
+    ) {
+        impl_->Append(stream, direction, transport, message, address, port);
+    }
+
+    void Capture::Close() {
+        impl_->Close();
+    }
+
+    CaptureStatistics Capture::GetStatistics() const {
+        CaptureStatistics statistics;
+        statistics.recordsCaptured = impl_->recordsCaptured.load(std::memory_order_relaxed);
+        statistics.bytesCaptured = impl_->bytesCaptured.load(std::memory_order_relaxed);
+        statistics.recordsDropped = impl_->recordsDropped.load(std::memory_order_relaxed);
+        return statistics;
+    }
+
+    uint64_t Capture::NewStream() {
+        return impl_->nextStream++;
+    }
+
+    bool Capture::Open(
+        const std::string& path,
+        size_t capacity
+    ) {
+        return impl_->Open(path, capacity);
+    }
+
+}
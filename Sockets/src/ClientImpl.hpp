@@ -0,0 +1,197 @@
+#pragma once
+
+#include "Connection.hpp"
+
+#include <Sockets/Detail/Abstractions.hpp>
+#include <Sockets/ServerSocket.hpp>
+
+namespace Sockets {
+
+    /**
+     * This is the implementation of the connections accepted by a
+     * ServerSocket.
+     */
+    struct ClientImpl
+        : public ServerSocket::Client
+    {
+        // Properties
+
+        Connection connection;
+
+        // This is the accepted socket, until ownership of it is handed off
+        // (to the connection when started, or to a relay).
+        SOCKET socket = INVALID_SOCKET;
+
+        // Lifecycle
+
+        ~ClientImpl() noexcept {
+            if (!IS_INVALID_SOCKET(socket)) {
+                (void)closesocket(socket);
+            }
+        }
+
+        ClientImpl(const ClientImpl&) = delete;
+        ClientImpl(ClientImpl&&) noexcept = delete;
+        ClientImpl& operator=(const ClientImpl&) = delete;
+        ClientImpl& operator=(ClientImpl&&) noexcept = delete;
+
+        // Constructor
+
+        explicit ClientImpl(const std::shared_ptr< SlabPool >& connectionPool)
+            : connection(connectionPool)
+        {
+        }
+
+        // Methods
+
+        /**
+         * Start handing back the accepted socket, so that it can be passed
+         * to another process (see BasicConnection::BeginRelease).  A client
+         * which hasn't been started can always be released.
+         */
+        bool BeginRelease() {
+            if (!IS_INVALID_SOCKET(socket)) {
+                return true;
+            }
+            return connection.BeginRelease();
+        }
+
+        /**
+         * Finish a release started by BeginRelease, and take the socket.
+         *
+         * Returns INVALID_SOCKET if the socket couldn't be released by the
+         * given time.
+         */
+        SOCKET EndRelease(std::chrono::steady_clock::time_point deadline) {
+            if (!IS_INVALID_SOCKET(socket)) {
+                const auto releasedSocket = socket;
+                socket = INVALID_SOCKET;
+                return releasedSocket;
+            }
+            return connection.EndRelease(deadline);
+        }
+
+        /**
+         * Returns true while the connection still has something queued
+         * which it may yet send.
+         */
+        bool IsSending() const {
+            return connection.IsSending();
+        }
+
+        // ClientConnection
+
+        virtual void Close() override {
+            connection.Close();
+        }
+
+        virtual void Flush() override {
+            connection.Flush();
+        }
+
+        virtual LatencyHistograms GetLatencyHistograms() const override {
+            return connection.GetLatencyHistograms();
+        }
+
+        virtual size_t GetSendQueueBytes() const override {
+            return connection.GetSendQueueBytes();
+        }
+
+        virtual ConnectionStatistics GetStatistics() const override {
+            return connection.GetStatistics();
+        }
+
+        virtual void SendMessage(
+            const std::string& message,
+            SendPriority priority
+        ) override {
+            connection.SendMessage(message, priority);
+        }
+
+        virtual void SendMessage(
+            const std::shared_ptr< const std::string >& message,
+            SendPriority priority
+        ) override {
+            connection.SendMessage(message, priority);
+        }
+
+        virtual bool SendFile(
+            int file,
+            uint64_t offset,
+            size_t length
+        ) override {
+            return connection.SendFile(file, offset, length);
+        }
+
+        virtual void SendMessages(
+            const std::vector< std::string >& messages,
+            SendPriority priority
+        ) override {
+            connection.SendMessages(messages, priority);
+        }
+
+        virtual void SetBatchedReceive(bool batchedReceive) override {
+            connection.SetBatchedReceive(batchedReceive);
+        }
+
+        virtual void SetCapture(const std::shared_ptr< Capture >& capture) override {
+            connection.SetCapture(capture);
+        }
+
+        virtual bool SetCompression(bool compression, size_t threshold) override {
+            return connection.SetCompression(compression, threshold);
+        }
+
+        virtual void SetHeartbeat(
+            std::chrono::milliseconds interval,
+            const std::string& message
+        ) override {
+            connection.SetHeartbeat(interval, message);
+        }
+
+        virtual void SetIdleTimeouts(
+            std::chrono::milliseconds readTimeout,
+            std::chrono::milliseconds writeTimeout,
+            std::chrono::milliseconds idleTimeout
+        ) override {
+            connection.SetIdleTimeouts(readTimeout, writeTimeout, idleTimeout);
+        }
+
+        virtual bool SetKeepAlive(
+            std::chrono::seconds idle,
+            std::chrono::seconds interval,
+            unsigned int count
+        ) override {
+            return connection.SetKeepAlive(idle, interval, count);
+        }
+
+        virtual void SetRateLimit(uint64_t bytesPerSecond, size_t burst) override {
+            connection.SetRateLimit(bytesPerSecond, burst);
+        }
+
+        virtual bool SetUserTimeout(std::chrono::milliseconds timeout) override {
+            return connection.SetUserTimeout(timeout);
+        }
+
+        virtual bool SetWritePolicy(
+            WritePolicy writePolicy,
+            std::chrono::microseconds coalesceWindow
+        ) override {
+            return connection.SetWritePolicy(writePolicy, coalesceWindow);
+        }
+
+        virtual bool SetZeroCopyThreshold(size_t threshold) override {
+            return connection.SetZeroCopyThreshold(threshold);
+        }
+
+        virtual bool Start(
+            ServerSocket::OnReceived onReceived,
+            ServerSocket::OnClosed onClosed
+        ) override {
+            const auto connectionSocket = socket;
+            socket = INVALID_SOCKET;
+            return connection.Start(connectionSocket, onReceived, onClosed);
+        }
+    };
+
+}
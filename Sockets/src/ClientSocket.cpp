@@ -1,7 +1,7 @@
-#include "Abstractions.hpp"
 #include "Connection.hpp"
 
 #include <Sockets/ClientSocket.hpp>
+#include <Sockets/Detail/Abstractions.hpp>
 #include <string.h>
 
 namespace Sockets {
@@ -18,6 +18,10 @@ namespace Sockets {
     }
 
     bool ClientSocket::Bind(uint16_t port) {
+        return Bind(0, port);
+    }
+
+    bool ClientSocket::Bind(uint32_t address, uint16_t port) {
         // Create the socket.
         impl_->socket = socket(AF_INET, SOCK_STREAM, 0);
         if (IS_INVALID_SOCKET(impl_->socket)) {
@@ -29,6 +33,7 @@ namespace Sockets {
         struct sockaddr_in socketAddress;
         (void)memset(&socketAddress, 0, sizeof(socketAddress));
         socketAddress.sin_family = AF_INET;
+        socketAddress.IPV4_ADDRESS_IN_SOCKADDR = htonl(address);
         socketAddress.sin_port = htons(port);
         if (bind(impl_->socket, (struct sockaddr*)&socketAddress, sizeof(socketAddress))) {
             fprintf(stderr, "error: unable to bind socket\n");
@@ -58,20 +63,153 @@ namespace Sockets {
             fprintf(stderr, "error: unable to connect\n");
             return false;
         }
-        impl_->connection.Start(
+        return impl_->connection.Start(
+            impl_->socket,
+            onReceived,
+            onClosed
+        );
+    }
+
+    bool ClientSocket::Connect(
+        const std::string& path,
+        OnReceived onReceived,
+        OnClosed onClosed
+    ) {
+        LocalAddress socketAddress;
+        if (!MakeLocalAddress(path, socketAddress)) {
+            fprintf(stderr, "error: invalid local socket path\n");
+            return false;
+        }
+
+        // Create the socket.  Bind only makes TCP sockets, and binding
+        // doesn't matter for local connections, so any socket it made is
+        // replaced.
+        if (!IS_INVALID_SOCKET(impl_->socket)) {
+            (void)closesocket(impl_->socket);
+        }
+        impl_->socket = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (IS_INVALID_SOCKET(impl_->socket)) {
+            fprintf(stderr, "error: unable to create socket\n");
+            return false;
+        }
+        if (
+            connect(
+                impl_->socket,
+                (const sockaddr*)&socketAddress.storage,
+                socketAddress.length
+            )
+        ) {
+            fprintf(stderr, "error: unable to connect\n");
+            return false;
+        }
+        return impl_->connection.Start(
             impl_->socket,
             onReceived,
             onClosed
         );
-        return true;
     }
 
     void ClientSocket::Close() {
         impl_->connection.Close();
     }
 
-    void ClientSocket::SendMessage(const std::string& message) {
-        impl_->connection.SendMessage(message);
+    void ClientSocket::Flush() {
+        impl_->connection.Flush();
+    }
+
+    LatencyHistograms ClientSocket::GetLatencyHistograms() const {
+        return impl_->connection.GetLatencyHistograms();
+    }
+
+    size_t ClientSocket::GetSendQueueBytes() const {
+        return impl_->connection.GetSendQueueBytes();
+    }
+
+    ConnectionStatistics ClientSocket::GetStatistics() const {
+        return impl_->connection.GetStatistics();
+    }
+
+    void ClientSocket::SendMessage(
+        const std::string& message,
+        SendPriority priority
+    ) {
+        impl_->connection.SendMessage(message, priority);
+    }
+
+    void ClientSocket::SendMessage(
+        const std::shared_ptr< const std::string >& message,
+        SendPriority priority
+    ) {
+        impl_->connection.SendMessage(message, priority);
+    }
+
+    bool ClientSocket::SendFile(
+        int file,
+        uint64_t offset,
+        size_t length
+    ) {
+        return impl_->connection.SendFile(file, offset, length);
+    }
+
+    void ClientSocket::SendMessages(
+        const std::vector< std::string >& messages,
+        SendPriority priority
+    ) {
+        impl_->connection.SendMessages(messages, priority);
+    }
+
+    void ClientSocket::SetBatchedReceive(bool batchedReceive) {
+        impl_->connection.SetBatchedReceive(batchedReceive);
+    }
+
+    void ClientSocket::SetCapture(const std::shared_ptr< Capture >& capture) {
+        impl_->connection.SetCapture(capture);
+    }
+
+    bool ClientSocket::SetCompression(bool compression, size_t threshold) {
+        return impl_->connection.SetCompression(compression, threshold);
+    }
+
+    void ClientSocket::SetHeartbeat(
+        std::chrono::milliseconds interval,
+        const std::string& message
+    ) {
+        impl_->connection.SetHeartbeat(interval, message);
+    }
+
+    void ClientSocket::SetIdleTimeouts(
+        std::chrono::milliseconds readTimeout,
+        std::chrono::milliseconds writeTimeout,
+        std::chrono::milliseconds idleTimeout
+    ) {
+        impl_->connection.SetIdleTimeouts(readTimeout, writeTimeout, idleTimeout);
+    }
+
+    bool ClientSocket::SetKeepAlive(
+        std::chrono::seconds idle,
+        std::chrono::seconds interval,
+        unsigned int count
+    ) {
+        return impl_->connection.SetKeepAlive(idle, interval, count);
+    }
+
+    void ClientSocket::SetRateLimit(uint64_t bytesPerSecond, size_t burst) {
+        impl_->connection.SetRateLimit(bytesPerSecond, burst);
+    }
+
+    bool ClientSocket::SetUserTimeout(std::chrono::milliseconds timeout) {
+        return impl_->connection.SetUserTimeout(timeout);
+    }
+
+    bool ClientSocket::SetWritePolicy(
+        WritePolicy writePolicy,
+        std::chrono::microseconds coalesceWindow
+    ) {
+        return impl_->connection.SetWritePolicy(writePolicy, coalesceWindow);
+    }
+
+    bool ClientSocket::SetZeroCopyThreshold(size_t threshold) {
+        return impl_->connection.SetZeroCopyThreshold(threshold);
     }
 
 }
@@ -0,0 +1,56 @@
+#include <deque>
+#include <functional>
+#include <list>
+#include <Sockets/BasicConnectionImpl.hpp>
+#include <stddef.h>
+#include <string>
+
+namespace Sockets {
+
+    /**
+     * These are the policies of a connection which is used from more than
+     * one thread, but only ever holds its lock briefly, and doesn't need
+     * compression.
+     */
+    struct SpinConnectionPolicies {
+        // Types
+        using Mutex = SpinMutex;
+        template< class T > using Queue = std::deque< T >;
+        using OnReceived = std::function< void(const std::string&) >;
+        using OnClosed = std::function< void() >;
+
+        // Constants
+        static constexpr size_t receiveBufferSize = 16384;
+        static constexpr bool framing = false;
+    };
+
+    /**
+     * These are the policies of a connection which is only ever used from
+     * its own callbacks, which are plain functions.
+     */
+    struct SingleThreadConnectionPolicies {
+        // Types
+        using Mutex = NullMutex;
+        template< class T > using Queue = std::list< T >;
+        using OnReceived = void (*)(const std::string&);
+        using OnClosed = void (*)();
+
+        // Constants
+        static constexpr size_t receiveBufferSize = 4096;
+        static constexpr bool framing = true;
+    };
+
+    constexpr size_t SpinConnectionPolicies::receiveBufferSize;
+    constexpr bool SpinConnectionPolicies::framing;
+    constexpr size_t SingleThreadConnectionPolicies::receiveBufferSize;
+    constexpr bool SingleThreadConnectionPolicies::framing;
+
+    // The library itself only uses the default policies (see
+    // Connection.cpp), so these are instantiated here, outside of the
+    // library, to keep the template building with the other kinds of lock,
+    // queue and callback, and with framing compiled out, just as a program
+    // choosing its own policies would.
+    template class BasicConnection< SpinConnectionPolicies >;
+    template class BasicConnection< SingleThreadConnectionPolicies >;
+
+}
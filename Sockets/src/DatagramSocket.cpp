@@ -1,12 +1,18 @@
-#include "Abstractions.hpp"
-
+#include <chrono>
 #include <list>
 #include <mutex>
+#include <Sockets/Capture.hpp>
 #include <Sockets/DatagramSocket.hpp>
+#include <Sockets/Detail/Abstractions.hpp>
+#include <Sockets/Detail/Counter.hpp>
+#include <Sockets/Detail/LatencyRecorder.hpp>
+#include <Sockets/Detail/TokenBucket.hpp>
+#include <Sockets/Detail/TraceBuffer.hpp>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <string>
 #include <thread>
 #include <vector>
 
@@ -14,6 +20,8 @@ namespace {
 
     constexpr size_t maximumReadSize = 65536;
 
+    using Clock = std::chrono::steady_clock;
+
 }
 
 namespace Sockets {
@@ -24,7 +32,13 @@ namespace Sockets {
             std::string message;
             uint32_t address;
             uint16_t port;
+
+            // This is set instead of the address and port when sending to
+            // a local (Unix domain) socket.
+            std::string path;
+
             OnSent onSent;
+            Clock::time_point enqueued;
         };
 
         // Properties
@@ -36,12 +50,45 @@ namespace Sockets {
         SocketEventLoop socketEventLoop;
         UsesSockets usesSockets;
 
+        // This is the path of the local socket, if bound to one.
+        std::string localPath;
+
+        // Rate limit settings and state.  The operating system is also
+        // asked to pace the socket at the same rate, where it can.
+        uint64_t rateLimit = 0;
+        TokenBucket pacing;
+
+        // If set, datagrams sent and received are recorded here, under the
+        // given stream number.
+        std::shared_ptr< Capture > capture;
+        uint64_t captureStream = 0;
+
+        // Statistics
+        Counter bytesReceived;
+        Counter bytesSent;
+        Counter datagramsReceived;
+        Counter datagramsSent;
+        Counter datagramsDropped;
+        Counter receiveCalls;
+        Counter sendCalls;
+        Counter receiveWouldBlock;
+        Counter sendWouldBlock;
+        Counter sendQueueDepth;
+        Counter sendQueueBytes;
+        Counter throttleStalls;
+        Counter throttledNanoseconds;
+        LatencyRecorder sendQueueResidency;
+        LatencyRecorder receiveHandlerTime;
+
         // Lifecycle
 
         ~Impl() noexcept {
             if (!IS_INVALID_SOCKET(socket)) {
                 (void)closesocket(socket);
             }
+            if (!localPath.empty()) {
+                RemoveLocalAddress(localPath);
+            }
         }
 
         Impl(const Impl&) = delete;
@@ -54,13 +101,43 @@ namespace Sockets {
 
         // Methods
 
+        // Record a datagram being sent, if the socket is captured.
+        void CaptureOutbound(
+            const std::string& message,
+            uint32_t address,
+            uint16_t port
+        ) {
+            if (capture) {
+                capture->Append(
+                    captureStream,
+                    Capture::Direction::Outbound,
+                    Capture::Transport::Datagram,
+                    message,
+                    address,
+                    port
+                );
+            }
+        }
+
+        // Determine whether sends are being held back by the rate limit.
+        bool IsPacing(Clock::time_point now) const {
+            return (
+                pacing.IsLimited()
+                && !datagramsToSend.empty()
+                && (pacing.GetAllowance(now) == 0)
+            );
+        }
+
         bool IsReadyToSend() {
             std::lock_guard< decltype(mutex) > lock(mutex);
-            return !datagramsToSend.empty();
+            return (
+                !datagramsToSend.empty()
+                && !IsPacing(Clock::now())
+            );
         }
 
         bool OnSocketReady(
-            OnReceived onReceived
+            const OnReceived& onReceived
         ) {
             std::unique_lock< decltype(mutex) > lock(mutex);
             if (error) {
@@ -75,33 +152,62 @@ namespace Sockets {
         }
 
         bool TryReceivingDatagram(
-            OnReceived onReceived,
+            const OnReceived& onReceived,
             std::unique_lock< decltype(mutex) >& lock
         ) {
+            receiveCalls.Add();
+
+            // The sender's address is only needed for the capture.
+            LocalAddress peerAddress;
+            peerAddress.length = (SOCKADDR_LENGTH_TYPE)sizeof(peerAddress.storage);
             const auto amountReceived = recvfrom(
                 socket,
                 (char*)receiveBuffer,
                 (SOCKET_DATAGRAM_LENGTH_TYPE)maximumReadSize,
                 MSG_NOSIGNAL,
-                NULL,
-                NULL
+                capture ? (struct sockaddr*)&peerAddress.storage : NULL,
+                capture ? &peerAddress.length : NULL
             );
             if (IS_SOCKET_ERROR(amountReceived)) {
-                if (
-                    !LAST_SOCKET_OPERATION_WOULD_BLOCK
-                    && !LAST_SOCKET_OPERATION_WAS_RESET
-                ) {
+                if (LAST_SOCKET_OPERATION_WOULD_BLOCK) {
+                    receiveWouldBlock.Add();
+                    TraceEvent(Trace::EventType::WouldBlock, (int64_t)socket);
+                } else if (!LAST_SOCKET_OPERATION_WAS_RESET) {
                     error = true;
+                    TraceEvent(Trace::EventType::Error, (int64_t)socket);
                     fprintf(stderr, "error: unable to read socket\n");
                 }
             } else if (amountReceived > 0) {
+                bytesReceived.Add((uint64_t)amountReceived);
+                datagramsReceived.Add();
+                TraceEvent(Trace::EventType::Receive, (int64_t)socket, (uint64_t)amountReceived);
                 const std::string message(
                     receiveBuffer,
                     receiveBuffer + amountReceived
                 );
+                if (capture) {
+                    uint32_t address = 0;
+                    uint16_t port = 0;
+                    if (peerAddress.storage.ss_family == AF_INET) {
+                        const auto internetAddress = (const struct sockaddr_in*)&peerAddress.storage;
+                        address = ntohl(internetAddress->IPV4_ADDRESS_IN_SOCKADDR);
+                        port = ntohs(internetAddress->sin_port);
+                    }
+                    capture->Append(
+                        captureStream,
+                        Capture::Direction::Inbound,
+                        Capture::Transport::Datagram,
+                        message,
+                        address,
+                        port
+                    );
+                }
                 lock.unlock();
+                const auto handlerStart = Clock::now();
                 onReceived(message);
+                const auto handlerEnd = Clock::now();
                 lock.lock();
+                receiveHandlerTime.Record(handlerEnd - handlerStart);
                 return true;
             }
             return false;
@@ -113,36 +219,87 @@ namespace Sockets {
             if (datagramsToSend.empty()) {
                 return false;
             }
+
+            // Datagrams can't be split, so one is sent whenever the rate
+            // limit allows anything at all, and any excess is paid back by
+            // holding back the ones after it for longer.
+            const auto now = Clock::now();
+            if (IsPacing(now)) {
+                if (pacing.Stall(now)) {
+                    throttleStalls.Add();
+                }
+                socketEventLoop.SetTimeout(
+                    std::chrono::duration_cast< std::chrono::microseconds >(
+                        pacing.GetNextAllowance(now) - now
+                    ) + std::chrono::microseconds(1)
+                );
+                return false;
+            }
+            if (pacing.IsLimited()) {
+                throttledNanoseconds.Add(
+                    (uint64_t)std::chrono::duration_cast< std::chrono::nanoseconds >(
+                        pacing.Resume(now)
+                    ).count()
+                );
+                socketEventLoop.SetTimeout(std::chrono::microseconds(0));
+            }
             const auto& datagram = datagramsToSend.front();
-            struct sockaddr_in peerAddress;
-            (void)memset(&peerAddress, 0, sizeof(peerAddress));
-            peerAddress.sin_family = AF_INET;
-            peerAddress.IPV4_ADDRESS_IN_SOCKADDR = htonl(datagram.address);
-            peerAddress.sin_port = htons(datagram.port);
+            LocalAddress peerAddress;
+            if (datagram.path.empty()) {
+                struct sockaddr_in internetAddress;
+                (void)memset(&internetAddress, 0, sizeof(internetAddress));
+                internetAddress.sin_family = AF_INET;
+                internetAddress.IPV4_ADDRESS_IN_SOCKADDR = htonl(datagram.address);
+                internetAddress.sin_port = htons(datagram.port);
+                (void)memcpy(&peerAddress.storage, &internetAddress, sizeof(internetAddress));
+                peerAddress.length = (SOCKADDR_LENGTH_TYPE)sizeof(internetAddress);
+            } else {
+                // The path was checked when the datagram was queued.
+                (void)MakeLocalAddress(datagram.path, peerAddress);
+            }
+            sendCalls.Add();
             const auto amountSent = sendto(
                 socket,
                 datagram.message.c_str(),
                 (SOCKET_DATAGRAM_LENGTH_TYPE)datagram.message.length(),
                 0,
-                (const sockaddr*)&peerAddress,
-                sizeof(peerAddress)
+                (const sockaddr*)&peerAddress.storage,
+                peerAddress.length
             );
             if (IS_SOCKET_ERROR(amountSent)) {
-                if (!LAST_SOCKET_OPERATION_WOULD_BLOCK) {
+                if (LAST_SOCKET_OPERATION_WOULD_BLOCK) {
+                    sendWouldBlock.Add();
+                    TraceEvent(Trace::EventType::WouldBlock, (int64_t)socket);
+                    return true;
+                } else if (LAST_SOCKET_OPERATION_BROKE_SOCKET) {
                     error = true;
+                    TraceEvent(Trace::EventType::Error, (int64_t)socket);
                     fprintf(stderr, "error: unable to write socket\n");
+                    return true;
                 }
-                return true;
+
+                // Anything else (such as nobody being bound to a local
+                // path, or the datagram being too big) is a problem with
+                // this datagram only, so drop it and carry on.
+                datagramsDropped.Add();
+                fprintf(stderr, "error: unable to send datagram\n");
             } else {
-                auto onSent = std::move(datagram.onSent);
-                datagramsToSend.pop_front();
-                if (onSent) {
-                    lock.unlock();
-                    onSent();
-                    lock.lock();
-                }
-                return !datagramsToSend.empty();
+                bytesSent.Add((uint64_t)amountSent);
+                datagramsSent.Add();
+                pacing.Consume((size_t)amountSent, now);
+                TraceEvent(Trace::EventType::Send, (int64_t)socket, (uint64_t)amountSent);
+            }
+            sendQueueDepth.Subtract();
+            sendQueueBytes.Subtract(datagram.message.length());
+            sendQueueResidency.Record(Clock::now() - datagram.enqueued);
+            auto onSent = std::move(datagram.onSent);
+            datagramsToSend.pop_front();
+            if (onSent) {
+                lock.unlock();
+                onSent();
+                lock.lock();
             }
+            return !datagramsToSend.empty();
         }
     };
 
@@ -171,6 +328,58 @@ namespace Sockets {
         return true;
     }
 
+    bool DatagramSocket::Bind(const std::string& path) {
+        LocalAddress socketAddress;
+        if (!MakeLocalAddress(path, socketAddress)) {
+            fprintf(stderr, "error: invalid local socket path\n");
+            return false;
+        }
+
+        // Create the socket.
+        impl_->socket = socket(AF_UNIX, SOCK_DGRAM, 0);
+        if (IS_INVALID_SOCKET(impl_->socket)) {
+            fprintf(stderr, "error: unable to create socket\n");
+            return false;
+        }
+
+        // Bind the socket, replacing any socket left behind by an earlier
+        // program which didn't clean up.
+        RemoveLocalAddress(path);
+        if (bind(impl_->socket, (struct sockaddr*)&socketAddress.storage, socketAddress.length)) {
+            fprintf(stderr, "error: unable to bind socket\n");
+            return false;
+        }
+        impl_->localPath = path;
+        return true;
+    }
+
+    LatencyHistograms DatagramSocket::GetLatencyHistograms() const {
+        LatencyHistograms histograms;
+        histograms.sendQueueResidency = impl_->sendQueueResidency.GetHistogram();
+        histograms.wakeupDelay = impl_->socketEventLoop.GetWakeupDelay();
+        histograms.receiveHandlerTime = impl_->receiveHandlerTime.GetHistogram();
+        return histograms;
+    }
+
+    DatagramStatistics DatagramSocket::GetStatistics() const {
+        DatagramStatistics statistics;
+        statistics.bytesReceived = impl_->bytesReceived.Get();
+        statistics.bytesSent = impl_->bytesSent.Get();
+        statistics.datagramsReceived = impl_->datagramsReceived.Get();
+        statistics.datagramsSent = impl_->datagramsSent.Get();
+        statistics.datagramsDropped = impl_->datagramsDropped.Get();
+        statistics.receiveCalls = impl_->receiveCalls.Get();
+        statistics.sendCalls = impl_->sendCalls.Get();
+        statistics.receiveWouldBlock = impl_->receiveWouldBlock.Get();
+        statistics.sendWouldBlock = impl_->sendWouldBlock.Get();
+        statistics.sendQueueDepth = impl_->sendQueueDepth.Get();
+        statistics.sendQueueBytes = impl_->sendQueueBytes.Get();
+        statistics.throttleStalls = impl_->throttleStalls.Get();
+        statistics.throttledNanoseconds = impl_->throttledNanoseconds.Get();
+        statistics.eventLoop = impl_->socketEventLoop.GetStatistics();
+        return statistics;
+    }
+
     void DatagramSocket::SendMessage(
         const std::string& message,
         uint32_t address,
@@ -178,25 +387,123 @@ namespace Sockets {
         OnSent onSent
     ) {
         std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
-        impl_->datagramsToSend.push_back({message, address, port, onSent});
+        impl_->CaptureOutbound(message, address, port);
+        impl_->sendQueueDepth.Add();
+        impl_->sendQueueBytes.Add(message.length());
+        impl_->datagramsToSend.push_back({message, address, port, std::string(), onSent, Clock::now()});
+        impl_->socketEventLoop.UserEvent();
+    }
+
+    void DatagramSocket::SendMessages(
+        const std::vector< std::string >& messages,
+        uint32_t address,
+        uint16_t port,
+        OnSent onSent
+    ) {
+        if (messages.empty()) {
+            return;
+        }
+        std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+        const auto now = Clock::now();
+        for (size_t i = 0; i < messages.size(); ++i) {
+            const auto& message = messages[i];
+            impl_->CaptureOutbound(message, address, port);
+            impl_->sendQueueDepth.Add();
+            impl_->sendQueueBytes.Add(message.length());
+            impl_->datagramsToSend.push_back({
+                message,
+                address,
+                port,
+                std::string(),
+                (i + 1 == messages.size()) ? onSent : nullptr,
+                now
+            });
+        }
+        impl_->socketEventLoop.UserEvent();
+    }
+
+    void DatagramSocket::SendMessage(
+        const std::string& message,
+        const std::string& path,
+        OnSent onSent
+    ) {
+        LocalAddress peerAddress;
+        if (!MakeLocalAddress(path, peerAddress)) {
+            fprintf(stderr, "error: invalid local socket path\n");
+            return;
+        }
+        std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+        impl_->CaptureOutbound(message, 0, 0);
+        impl_->sendQueueDepth.Add();
+        impl_->sendQueueBytes.Add(message.length());
+        impl_->datagramsToSend.push_back({message, 0, 0, path, onSent, Clock::now()});
+        impl_->socketEventLoop.UserEvent();
+    }
+
+    void DatagramSocket::SendMessages(
+        const std::vector< std::string >& messages,
+        const std::string& path,
+        OnSent onSent
+    ) {
+        if (messages.empty()) {
+            return;
+        }
+        LocalAddress peerAddress;
+        if (!MakeLocalAddress(path, peerAddress)) {
+            fprintf(stderr, "error: invalid local socket path\n");
+            return;
+        }
+        std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+        const auto now = Clock::now();
+        for (size_t i = 0; i < messages.size(); ++i) {
+            const auto& message = messages[i];
+            impl_->CaptureOutbound(message, 0, 0);
+            impl_->sendQueueDepth.Add();
+            impl_->sendQueueBytes.Add(message.length());
+            impl_->datagramsToSend.push_back({
+                message,
+                0,
+                0,
+                path,
+                (i + 1 == messages.size()) ? onSent : nullptr,
+                now
+            });
+        }
+        impl_->socketEventLoop.UserEvent();
+    }
+
+    void DatagramSocket::SetCapture(const std::shared_ptr< Capture >& capture) {
+        std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+        impl_->capture = capture;
+        impl_->captureStream = capture ? capture->NewStream() : 0;
+    }
+
+    void DatagramSocket::SetRateLimit(uint64_t bytesPerSecond, size_t burst) {
+        std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+        impl_->rateLimit = bytesPerSecond;
+        impl_->pacing.Configure(bytesPerSecond, burst, Clock::now());
         impl_->socketEventLoop.UserEvent();
+        if (!IS_INVALID_SOCKET(impl_->socket)) {
+            (void)SetPacingRate(impl_->socket, bytesPerSecond);
+        }
     }
 
     void DatagramSocket::Start(OnReceived onReceived) {
+        {
+            std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+            if (impl_->rateLimit > 0) {
+                (void)SetPacingRate(impl_->socket, impl_->rateLimit);
+            }
+        }
         std::weak_ptr< Impl > implWeak(impl_);
-        impl_->socketEventLoop.Start(
+        (void)impl_->socketEventLoop.Start(
             impl_->socket,
 
             // isReadyToSend
-            [
-                implWeak
-            ]{
-                const auto impl = implWeak.lock();
-                if (!impl) {
-                    return false;
-                }
-                return impl->IsReadyToSend();
-            },
+            SocketEventLoop::IsReadyToSend::BindWeak< Impl, &Impl::IsReadyToSend >(
+                implWeak,
+                false
+            ),
 
             // onSocketReady
             [
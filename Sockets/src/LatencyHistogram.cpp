@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <Sockets/LatencyHistogram.hpp>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif /* _MSC_VER */
+
+namespace {
+
+    unsigned int HighestBitSet(uint64_t value) {
+#ifdef _MSC_VER
+        unsigned long index;
+        (void)_BitScanReverse64(&index, value);
+        return (unsigned int)index;
+#else
+        return 63 - (unsigned int)__builtin_clzll(value);
+#endif
+    }
+
+}
+
+namespace Sockets {
+
+    constexpr unsigned int LatencyHistogram::subBucketBits;
+    constexpr unsigned int LatencyHistogram::largestExponent;
+    constexpr size_t LatencyHistogram::numberOfBuckets;
+
+    LatencyHistogram::LatencyHistogram()
+        : buckets_(numberOfBuckets)
+    {
+    }
+
+    size_t LatencyHistogram::GetBucketIndex(uint64_t value) {
+        constexpr uint64_t linearLimit = (2 << subBucketBits);
+        if (value < linearLimit) {
+            return (size_t)value;
+        }
+        const auto exponent = HighestBitSet(value);
+        if (exponent > largestExponent) {
+            return numberOfBuckets - 1;
+        }
+        const auto shift = exponent - subBucketBits;
+        const auto mantissa = (size_t)((value >> shift) & ((1 << subBucketBits) - 1));
+        return (
+            linearLimit
+            + (exponent - subBucketBits - 1) * (1 << subBucketBits)
+            + mantissa
+        );
+    }
+
+    uint64_t LatencyHistogram::GetBucketLowerBound(size_t index) {
+        constexpr uint64_t linearLimit = (2 << subBucketBits);
+        if (index < linearLimit) {
+            return (uint64_t)index;
+        }
+        const auto offset = index - linearLimit;
+        const auto shift = (unsigned int)(offset >> subBucketBits) + 1;
+        const auto mantissa = (uint64_t)(offset & ((1 << subBucketBits) - 1));
+        return (((uint64_t)1 << subBucketBits) + mantissa) << shift;
+    }
+
+    uint64_t LatencyHistogram::GetBucketUpperBound(size_t index) {
+        if (index + 1 >= numberOfBuckets) {
+            return UINT64_MAX;
+        }
+        return GetBucketLowerBound(index + 1) - 1;
+    }
+
+    uint64_t LatencyHistogram::GetBucketCount(size_t index) const {
+        return buckets_[index];
+    }
+
+    uint64_t LatencyHistogram::GetCount() const {
+        return count_;
+    }
+
+    uint64_t LatencyHistogram::GetMinimum() const {
+        for (size_t i = 0; i < numberOfBuckets; ++i) {
+            if (buckets_[i] != 0) {
+                return GetBucketLowerBound(i);
+            }
+        }
+        return 0;
+    }
+
+    uint64_t LatencyHistogram::GetMaximum() const {
+        for (size_t i = numberOfBuckets; i > 0; --i) {
+            if (buckets_[i - 1] != 0) {
+                return GetBucketUpperBound(i - 1);
+            }
+        }
+        return 0;
+    }
+
+    double LatencyHistogram::GetMean() const {
+        if (count_ == 0) {
+            return 0.0;
+        }
+        double total = 0.0;
+        for (size_t i = 0; i < numberOfBuckets; ++i) {
+            if (buckets_[i] != 0) {
+                const auto lower = (double)GetBucketLowerBound(i);
+                const auto upper = (double)GetBucketLowerBound(
+                    std::min(i + 1, numberOfBuckets - 1)
+                );
+                total += (double)buckets_[i] * (lower + upper) / 2.0;
+            }
+        }
+        return total / (double)count_;
+    }
+
+    uint64_t LatencyHistogram::GetPercentile(double percentile) const {
+        if (count_ == 0) {
+            return 0;
+        }
+        percentile = std::min(std::max(percentile, 0.0), 100.0);
+        auto target = (uint64_t)((percentile / 100.0) * (double)count_ + 0.5);
+        target = std::max(target, (uint64_t)1);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < numberOfBuckets; ++i) {
+            seen += buckets_[i];
+            if (seen >= target) {
+                return GetBucketUpperBound(i);
+            }
+        }
+        return GetMaximum();
+    }
+
+    void LatencyHistogram::Merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < numberOfBuckets; ++i) {
+            buckets_[i] += other.buckets_[i];
+        }
+        count_ += other.count_;
+    }
+
+    void LatencyHistogram::Record(uint64_t value, uint64_t count) {
+        buckets_[GetBucketIndex(value)] += count;
+        count_ += count;
+    }
+
+    void LatencyHistogram::Reset() {
+        std::fill(buckets_.begin(), buckets_.end(), 0);
+        count_ = 0;
+    }
+
+    void LatencyHistograms::Merge(const LatencyHistograms& other) {
+        sendQueueResidency.Merge(other.sendQueueResidency);
+        wakeupDelay.Merge(other.wakeupDelay);
+        receiveHandlerTime.Merge(other.receiveHandlerTime);
+    }
+
+}
@@ -0,0 +1,252 @@
+#include <Sockets/Detail/Lz.hpp>
+#include <string.h>
+
+namespace {
+
+    // This is the shortest match worth encoding.
+    constexpr size_t minimumMatch = 4;
+
+    // The last few bytes of the input are always sent as literals, and no
+    // match starts too close to the end, so that the match finder can
+    // always read whole words.
+    constexpr size_t lastLiterals = 5;
+    constexpr size_t matchSearchMargin = 12;
+
+    // This is the farthest back a match can refer.
+    constexpr size_t maximumOffset = 65535;
+
+    // Lengths too big for their half of a sequence's token byte are
+    // continued in extra bytes after it.
+    constexpr size_t tokenLengthLimit = 15;
+
+    uint32_t Read32(const uint8_t* data) {
+        uint32_t value;
+        (void)memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    uint32_t Hash(uint32_t value) {
+        return (
+            (value * 2654435761U)
+            >> (32 - Sockets::LzCompressor::hashBits)
+        );
+    }
+
+    // This is the most space taken by the extra bytes of a length.
+    size_t GetLengthSize(size_t length) {
+        return (length >= tokenLengthLimit) ? ((length - tokenLengthLimit) / 255 + 1) : 0;
+    }
+
+    void WriteLength(size_t length, uint8_t*& output) {
+        if (length < tokenLengthLimit) {
+            return;
+        }
+        length -= tokenLengthLimit;
+        while (length >= 255) {
+            *output++ = 255;
+            length -= 255;
+        }
+        *output++ = (uint8_t)length;
+    }
+
+    bool ReadLength(const uint8_t*& input, const uint8_t* end, size_t& length) {
+        for (;;) {
+            if (input >= end) {
+                return false;
+            }
+            const auto extra = *input++;
+            length += extra;
+            if (extra != 255) {
+                return true;
+            }
+        }
+    }
+
+    // Write one sequence: literals, followed by a match unless this is
+    // the last sequence (in which case the match length is zero).
+    //
+    // Returns false if there isn't room for it.
+    bool WriteSequence(
+        const uint8_t* literals,
+        size_t literalLength,
+        size_t offset,
+        size_t matchLength,
+        uint8_t*& output,
+        const uint8_t* end
+    ) {
+        const auto matchCode = (matchLength == 0) ? 0 : (matchLength - minimumMatch);
+        const size_t needed = (
+            1
+            + GetLengthSize(literalLength)
+            + literalLength
+            + ((matchLength == 0) ? 0 : (2 + GetLengthSize(matchCode)))
+        );
+        if ((size_t)(end - output) < needed) {
+            return false;
+        }
+        *output++ = (uint8_t)(
+            ((literalLength < tokenLengthLimit ? literalLength : tokenLengthLimit) << 4)
+            | (matchCode < tokenLengthLimit ? matchCode : tokenLengthLimit)
+        );
+        WriteLength(literalLength, output);
+        if (literalLength > 0) {
+            (void)memcpy(output, literals, literalLength);
+            output += literalLength;
+        }
+        if (matchLength > 0) {
+            *output++ = (uint8_t)(offset & 0xff);
+            *output++ = (uint8_t)(offset >> 8);
+            WriteLength(matchCode, output);
+        }
+        return true;
+    }
+
+}
+
+namespace Sockets {
+
+    constexpr unsigned int LzCompressor::hashBits;
+
+    LzCompressor::LzCompressor() {
+        (void)memset(table_, 0, sizeof(table_));
+    }
+
+    size_t LzCompressor::Compress(
+        const uint8_t* input,
+        size_t length,
+        uint8_t* output,
+        size_t capacity
+    ) {
+        auto out = output;
+        const auto outEnd = output + capacity;
+        size_t anchor = 0;
+        if (length > matchSearchMargin) {
+            const auto searchLimit = length - matchSearchMargin;
+            const auto matchLimit = length - lastLiterals;
+            size_t i = 0;
+            while (i < searchLimit) {
+                const auto value = Read32(input + i);
+                const auto hash = Hash(value);
+                const size_t candidate = table_[hash];
+                table_[hash] = (uint32_t)i;
+                if (
+                    (candidate < i)
+                    && (i - candidate <= maximumOffset)
+                    && (Read32(input + candidate) == value)
+                ) {
+                    auto matchLength = minimumMatch;
+                    while (
+                        (i + matchLength < matchLimit)
+                        && (input[candidate + matchLength] == input[i + matchLength])
+                    ) {
+                        ++matchLength;
+                    }
+                    if (
+                        !WriteSequence(
+                            input + anchor,
+                            i - anchor,
+                            i - candidate,
+                            matchLength,
+                            out,
+                            outEnd
+                        )
+                    ) {
+                        return 0;
+                    }
+                    i += matchLength;
+                    anchor = i;
+                } else {
+                    // Skip ahead faster the longer it's been since the
+                    // last match, so incompressible data goes quickly.
+                    i += 1 + ((i - anchor) >> 6);
+                }
+            }
+        }
+        if (
+            !WriteSequence(
+                input + anchor,
+                length - anchor,
+                0,
+                0,
+                out,
+                outEnd
+            )
+        ) {
+            return 0;
+        }
+        return (size_t)(out - output);
+    }
+
+    bool LzDecompress(
+        const uint8_t* input,
+        size_t length,
+        uint8_t* output,
+        size_t outputLength
+    ) {
+        auto in = input;
+        const auto inEnd = input + length;
+        auto out = output;
+        const auto outEnd = output + outputLength;
+        for (;;) {
+            if (in >= inEnd) {
+                return false;
+            }
+            const auto token = *in++;
+            size_t literalLength = (token >> 4);
+            if (
+                (literalLength == tokenLengthLimit)
+                && !ReadLength(in, inEnd, literalLength)
+            ) {
+                return false;
+            }
+            if (
+                (literalLength > (size_t)(inEnd - in))
+                || (literalLength > (size_t)(outEnd - out))
+            ) {
+                return false;
+            }
+            if (literalLength > 0) {
+                (void)memcpy(out, in, literalLength);
+                in += literalLength;
+                out += literalLength;
+            }
+            if (in == inEnd) {
+                return (out == outEnd);
+            }
+            if (inEnd - in < 2) {
+                return false;
+            }
+            const size_t offset = (size_t)in[0] | ((size_t)in[1] << 8);
+            in += 2;
+            if (
+                (offset == 0)
+                || (offset > (size_t)(out - output))
+            ) {
+                return false;
+            }
+            size_t matchLength = (token & 0x0f);
+            if (
+                (matchLength == tokenLengthLimit)
+                && !ReadLength(in, inEnd, matchLength)
+            ) {
+                return false;
+            }
+            matchLength += minimumMatch;
+            if (matchLength > (size_t)(outEnd - out)) {
+                return false;
+            }
+            const auto match = out - offset;
+            if (offset >= matchLength) {
+                (void)memcpy(out, match, matchLength);
+            } else {
+                // The match overlaps what it's producing (a repeating
+                // pattern), so it has to be copied one byte at a time.
+                for (size_t i = 0; i < matchLength; ++i) {
+                    out[i] = match[i];
+                }
+            }
+            out += matchLength;
+        }
+    }
+
+}
@@ -2,9 +2,9 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <stdint.h>
 #include <string.h>
-#include <sys/select.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -76,11 +76,10 @@ namespace Sockets {
     }
 
     bool PipeSignal::IsSet() const {
-        fd_set readfds;
-        struct timeval timeout = {0};
-        FD_ZERO(&readfds);
-        FD_SET(impl_->pipe[0], &readfds);
-        return (select(impl_->pipe[0] + 1, &readfds, NULL, NULL, &timeout) != 0);
+        struct pollfd pollfd;
+        pollfd.fd = impl_->pipe[0];
+        pollfd.events = POLLIN;
+        return (poll(&pollfd, 1, 0) > 0);
     }
 
     int PipeSignal::GetSelectHandle() const {
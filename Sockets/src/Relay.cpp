@@ -0,0 +1,460 @@
+#include "ClientImpl.hpp"
+#include "PipeSignal.hpp"
+
+#include <atomic>
+#include <fcntl.h>
+#include <poll.h>
+#include <Sockets/Detail/Abstractions.hpp>
+#include <Sockets/Detail/Counter.hpp>
+#include <Sockets/Detail/TraceBuffer.hpp>
+#include <Sockets/Relay.hpp>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace {
+
+    // This is the most data held in transit in each direction, after which
+    // the relay stops reading from the sender until the receiver catches up.
+    constexpr size_t maximumBufferedSize = 65536;
+
+}
+
+namespace Sockets {
+
+    struct Relay::Impl {
+        // Types
+
+        // This moves data one way, from one socket to another.
+        struct Direction {
+            // Properties
+
+            SOCKET from = INVALID_SOCKET;
+            SOCKET to = INVALID_SOCKET;
+#ifdef __linux__
+            int pipe[2] = {-1, -1};
+#else /* __linux__ */
+            std::vector< char > buffer;
+            size_t bufferOffset = 0;
+#endif /* __linux__ */
+            size_t buffered = 0;
+            bool fromClosed = false;
+            bool toClosed = false;
+
+            // Lifecycle
+
+            ~Direction() noexcept {
+#ifdef __linux__
+                for (int i = 0; i < 2; ++i) {
+                    if (pipe[i] >= 0) {
+                        (void)close(pipe[i]);
+                    }
+                }
+#endif /* __linux__ */
+            }
+
+            Direction(const Direction&) = delete;
+            Direction(Direction&&) noexcept = delete;
+            Direction& operator=(const Direction&) = delete;
+            Direction& operator=(Direction&&) noexcept = delete;
+
+            // Constructor
+            Direction() = default;
+
+            // Methods
+
+            bool Initialize() {
+#ifdef __linux__
+                return (pipe2(pipe, O_NONBLOCK | O_CLOEXEC) == 0);
+#else /* __linux__ */
+                buffer.resize(maximumBufferedSize);
+                return true;
+#endif /* __linux__ */
+            }
+
+            bool WantsToReceive() const {
+                return (
+                    !fromClosed
+                    && (buffered < maximumBufferedSize)
+                );
+            }
+
+            long long Receive() {
+#ifdef __linux__
+                const auto amountReceived = (long long)splice(
+                    from,
+                    NULL,
+                    pipe[1],
+                    NULL,
+                    maximumBufferedSize - buffered,
+                    SPLICE_F_MOVE | SPLICE_F_NONBLOCK
+                );
+#else /* __linux__ */
+                if (bufferOffset + buffered == buffer.size()) {
+                    (void)memmove(buffer.data(), buffer.data() + bufferOffset, buffered);
+                    bufferOffset = 0;
+                }
+                const auto amountReceived = (long long)recv(
+                    from,
+                    buffer.data() + bufferOffset + buffered,
+                    buffer.size() - bufferOffset - buffered,
+                    0
+                );
+#endif /* __linux__ */
+                if (amountReceived > 0) {
+                    buffered += (size_t)amountReceived;
+                }
+                return amountReceived;
+            }
+
+            long long Send() {
+#ifdef __linux__
+                const auto amountSent = (long long)splice(
+                    pipe[0],
+                    NULL,
+                    to,
+                    NULL,
+                    buffered,
+                    SPLICE_F_MOVE | SPLICE_F_NONBLOCK
+                );
+#else /* __linux__ */
+                const auto amountSent = (long long)send(
+                    to,
+                    buffer.data() + bufferOffset,
+                    buffered,
+                    MSG_NOSIGNAL
+                );
+                if (amountSent > 0) {
+                    bufferOffset += (size_t)amountSent;
+                }
+#endif /* __linux__ */
+                if (amountSent > 0) {
+                    buffered -= (size_t)amountSent;
+#ifndef __linux__
+                    if (buffered == 0) {
+                        bufferOffset = 0;
+                    }
+#endif /* __linux__ */
+                }
+                return amountSent;
+            }
+        };
+
+        // Properties
+        SOCKET clientSocket = INVALID_SOCKET;
+        SOCKET upstreamSocket = INVALID_SOCKET;
+        bool connecting = false;
+        Direction toUpstream;
+        Direction toDownstream;
+        OnClosed onClosed;
+        std::atomic< bool > stop{false};
+        PipeSignal stopSignal;
+        std::thread worker;
+        UsesSockets usesSockets;
+
+        // Statistics
+        Counter bytesToUpstream;
+        Counter bytesToDownstream;
+        Counter transferCalls;
+        Counter wouldBlock;
+        Counter wakeups;
+
+        // Lifecycle
+
+        ~Impl() noexcept {
+            if (worker.joinable()) {
+                if (worker.get_id() == std::this_thread::get_id()) {
+                    worker.detach();
+                } else {
+                    stop = true;
+                    stopSignal.Set();
+                    worker.join();
+                }
+            }
+            CloseSockets();
+        }
+
+        Impl(const Impl&) = delete;
+        Impl(Impl&&) noexcept = delete;
+        Impl& operator=(const Impl&) = delete;
+        Impl& operator=(Impl&&) noexcept = delete;
+
+        // Constructor
+        Impl() = default;
+
+        // Methods
+
+        void CloseSockets() {
+            if (!IS_INVALID_SOCKET(clientSocket)) {
+                (void)closesocket(clientSocket);
+                clientSocket = INVALID_SOCKET;
+            }
+            if (!IS_INVALID_SOCKET(upstreamSocket)) {
+                (void)closesocket(upstreamSocket);
+                upstreamSocket = INVALID_SOCKET;
+            }
+        }
+
+        // Move what data can be moved in one direction, and pass along the
+        // end of the data once it's all been delivered.
+        //
+        // Returns false if the connection failed.
+        bool Pump(
+            Direction& direction,
+            Counter& bytes,
+            bool readable,
+            bool writable
+        ) {
+            if (
+                readable
+                && direction.WantsToReceive()
+            ) {
+                transferCalls.Add();
+                const auto amountReceived = direction.Receive();
+                if (amountReceived == 0) {
+                    direction.fromClosed = true;
+                    TraceEvent(Trace::EventType::Close, (int64_t)direction.from);
+                } else if (amountReceived > 0) {
+                    TraceEvent(Trace::EventType::Receive, (int64_t)direction.from, (uint64_t)amountReceived);
+                    writable = true;
+                } else if (LAST_SOCKET_OPERATION_WOULD_BLOCK) {
+                    wouldBlock.Add();
+                } else {
+                    TraceEvent(Trace::EventType::Error, (int64_t)direction.from);
+                    return false;
+                }
+            }
+            if (
+                writable
+                && (direction.buffered > 0)
+            ) {
+                transferCalls.Add();
+                const auto amountSent = direction.Send();
+                if (amountSent >= 0) {
+                    bytes.Add((uint64_t)amountSent);
+                    TraceEvent(Trace::EventType::Send, (int64_t)direction.to, (uint64_t)amountSent);
+                } else if (LAST_SOCKET_OPERATION_WOULD_BLOCK) {
+                    wouldBlock.Add();
+                } else {
+                    TraceEvent(Trace::EventType::Error, (int64_t)direction.to);
+                    return false;
+                }
+            }
+            if (
+                direction.fromClosed
+                && (direction.buffered == 0)
+                && !direction.toClosed
+            ) {
+                (void)shutdown(direction.to, SD_SEND);
+                direction.toClosed = true;
+            }
+            return true;
+        }
+
+        // Wait for something to do, and do it.
+        //
+        // Returns false once the relay is finished, whether because both
+        // directions are closed or because a connection failed.
+        bool Step() {
+            if (
+                toUpstream.toClosed
+                && toDownstream.toClosed
+            ) {
+                return false;
+            }
+            struct pollfd pollfds[3];
+            short clientEvents = 0;
+            short upstreamEvents = 0;
+            if (connecting) {
+                upstreamEvents = POLLOUT;
+            } else {
+                if (toUpstream.WantsToReceive()) {
+                    clientEvents |= POLLIN;
+                }
+                if (toDownstream.buffered > 0) {
+                    clientEvents |= POLLOUT;
+                }
+                if (toDownstream.WantsToReceive()) {
+                    upstreamEvents |= POLLIN;
+                }
+                if (toUpstream.buffered > 0) {
+                    upstreamEvents |= POLLOUT;
+                }
+            }
+
+            // Leave out sockets we don't need anything from, since poll
+            // would otherwise keep reporting hang-ups on them.
+            pollfds[0].fd = (clientEvents == 0) ? -1 : clientSocket;
+            pollfds[0].events = clientEvents;
+            pollfds[0].revents = 0;
+            pollfds[1].fd = (upstreamEvents == 0) ? -1 : upstreamSocket;
+            pollfds[1].events = upstreamEvents;
+            pollfds[1].revents = 0;
+            pollfds[2].fd = stopSignal.GetSelectHandle();
+            pollfds[2].events = POLLIN;
+            pollfds[2].revents = 0;
+            if (poll(pollfds, 3, -1) < 0) {
+                return (errno == EINTR);
+            }
+            wakeups.Add();
+            if ((pollfds[2].revents & POLLIN) != 0) {
+                stopSignal.Clear();
+                return true;
+            }
+            if (connecting) {
+                if (pollfds[1].revents == 0) {
+                    return true;
+                }
+                int error = 0;
+                socklen_t errorLength = sizeof(error);
+                if (
+                    (getsockopt(upstreamSocket, SOL_SOCKET, SO_ERROR, &error, &errorLength) != 0)
+                    || (error != 0)
+                ) {
+                    fprintf(stderr, "error: unable to connect to upstream server\n");
+                    return false;
+                }
+                connecting = false;
+                return true;
+            }
+            const short readableEvents = POLLIN | POLLHUP | POLLERR;
+            const short writableEvents = POLLOUT | POLLHUP | POLLERR;
+            return (
+                Pump(
+                    toUpstream,
+                    bytesToUpstream,
+                    (pollfds[0].revents & readableEvents) != 0,
+                    (pollfds[1].revents & writableEvents) != 0
+                )
+                && Pump(
+                    toDownstream,
+                    bytesToDownstream,
+                    (pollfds[1].revents & readableEvents) != 0,
+                    (pollfds[0].revents & writableEvents) != 0
+                )
+            );
+        }
+
+        static void Worker(std::weak_ptr< Impl > implWeak) {
+            for (;;) {
+                auto impl = implWeak.lock();
+                if (
+                    !impl
+                    || impl->stop
+                ) {
+                    return;
+                }
+                if (!impl->Step()) {
+                    impl->CloseSockets();
+                    if (impl->onClosed) {
+                        impl->onClosed();
+                    }
+                    return;
+                }
+            }
+        }
+    };
+
+    Relay::~Relay() noexcept {
+        Stop();
+    }
+
+    Relay::Relay()
+        : impl_(new Impl())
+    {
+    }
+
+    RelayStatistics Relay::GetStatistics() const {
+        RelayStatistics statistics;
+        statistics.bytesToUpstream = impl_->bytesToUpstream.Get();
+        statistics.bytesToDownstream = impl_->bytesToDownstream.Get();
+        statistics.transferCalls = impl_->transferCalls.Get();
+        statistics.wouldBlock = impl_->wouldBlock.Get();
+        statistics.wakeups = impl_->wakeups.Get();
+        return statistics;
+    }
+
+    bool Relay::Start(
+        std::shared_ptr< ServerSocket::Client >&& client,
+        uint32_t upstreamAddress,
+        uint16_t upstreamPort,
+        OnClosed onClosed
+    ) {
+        // Take over the accepted socket from the client object.
+        const auto clientImpl = std::dynamic_pointer_cast< ClientImpl >(client);
+        if (
+            !clientImpl
+            || IS_INVALID_SOCKET(clientImpl->socket)
+        ) {
+            fprintf(stderr, "error: client connection can't be relayed\n");
+            return false;
+        }
+        impl_->clientSocket = clientImpl->socket;
+        clientImpl->socket = INVALID_SOCKET;
+        client.reset();
+
+        // Set up the pipes or buffers used to move the data.
+        if (
+            !impl_->toUpstream.Initialize()
+            || !impl_->toDownstream.Initialize()
+            || !impl_->stopSignal.Initialize()
+        ) {
+            fprintf(stderr, "error: unable to create relay buffers\n");
+            return false;
+        }
+
+        // Begin connecting to the upstream server.
+        impl_->upstreamSocket = socket(AF_INET, SOCK_STREAM, 0);
+        if (IS_INVALID_SOCKET(impl_->upstreamSocket)) {
+            fprintf(stderr, "error: unable to create socket\n");
+            return false;
+        }
+        for (const auto socket: {impl_->clientSocket, impl_->upstreamSocket}) {
+            int flags = fcntl(socket, F_GETFL, 0);
+            flags |= O_NONBLOCK;
+            (void)fcntl(socket, F_SETFL, flags);
+        }
+        struct sockaddr_in socketAddress;
+        (void)memset(&socketAddress, 0, sizeof(socketAddress));
+        socketAddress.sin_family = AF_INET;
+        socketAddress.IPV4_ADDRESS_IN_SOCKADDR = htonl(upstreamAddress);
+        socketAddress.sin_port = htons(upstreamPort);
+        if (
+            connect(
+                impl_->upstreamSocket,
+                (const sockaddr*)&socketAddress,
+                (SOCKADDR_LENGTH_TYPE)sizeof(socketAddress)
+            ) != 0
+        ) {
+            if (errno != EINPROGRESS) {
+                fprintf(stderr, "error: unable to connect to upstream server\n");
+                return false;
+            }
+            impl_->connecting = true;
+        }
+        impl_->toUpstream.from = impl_->clientSocket;
+        impl_->toUpstream.to = impl_->upstreamSocket;
+        impl_->toDownstream.from = impl_->upstreamSocket;
+        impl_->toDownstream.to = impl_->clientSocket;
+        impl_->onClosed = onClosed;
+
+        // Start moving data.
+        std::weak_ptr< Impl > implWeak(impl_);
+        try {
+            impl_->worker = std::thread(&Impl::Worker, implWeak);
+        } catch (const std::system_error&) {
+            fprintf(stderr, "error: unable to create worker thread\n");
+            return false;
+        }
+        return true;
+    }
+
+    void Relay::Stop() {
+        impl_->stop = true;
+        impl_->stopSignal.Set();
+    }
+
+}
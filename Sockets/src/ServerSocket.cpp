@@ -1,65 +1,148 @@
-#include "Abstractions.hpp"
-#include "Connection.hpp"
+#include "ClientImpl.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <Sockets/Detail/Abstractions.hpp>
+#include <Sockets/Detail/Counter.hpp>
+#include <Sockets/Detail/SlabPool.hpp>
+#include <Sockets/Detail/TraceBuffer.hpp>
 #include <Sockets/ServerSocket.hpp>
 #include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace Sockets {
 
-    struct ClientImpl
-        : public ServerSocket::Client
-    {
+    struct ServerSocket::Impl {
+        // Types
+        using Clock = std::chrono::steady_clock;
+
         // Properties
 
-        Connection connection;
+        bool error = false;
         SOCKET socket = INVALID_SOCKET;
+        SocketEventLoop socketEventLoop;
+        UsesSockets usesSockets;
 
-        // ClientConnection
+        // This is the path of the local socket, if bound to one.
+        std::string localPath;
 
-        virtual void Close() override {
-            connection.Close();
-        }
+        // Accepted clients and their connection state are allocated from
+        // these, so that their memory is recycled rather than going back
+        // and forth to the general-purpose allocator.
+        std::shared_ptr< SlabPool > clientPool = std::make_shared< SlabPool >();
+        std::shared_ptr< SlabPool > connectionPool = std::make_shared< SlabPool >();
 
-        virtual void SendMessage(const std::string& message) override {
-            connection.SendMessage(message);
-        }
+        // These are the clients accepted so far, kept so that they can be
+        // drained.  Clients which have gone away are pruned whenever the
+        // list has doubled in size since it was last pruned.
+        std::mutex clientsMutex;
+        std::vector< std::weak_ptr< ClientImpl > > clients;
+        size_t clientsPruneSize = 64;
+
+        // These are the connections handed over by another program (see
+        // TakeOver), waiting to be given to the accept callback.
+        std::vector< SOCKET > handedOverClients;
+
+        // Statistics
+        Counter acceptCalls;
+        Counter accepted;
+        Counter acceptWouldBlock;
+        Counter acceptErrors;
 
-        virtual void Start(
-            ServerSocket::OnReceived onReceived,
-            ServerSocket::OnClosed onClosed
-        ) override {
-            connection.Start(socket, onReceived, onClosed);
+        // Lifecycle
+
+        ~Impl() noexcept {
+            if (!localPath.empty()) {
+                RemoveLocalAddress(localPath);
+            }
         }
-    };
 
-    struct ServerSocket::Impl {
-        // Properties
+        Impl(const Impl&) = delete;
+        Impl(Impl&&) noexcept = delete;
+        Impl& operator=(const Impl&) = delete;
+        Impl& operator=(Impl&&) noexcept = delete;
 
-        bool error = false;
-        SOCKET socket;
-        SocketEventLoop socketEventLoop;
-        UsesSockets usesSockets;
+        // Constructor
+        Impl() = default;
 
         // Methods
 
-        bool OnSocketReady(OnAcceptClient onAcceptClient) {
+        void AcceptClient(
+            SOCKET clientSocket,
+            const OnAcceptClient& onAcceptClient
+        ) {
+            auto client = std::allocate_shared< ClientImpl >(
+                SlabAllocator< ClientImpl >(clientPool),
+                connectionPool
+            );
+            client->socket = clientSocket;
+            {
+                std::lock_guard< decltype(clientsMutex) > lock(clientsMutex);
+                if (clients.size() >= clientsPruneSize) {
+                    clients.erase(
+                        std::remove_if(
+                            clients.begin(),
+                            clients.end(),
+                            [](const std::weak_ptr< ClientImpl >& client){
+                                return client.expired();
+                            }
+                        ),
+                        clients.end()
+                    );
+                    clientsPruneSize = std::max(clientsPruneSize, clients.size() * 2);
+                }
+                clients.push_back(client);
+            }
+            onAcceptClient(std::move(client));
+        }
+
+        std::vector< std::shared_ptr< ClientImpl > > GetClients() {
+            std::vector< std::shared_ptr< ClientImpl > > liveClients;
+            std::lock_guard< decltype(clientsMutex) > lock(clientsMutex);
+            for (const auto& clientWeak: clients) {
+                auto client = clientWeak.lock();
+                if (client) {
+                    liveClients.push_back(std::move(client));
+                }
+            }
+            return liveClients;
+        }
+
+        bool OnSocketReady(const OnAcceptClient& onAcceptClient) {
             if (error) {
                 return true;
             }
+            acceptCalls.Add();
             const SOCKET clientSocket = accept(socket, NULL, NULL);
             if (IS_INVALID_SOCKET(clientSocket)) {
-                if (!LAST_SOCKET_OPERATION_WOULD_BLOCK) {
+                if (LAST_SOCKET_OPERATION_WOULD_BLOCK) {
+                    acceptWouldBlock.Add();
+                } else {
+                    acceptErrors.Add();
+                    TraceEvent(Trace::EventType::Error, (int64_t)socket);
                     error = true;
                     fprintf(stderr, "error: unable to read socket\n");
                 }
                 return true;
             } else {
-                auto client = std::make_shared< ClientImpl >();
-                client->socket = clientSocket;
-                onAcceptClient(std::move(client));
+                accepted.Add();
+                TraceEvent(Trace::EventType::Accept, (int64_t)clientSocket);
+                AcceptClient(clientSocket, onAcceptClient);
             }
             return true;
         }
+
+        // Stop the worker thread and close the listening socket.
+        void StopAccepting() {
+            socketEventLoop.Join();
+            if (!IS_INVALID_SOCKET(socket)) {
+                (void)closesocket(socket);
+                socket = INVALID_SOCKET;
+            }
+        }
     };
 
     ServerSocket::ServerSocket()
@@ -87,13 +170,167 @@ namespace Sockets {
         return true;
     }
 
+    bool ServerSocket::Bind(const std::string& path) {
+        LocalAddress socketAddress;
+        if (!MakeLocalAddress(path, socketAddress)) {
+            fprintf(stderr, "error: invalid local socket path\n");
+            return false;
+        }
+
+        // Create the socket.
+        impl_->socket = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (IS_INVALID_SOCKET(impl_->socket)) {
+            fprintf(stderr, "error: unable to create socket\n");
+            return false;
+        }
+
+        // Bind the socket, replacing any socket left behind by an earlier
+        // program which didn't clean up.
+        RemoveLocalAddress(path);
+        if (bind(impl_->socket, (struct sockaddr*)&socketAddress.storage, socketAddress.length)) {
+            fprintf(stderr, "error: unable to bind socket\n");
+            return false;
+        }
+        impl_->localPath = path;
+        return true;
+    }
+
+    bool ServerSocket::Drain(std::chrono::milliseconds timeout) {
+        const auto deadline = Impl::Clock::now() + timeout;
+        impl_->StopAccepting();
+        const auto clients = impl_->GetClients();
+        for (const auto& client: clients) {
+            client->Close();
+        }
+        for (const auto& client: clients) {
+            // A connection which has failed will never finish sending, so
+            // don't wait for it.
+            while (client->IsSending()) {
+                if (Impl::Clock::now() >= deadline) {
+                    return false;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        return true;
+    }
+
+    ListenerStatistics ServerSocket::GetStatistics() const {
+        ListenerStatistics statistics;
+        statistics.acceptCalls = impl_->acceptCalls.Get();
+        statistics.accepted = impl_->accepted.Get();
+        statistics.acceptWouldBlock = impl_->acceptWouldBlock.Get();
+        statistics.acceptErrors = impl_->acceptErrors.Get();
+        statistics.connectionBlocks = impl_->connectionPool->GetBlockCount();
+        statistics.connectionBlocksInUse = impl_->connectionPool->GetBlocksInUse();
+        statistics.eventLoop = impl_->socketEventLoop.GetStatistics();
+        return statistics;
+    }
+
+    bool ServerSocket::HandOff(
+        const std::string& path,
+        std::vector< std::shared_ptr< Client > >& handedOff,
+        std::chrono::milliseconds timeout
+    ) {
+        const auto deadline = Impl::Clock::now() + timeout;
+        LocalAddress channelAddress;
+        if (!MakeLocalAddress(path, channelAddress)) {
+            fprintf(stderr, "error: invalid local socket path\n");
+            return false;
+        }
+        if (IS_INVALID_SOCKET(impl_->socket)) {
+            fprintf(stderr, "error: no listening socket to hand off\n");
+            return false;
+        }
+        const SOCKET channel = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (IS_INVALID_SOCKET(channel)) {
+            fprintf(stderr, "error: unable to create socket\n");
+            return false;
+        }
+        if (connect(channel, (struct sockaddr*)&channelAddress.storage, channelAddress.length)) {
+            fprintf(stderr, "error: unable to connect to program taking over\n");
+            (void)closesocket(channel);
+            return false;
+        }
+
+        // Stop accepting connections here, and then hand off the listening
+        // socket.  The other program doesn't accept anything until
+        // everything has been handed off, so any connections made from
+        // now on wait in the backlog.
+        impl_->socketEventLoop.Join();
+        if (!SendSockets(channel, &impl_->socket, 1)) {
+            fprintf(stderr, "error: unable to hand off listening socket\n");
+            (void)closesocket(channel);
+            return false;
+        }
+        impl_->StopAccepting();
+
+        // Now that the list of connections can't grow, release all of them
+        // at once, so that they finish sending in parallel, and then hand
+        // off those which were released in time.
+        std::vector< std::shared_ptr< ClientImpl > > releasing;
+        for (const auto& clientImpl: impl_->GetClients()) {
+            if (clientImpl->BeginRelease()) {
+                releasing.push_back(clientImpl);
+            }
+        }
+        std::vector< SOCKET > released;
+        handedOff.clear();
+        for (const auto& clientImpl: releasing) {
+            const auto clientSocket = clientImpl->EndRelease(deadline);
+            if (!IS_INVALID_SOCKET(clientSocket)) {
+                released.push_back(clientSocket);
+                handedOff.push_back(clientImpl);
+            }
+        }
+        bool success = true;
+        for (size_t i = 0; i < released.size(); i += maximumSocketsPerTransfer) {
+            if (
+                success
+                && !SendSockets(
+                    channel,
+                    released.data() + i,
+                    std::min(maximumSocketsPerTransfer, released.size() - i)
+                )
+            ) {
+                fprintf(stderr, "error: unable to hand off connections\n");
+                success = false;
+            }
+        }
+        for (const auto clientSocket: released) {
+            (void)closesocket(clientSocket);
+        }
+
+        // An empty transfer marks the end.  The other program now serves the
+        // listening socket (and its path, if it's a local socket).
+        if (
+            success
+            && !SendSockets(channel, NULL, 0)
+        ) {
+            fprintf(stderr, "error: unable to finish handoff\n");
+            success = false;
+        }
+        (void)closesocket(channel);
+        impl_->localPath.clear();
+        return success;
+    }
+
+    void ServerSocket::ReserveConnections(size_t count) {
+        impl_->clientPool->Reserve(count);
+        impl_->connectionPool->Reserve(count);
+    }
+
     bool ServerSocket::Listen(OnAcceptClient onAcceptClient) {
         if (listen(impl_->socket, SOMAXCONN)) {
             fprintf(stderr, "error: unable to listen on socket\n");
             return false;
         }
+        for (const auto clientSocket: impl_->handedOverClients) {
+            impl_->AcceptClient(clientSocket, onAcceptClient);
+        }
+        impl_->handedOverClients.clear();
         std::weak_ptr< Impl > implWeak(impl_);
-        impl_->socketEventLoop.Start(
+        return impl_->socketEventLoop.Start(
             impl_->socket,
 
             // isReadyToSend
@@ -111,6 +348,80 @@ namespace Sockets {
                 return impl->OnSocketReady(onAcceptClient);
             }
         );
+    }
+
+    bool ServerSocket::TakeOver(
+        const std::string& path,
+        std::chrono::milliseconds timeout
+    ) {
+        const auto deadline = Impl::Clock::now() + timeout;
+        LocalAddress channelAddress;
+        if (!MakeLocalAddress(path, channelAddress)) {
+            fprintf(stderr, "error: invalid local socket path\n");
+            return false;
+        }
+
+        // Wait for the program handing off to connect.
+        const SOCKET channelListener = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (IS_INVALID_SOCKET(channelListener)) {
+            fprintf(stderr, "error: unable to create socket\n");
+            return false;
+        }
+        RemoveLocalAddress(path);
+        if (
+            bind(channelListener, (struct sockaddr*)&channelAddress.storage, channelAddress.length)
+            || listen(channelListener, 1)
+        ) {
+            fprintf(stderr, "error: unable to listen for handoff\n");
+            (void)closesocket(channelListener);
+            return false;
+        }
+        SOCKET channel = INVALID_SOCKET;
+        if (WaitUntilReadable(channelListener, timeout)) {
+            channel = accept(channelListener, NULL, NULL);
+        }
+        (void)closesocket(channelListener);
+        RemoveLocalAddress(path);
+        if (IS_INVALID_SOCKET(channel)) {
+            fprintf(stderr, "error: no program handed off a listening socket\n");
+            return false;
+        }
+
+        // The listening socket comes first, then the connections, and
+        // finally an empty transfer.
+        std::vector< SOCKET > sockets;
+        bool success = false;
+        for (;;) {
+            const auto remaining = std::chrono::duration_cast< std::chrono::milliseconds >(
+                deadline - Impl::Clock::now()
+            );
+            size_t count = 0;
+            if (
+                (remaining.count() <= 0)
+                || !WaitUntilReadable(channel, remaining)
+                || !ReceiveSockets(channel, sockets, count)
+            ) {
+                break;
+            }
+            if (count == 0) {
+                success = !sockets.empty();
+                break;
+            }
+        }
+        (void)closesocket(channel);
+        if (!success) {
+            fprintf(stderr, "error: unable to take over listening socket\n");
+            for (const auto receivedSocket: sockets) {
+                (void)closesocket(receivedSocket);
+            }
+            return false;
+        }
+        impl_->socket = sockets[0];
+        impl_->handedOverClients.assign(sockets.begin() + 1, sockets.end());
+
+        // A local listening socket's path now belongs to this program, to
+        // remove once it's done with it, just as if it had bound it.
+        impl_->localPath = GetLocalPath(impl_->socket);
         return true;
     }
 
@@ -0,0 +1,816 @@
+#include "ClientImpl.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <poll.h>
+#include <Sockets/Detail/Abstractions.hpp>
+#include <Sockets/Detail/Counter.hpp>
+#include <Sockets/SharedMemoryChannel.hpp>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <system_error>
+#include <thread>
+
+static_assert(
+    ATOMIC_LLONG_LOCK_FREE == 2,
+    "shared memory rings need lock-free 64-bit atomics"
+);
+
+namespace {
+
+    // These identify the handshake and shared memory layout, so that
+    // mismatched programs fail to connect rather than corrupt each other.
+    constexpr uint32_t magic = 0x53484d43;
+    constexpr uint32_t version = 1;
+
+    // These are the smallest and largest ring sizes allowed.  The largest
+    // keeps the size of the shared memory well within range.
+    constexpr size_t minimumRingSize = 4096;
+    constexpr size_t maximumRingSize = 1073741824;
+
+    // This is how long a worker keeps checking for more to do before
+    // going to sleep, so that under steady traffic neither side needs to
+    // make system calls to wake the other.  There's no spinning with only
+    // one processor, since the other side can't make progress meanwhile.
+    constexpr auto spinDuration = std::chrono::microseconds(20);
+
+    // Each message is put in a ring as its length followed by its bytes.
+    constexpr size_t messageHeaderSize = sizeof(uint32_t);
+
+    // This is one direction of the channel, written by one side and read
+    // by the other.  The positions count bytes since the channel started,
+    // and are kept in separate cache lines since each side writes one.
+    struct Ring {
+        alignas(64) std::atomic< uint64_t > writePosition{0};
+        alignas(64) std::atomic< uint64_t > readPosition{0};
+    };
+
+    // This is at the start of the shared memory, followed by the data of
+    // each ring.  Ring 0 is written by the side which called Start, and
+    // ring 1 by the side which called Connect.  Each side sets its own
+    // flags before going to sleep, and the other side clears them and
+    // rings the first side's doorbell when it has given it something to do.
+    struct SharedHeader {
+        uint32_t magic = 0;
+        uint32_t version = 0;
+        uint64_t ringSize = 0;
+        alignas(64) std::atomic< uint32_t > waitingForData[2];
+        std::atomic< uint32_t > waitingForSpace[2];
+        Ring rings[2];
+    };
+
+    // This is sent over the socket, along with the shared memory and the
+    // two doorbells, to set up the channel.
+    struct Handshake {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t ringSize;
+    };
+
+    // This is the number of file descriptors passed with the handshake:
+    // the shared memory and each side's doorbell.
+    constexpr size_t handshakeFiles = 3;
+
+    size_t GetHeaderSize() {
+        const size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+        return (sizeof(SharedHeader) + pageSize - 1) / pageSize * pageSize;
+    }
+
+    void RingDoorbell(int doorbell) {
+        const uint64_t one = 1;
+        (void)write(doorbell, &one, sizeof(one));
+    }
+
+}
+
+namespace Sockets {
+
+    constexpr size_t SharedMemoryChannel::defaultRingSize;
+
+    struct SharedMemoryChannel::Impl {
+        // Types
+        struct Message {
+            std::string message;
+            size_t offset;
+        };
+
+        // Properties
+        SOCKET socket = INVALID_SOCKET;
+        void* mapping = MAP_FAILED;
+        size_t mappingSize = 0;
+        SharedHeader* header = nullptr;
+        size_t side = 0;
+        int doorbells[2] = {-1, -1};
+        uint64_t ringMask = 0;
+        Ring* inbound = nullptr;
+        Ring* outbound = nullptr;
+        char* inboundData = nullptr;
+        char* outboundData = nullptr;
+        OnReceived onReceived;
+        OnClosed onClosed;
+        std::atomic< bool > stop{false};
+        std::atomic< bool > protocolError{false};
+        std::thread worker;
+        UsesSockets usesSockets;
+
+        // These are used by the worker thread to put back together the
+        // message currently coming in.
+        char incomingHeader[messageHeaderSize];
+        size_t incomingHeaderReceived = 0;
+        uint32_t incomingLength = 0;
+        std::string incoming;
+
+        // This is used to serialize access to the outbound ring and the
+        // properties below.
+        std::mutex mutex;
+
+        // These are the messages which didn't fit in the outbound ring
+        // when they were sent, in order.
+        std::deque< Message > sendQueue;
+
+        bool writeClosed = false;
+        bool shutDown = false;
+
+        // Statistics
+        Counter bytesReceived;
+        Counter bytesSent;
+        Counter messagesReceived;
+        Counter messagesSent;
+        Counter sendQueueDepth;
+        Counter ringFullStalls;
+        Counter dataDoorbells;
+        Counter spaceDoorbells;
+        Counter wakeups;
+
+        // Lifecycle
+
+        ~Impl() noexcept {
+            if (worker.joinable()) {
+                if (worker.get_id() == std::this_thread::get_id()) {
+                    worker.detach();
+                } else {
+                    stop = true;
+                    RingDoorbell(doorbells[side]);
+                    worker.join();
+                }
+            }
+            if (mapping != MAP_FAILED) {
+                (void)munmap(mapping, mappingSize);
+            }
+            for (const auto doorbell: doorbells) {
+                if (doorbell >= 0) {
+                    (void)close(doorbell);
+                }
+            }
+            if (!IS_INVALID_SOCKET(socket)) {
+                (void)closesocket(socket);
+            }
+        }
+
+        Impl(const Impl&) = delete;
+        Impl(Impl&&) noexcept = delete;
+        Impl& operator=(const Impl&) = delete;
+        Impl& operator=(Impl&&) noexcept = delete;
+
+        // Constructor
+        Impl() = default;
+
+        // Methods
+
+        bool Map(int memory, size_t ringSize) {
+            mappingSize = GetHeaderSize() + 2 * ringSize;
+            mapping = mmap(
+                NULL,
+                mappingSize,
+                PROT_READ | PROT_WRITE,
+                MAP_SHARED,
+                memory,
+                0
+            );
+            if (mapping == MAP_FAILED) {
+                fprintf(stderr, "error: unable to map shared memory\n");
+                return false;
+            }
+            header = (SharedHeader*)mapping;
+            ringMask = ringSize - 1;
+            const auto data = (char*)mapping + GetHeaderSize();
+            outbound = &header->rings[side];
+            inbound = &header->rings[1 - side];
+            outboundData = data + side * ringSize;
+            inboundData = data + (1 - side) * ringSize;
+            return true;
+        }
+
+        void CopyToRing(uint64_t position, const char* data, size_t length) {
+            const auto index = (size_t)(position & ringMask);
+            const auto first = std::min(length, (size_t)(ringMask + 1) - index);
+            (void)memcpy(outboundData + index, data, first);
+            (void)memcpy(outboundData, data + first, length - first);
+        }
+
+        void AppendFromRing(uint64_t position, size_t length, std::string& to) {
+            const auto index = (size_t)(position & ringMask);
+            const auto first = std::min(length, (size_t)(ringMask + 1) - index);
+            (void)to.append(inboundData + index, first);
+            (void)to.append(inboundData, length - first);
+        }
+
+        void CopyFromRing(uint64_t position, char* to, size_t length) {
+            const auto index = (size_t)(position & ringMask);
+            const auto first = std::min(length, (size_t)(ringMask + 1) - index);
+            (void)memcpy(to, inboundData + index, first);
+            (void)memcpy(to + first, inboundData, length - first);
+        }
+
+        // Copy as much of the given message (from the given offset, which
+        // counts its header) into the outbound ring as there is space for.
+        //
+        // Returns true if the whole message is now in the ring.
+        bool CopyMessage(
+            const std::string& message,
+            size_t& offset,
+            uint64_t& writePosition,
+            size_t& space
+        ) {
+            const auto totalLength = messageHeaderSize + message.length();
+            while (
+                (offset < totalLength)
+                && (space > 0)
+            ) {
+                size_t amount;
+                if (offset < messageHeaderSize) {
+                    const auto length = (uint32_t)message.length();
+                    char lengthBytes[messageHeaderSize];
+                    (void)memcpy(lengthBytes, &length, sizeof(length));
+                    amount = std::min(messageHeaderSize - offset, space);
+                    CopyToRing(writePosition, lengthBytes + offset, amount);
+                } else {
+                    amount = std::min(totalLength - offset, space);
+                    CopyToRing(
+                        writePosition,
+                        message.data() + offset - messageHeaderSize,
+                        amount
+                    );
+                    bytesSent.Add(amount);
+                }
+                offset += amount;
+                writePosition += amount;
+                space -= amount;
+            }
+            if (offset < totalLength) {
+                return false;
+            }
+            messagesSent.Add();
+            return true;
+        }
+
+        // Make what's been copied into the outbound ring visible to the
+        // other side, and wake it up if it's waiting for it.
+        //
+        // This must be called while holding the mutex.
+        void PublishOutbound(uint64_t writePosition) {
+            outbound->writePosition.store(writePosition);
+            auto& peerWaiting = header->waitingForData[1 - side];
+            if (
+                (peerWaiting.load() != 0)
+                && (peerWaiting.exchange(0) != 0)
+            ) {
+                dataDoorbells.Add();
+                RingDoorbell(doorbells[1 - side]);
+            }
+        }
+
+        // Make the space taken by what's been read from the inbound ring
+        // available again to the other side, and wake it up if it's
+        // waiting for it.
+        void PublishInbound(uint64_t readPosition) {
+            inbound->readPosition.store(readPosition);
+            auto& peerWaiting = header->waitingForSpace[1 - side];
+            if (
+                (peerWaiting.load() != 0)
+                && (peerWaiting.exchange(0) != 0)
+            ) {
+                spaceDoorbells.Add();
+                RingDoorbell(doorbells[1 - side]);
+            }
+        }
+
+        bool HasInbound() {
+            return (
+                inbound->writePosition.load(std::memory_order_relaxed)
+                != inbound->readPosition.load(std::memory_order_relaxed)
+            );
+        }
+
+        // The other side controls the read position, so don't trust it to
+        // stay within the ring.
+        size_t GetOutboundSpace(uint64_t writePosition) {
+            const auto readPosition = outbound->readPosition.load(std::memory_order_acquire);
+            const auto used = writePosition - readPosition;
+            if (used > ringMask + 1) {
+                if (!protocolError.exchange(true)) {
+                    fprintf(stderr, "error: invalid shared memory ring position\n");
+                }
+                return 0;
+            }
+            return (size_t)(ringMask + 1 - used);
+        }
+
+        // Move queued messages into the outbound ring.
+        //
+        // This must be called while holding the mutex.
+        //
+        // Returns true if anything was moved.
+        bool DrainSendQueue() {
+            if (sendQueue.empty()) {
+                return false;
+            }
+            auto writePosition = outbound->writePosition.load(std::memory_order_relaxed);
+            auto space = GetOutboundSpace(writePosition);
+            if (space == 0) {
+                return false;
+            }
+            while (!sendQueue.empty()) {
+                auto& message = sendQueue.front();
+                if (!CopyMessage(message.message, message.offset, writePosition, space)) {
+                    break;
+                }
+                sendQueue.pop_front();
+                sendQueueDepth.Subtract();
+            }
+            PublishOutbound(writePosition);
+            return true;
+        }
+
+        // Deliver whatever has arrived in the inbound ring.
+        //
+        // Returns true if anything was read.
+        bool Receive() {
+            auto readPosition = inbound->readPosition.load(std::memory_order_relaxed);
+            const auto writePosition = inbound->writePosition.load(std::memory_order_acquire);
+            if (readPosition == writePosition) {
+                return false;
+            }
+
+            // The other side controls the write position, so don't trust
+            // it to stay within the ring.
+            if (writePosition - readPosition > ringMask + 1) {
+                fprintf(stderr, "error: invalid shared memory ring position\n");
+                protocolError = true;
+                return false;
+            }
+            while (readPosition != writePosition) {
+                const auto available = (size_t)(writePosition - readPosition);
+                if (incomingHeaderReceived < messageHeaderSize) {
+                    const auto amount = std::min(
+                        messageHeaderSize - incomingHeaderReceived,
+                        available
+                    );
+                    CopyFromRing(readPosition, incomingHeader + incomingHeaderReceived, amount);
+                    incomingHeaderReceived += amount;
+                    readPosition += amount;
+                    if (incomingHeaderReceived < messageHeaderSize) {
+                        continue;
+                    }
+                    (void)memcpy(&incomingLength, incomingHeader, sizeof(incomingLength));
+                    incoming.clear();
+
+                    // Don't let the length alone make us allocate more
+                    // than the ring holds; a longer message grows as it
+                    // actually arrives.
+                    incoming.reserve(std::min((size_t)incomingLength, (size_t)(ringMask + 1)));
+                } else {
+                    const auto amount = std::min(
+                        (size_t)incomingLength - incoming.length(),
+                        available
+                    );
+                    AppendFromRing(readPosition, amount, incoming);
+                    readPosition += amount;
+                }
+                if (incoming.length() == incomingLength) {
+                    // Free up the space before calling back, so the other
+                    // side can keep going in the meantime.
+                    PublishInbound(readPosition);
+                    incomingHeaderReceived = 0;
+                    bytesReceived.Add(incomingLength);
+                    messagesReceived.Add();
+                    if (onReceived) {
+                        onReceived(incoming);
+                    }
+                }
+            }
+            PublishInbound(readPosition);
+            return true;
+        }
+
+        // Do what there is to do, or wait for something to do.
+        //
+        // Returns false once the other side has gone away.
+        bool Step() {
+            bool progress = Receive();
+            if (protocolError) {
+                return false;
+            }
+            bool sendBlocked;
+            {
+                std::lock_guard< decltype(mutex) > lock(mutex);
+                progress = DrainSendQueue() || progress;
+                sendBlocked = !sendQueue.empty();
+                if (
+                    writeClosed
+                    && !sendBlocked
+                    && !shutDown
+                ) {
+                    (void)shutdown(socket, SD_SEND);
+                    shutDown = true;
+                }
+                if (
+                    !progress
+                    && sendBlocked
+                ) {
+                    header->waitingForSpace[side].store(1);
+                }
+            }
+            if (protocolError) {
+                return false;
+            }
+            if (progress) {
+                return true;
+            }
+            static const bool spin = (std::thread::hardware_concurrency() > 1);
+            if (spin) {
+                const auto spinUntil = std::chrono::steady_clock::now() + spinDuration;
+                while (
+                    !HasInbound()
+                    && (std::chrono::steady_clock::now() < spinUntil)
+                    && !stop
+                ) {
+                }
+                if (HasInbound()) {
+                    return true;
+                }
+            }
+
+            // Tell the other side we're going to sleep, and then check once
+            // more, in case it gave us something to do before seeing that.
+            header->waitingForData[side].store(1);
+            if (
+                (inbound->writePosition.load() == inbound->readPosition.load(std::memory_order_relaxed))
+                && (
+                    !sendBlocked
+                    || (
+                        outbound->readPosition.load()
+                        + ringMask + 1
+                        == outbound->writePosition.load(std::memory_order_relaxed)
+                    )
+                )
+            ) {
+                struct pollfd pollfds[2];
+                pollfds[0].fd = doorbells[side];
+                pollfds[0].events = POLLIN;
+                pollfds[0].revents = 0;
+                pollfds[1].fd = socket;
+                pollfds[1].events = POLLIN;
+                pollfds[1].revents = 0;
+                if (poll(pollfds, 2, -1) < 0) {
+                    pollfds[0].revents = 0;
+                    pollfds[1].revents = 0;
+                }
+                wakeups.Add();
+                if ((pollfds[0].revents & POLLIN) != 0) {
+                    uint64_t count;
+                    (void)read(doorbells[side], &count, sizeof(count));
+                }
+                if (pollfds[1].revents != 0) {
+                    char buffer[1];
+                    const auto amountReceived = recv(socket, buffer, sizeof(buffer), MSG_DONTWAIT);
+                    if (
+                        (amountReceived == 0)
+                        || (
+                            (amountReceived < 0)
+                            && !LAST_SOCKET_OPERATION_WOULD_BLOCK
+                        )
+                    ) {
+                        // Deliver anything the other side sent before it
+                        // went away.
+                        while (Receive()) {
+                        }
+                        return false;
+                    }
+                }
+            }
+            header->waitingForData[side].store(0);
+            header->waitingForSpace[side].store(0);
+            return true;
+        }
+
+        static bool StartWorker(const std::shared_ptr< Impl >& impl) {
+            std::weak_ptr< Impl > implWeak(impl);
+            try {
+                impl->worker = std::thread(&Impl::Worker, implWeak);
+            } catch (const std::system_error&) {
+                fprintf(stderr, "error: unable to create worker thread\n");
+                return false;
+            }
+            return true;
+        }
+
+        static void Worker(std::weak_ptr< Impl > implWeak) {
+            for (;;) {
+                auto impl = implWeak.lock();
+                if (
+                    !impl
+                    || impl->stop
+                ) {
+                    return;
+                }
+                if (!impl->Step()) {
+                    if (impl->onClosed) {
+                        impl->onClosed();
+                    }
+                    return;
+                }
+            }
+        }
+    };
+
+    SharedMemoryChannel::~SharedMemoryChannel() noexcept {
+        // The worker holds on to the implementation while it's waiting,
+        // so wake it up and have it let go.
+        impl_->stop = true;
+        if (impl_->doorbells[impl_->side] >= 0) {
+            RingDoorbell(impl_->doorbells[impl_->side]);
+        }
+    }
+
+    SharedMemoryChannel::SharedMemoryChannel()
+        : impl_(new Impl())
+    {
+    }
+
+    void SharedMemoryChannel::Close() {
+        std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+        impl_->writeClosed = true;
+        if (impl_->doorbells[impl_->side] >= 0) {
+            RingDoorbell(impl_->doorbells[impl_->side]);
+        }
+    }
+
+    bool SharedMemoryChannel::Connect(
+        const std::string& path,
+        OnReceived onReceived,
+        OnClosed onClosed
+    ) {
+        // Connect to the other side.
+        LocalAddress socketAddress;
+        if (!MakeLocalAddress(path, socketAddress)) {
+            fprintf(stderr, "error: invalid local socket path\n");
+            return false;
+        }
+        impl_->socket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (IS_INVALID_SOCKET(impl_->socket)) {
+            fprintf(stderr, "error: unable to create socket\n");
+            return false;
+        }
+        if (
+            connect(
+                impl_->socket,
+                (const sockaddr*)&socketAddress.storage,
+                socketAddress.length
+            )
+        ) {
+            fprintf(stderr, "error: unable to connect\n");
+            return false;
+        }
+
+        // Wait for the handshake, which brings the shared memory and
+        // doorbells with it.
+        Handshake handshake;
+        struct iovec iov;
+        iov.iov_base = &handshake;
+        iov.iov_len = sizeof(handshake);
+        union {
+            char buffer[CMSG_SPACE(handshakeFiles * sizeof(int))];
+            struct cmsghdr align;
+        } control;
+        struct msghdr message;
+        (void)memset(&message, 0, sizeof(message));
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control.buffer;
+        message.msg_controllen = sizeof(control.buffer);
+        const auto amountReceived = recvmsg(impl_->socket, &message, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+        int files[handshakeFiles] = {-1, -1, -1};
+        const auto controlMessage = CMSG_FIRSTHDR(&message);
+        if (
+            (controlMessage != NULL)
+            && (controlMessage->cmsg_level == SOL_SOCKET)
+            && (controlMessage->cmsg_type == SCM_RIGHTS)
+            && (controlMessage->cmsg_len == CMSG_LEN(sizeof(files)))
+        ) {
+            (void)memcpy(files, CMSG_DATA(controlMessage), sizeof(files));
+        }
+        impl_->side = 1;
+        impl_->doorbells[0] = files[1];
+        impl_->doorbells[1] = files[2];
+        const auto memory = files[0];
+        struct stat memoryStatus;
+        const bool valid = (
+            (amountReceived == (ssize_t)sizeof(handshake))
+            && (memory >= 0)
+            && (impl_->doorbells[0] >= 0)
+            && (impl_->doorbells[1] >= 0)
+            && (handshake.magic == magic)
+            && (handshake.version == version)
+            && (handshake.ringSize >= minimumRingSize)
+            && (handshake.ringSize <= maximumRingSize)
+            && ((handshake.ringSize & (handshake.ringSize - 1)) == 0)
+            && (fstat(memory, &memoryStatus) == 0)
+            && ((uint64_t)memoryStatus.st_size >= GetHeaderSize() + 2 * handshake.ringSize)
+        );
+        if (!valid) {
+            if (memory >= 0) {
+                (void)close(memory);
+            }
+            fprintf(stderr, "error: invalid shared memory handshake\n");
+            return false;
+        }
+        const bool mapped = impl_->Map(memory, (size_t)handshake.ringSize);
+        (void)close(memory);
+        if (!mapped) {
+            return false;
+        }
+        if (
+            (impl_->header->magic != magic)
+            || (impl_->header->ringSize != handshake.ringSize)
+        ) {
+            fprintf(stderr, "error: invalid shared memory handshake\n");
+            return false;
+        }
+
+        // Start exchanging messages.
+        impl_->onReceived = onReceived;
+        impl_->onClosed = onClosed;
+        return Impl::StartWorker(impl_);
+    }
+
+    SharedMemoryStatistics SharedMemoryChannel::GetStatistics() const {
+        SharedMemoryStatistics statistics;
+        statistics.bytesReceived = impl_->bytesReceived.Get();
+        statistics.bytesSent = impl_->bytesSent.Get();
+        statistics.messagesReceived = impl_->messagesReceived.Get();
+        statistics.messagesSent = impl_->messagesSent.Get();
+        statistics.sendQueueDepth = impl_->sendQueueDepth.Get();
+        statistics.ringFullStalls = impl_->ringFullStalls.Get();
+        statistics.doorbellsRung = (
+            impl_->dataDoorbells.Get()
+            + impl_->spaceDoorbells.Get()
+        );
+        statistics.wakeups = impl_->wakeups.Get();
+        return statistics;
+    }
+
+    void SharedMemoryChannel::SendMessage(const std::string& message) {
+        if (message.length() > UINT32_MAX) {
+            fprintf(stderr, "error: message too large for shared memory channel\n");
+            return;
+        }
+        std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+        if (
+            (impl_->header == nullptr)
+            || impl_->writeClosed
+        ) {
+            return;
+        }
+
+        // If nothing is waiting to go ahead of this message, copy it
+        // straight into the ring.
+        size_t offset = 0;
+        if (impl_->sendQueue.empty()) {
+            auto writePosition = impl_->outbound->writePosition.load(std::memory_order_relaxed);
+            auto space = impl_->GetOutboundSpace(writePosition);
+            const auto copied = impl_->CopyMessage(message, offset, writePosition, space);
+            if (offset > 0) {
+                impl_->PublishOutbound(writePosition);
+            }
+            if (copied) {
+                return;
+            }
+
+            // The ring is full, so the worker has to take over from here,
+            // waiting for the other side to make space.
+            impl_->ringFullStalls.Add();
+            RingDoorbell(impl_->doorbells[impl_->side]);
+        }
+        impl_->sendQueueDepth.Add();
+        impl_->sendQueue.push_back({message, offset});
+    }
+
+    bool SharedMemoryChannel::Start(
+        std::shared_ptr< ServerSocket::Client >&& client,
+        OnReceived onReceived,
+        OnClosed onClosed,
+        size_t ringSize
+    ) {
+        if (ringSize > maximumRingSize) {
+            fprintf(stderr, "error: shared memory ring size is too large\n");
+            return false;
+        }
+
+        // Take over the accepted socket from the client object.
+        const auto clientImpl = std::dynamic_pointer_cast< ClientImpl >(client);
+        if (
+            !clientImpl
+            || IS_INVALID_SOCKET(clientImpl->socket)
+        ) {
+            fprintf(stderr, "error: client connection can't be used for shared memory\n");
+            return false;
+        }
+        impl_->socket = clientImpl->socket;
+        clientImpl->socket = INVALID_SOCKET;
+        client.reset();
+
+        // Make the shared memory and doorbells.
+        size_t roundedRingSize = minimumRingSize;
+        while (roundedRingSize < ringSize) {
+            roundedRingSize <<= 1;
+        }
+        const auto memory = memfd_create("Sockets::SharedMemoryChannel", MFD_CLOEXEC);
+        if (memory < 0) {
+            fprintf(stderr, "error: unable to create shared memory\n");
+            return false;
+        }
+        impl_->side = 0;
+        if (
+            (ftruncate(memory, (off_t)(GetHeaderSize() + 2 * roundedRingSize)) != 0)
+            || !impl_->Map(memory, roundedRingSize)
+        ) {
+            (void)close(memory);
+            fprintf(stderr, "error: unable to create shared memory\n");
+            return false;
+        }
+        impl_->header = new (impl_->mapping) SharedHeader();
+        impl_->header->magic = magic;
+        impl_->header->version = version;
+        impl_->header->ringSize = roundedRingSize;
+        for (int i = 0; i < 2; ++i) {
+            impl_->header->waitingForData[i].store(0);
+            impl_->header->waitingForSpace[i].store(0);
+            impl_->doorbells[i] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (impl_->doorbells[i] < 0) {
+                (void)close(memory);
+                fprintf(stderr, "error: unable to create doorbell\n");
+                return false;
+            }
+        }
+
+        // Send the handshake, passing along the shared memory and doorbells.
+        Handshake handshake;
+        handshake.magic = magic;
+        handshake.version = version;
+        handshake.ringSize = roundedRingSize;
+        const int files[handshakeFiles] = {memory, impl_->doorbells[0], impl_->doorbells[1]};
+        struct iovec iov;
+        iov.iov_base = &handshake;
+        iov.iov_len = sizeof(handshake);
+        union {
+            char buffer[CMSG_SPACE(handshakeFiles * sizeof(int))];
+            struct cmsghdr align;
+        } control;
+        (void)memset(control.buffer, 0, sizeof(control.buffer));
+        struct msghdr message;
+        (void)memset(&message, 0, sizeof(message));
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control.buffer;
+        message.msg_controllen = sizeof(control.buffer);
+        const auto controlMessage = CMSG_FIRSTHDR(&message);
+        controlMessage->cmsg_level = SOL_SOCKET;
+        controlMessage->cmsg_type = SCM_RIGHTS;
+        controlMessage->cmsg_len = CMSG_LEN(sizeof(files));
+        (void)memcpy(CMSG_DATA(controlMessage), files, sizeof(files));
+        const auto amountSent = sendmsg(impl_->socket, &message, MSG_NOSIGNAL);
+        (void)close(memory);
+        if (amountSent != (ssize_t)sizeof(handshake)) {
+            fprintf(stderr, "error: unable to send shared memory handshake\n");
+            return false;
+        }
+
+        // Start exchanging messages.
+        impl_->onReceived = onReceived;
+        impl_->onClosed = onClosed;
+        return Impl::StartWorker(impl_);
+    }
+
+}
@@ -0,0 +1,143 @@
+#include <algorithm>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <Sockets/Detail/SlabPool.hpp>
+#include <vector>
+
+namespace {
+
+    // This is the most blocks carved from one slab when the pool grows on
+    // demand, rather than by an explicit reservation.
+    constexpr size_t maximumBlocksPerSlab = 64;
+
+    constexpr size_t blockAlignment = alignof(std::max_align_t);
+
+}
+
+namespace Sockets {
+
+    struct SlabPool::Impl {
+        // Types
+
+        // Free blocks are linked through their own first bytes.
+        struct FreeBlock {
+            FreeBlock* next;
+        };
+
+        // Properties
+        mutable std::mutex mutex;
+        size_t blockSize = 0;
+        size_t blockCount = 0;
+        size_t blocksInUse = 0;
+        size_t blocksToReserve = 0;
+        FreeBlock* freeBlocks = nullptr;
+        std::vector< void* > slabs;
+
+        // Lifecycle
+
+        ~Impl() noexcept {
+            for (auto slab: slabs) {
+                ::operator delete(slab);
+            }
+        }
+
+        Impl(const Impl&) = delete;
+        Impl(Impl&&) noexcept = delete;
+        Impl& operator=(const Impl&) = delete;
+        Impl& operator=(Impl&&) noexcept = delete;
+
+        // Constructor
+        Impl() = default;
+
+        // Methods
+
+        void AddSlab(size_t blocks) {
+            const auto slab = static_cast< char* >(::operator new(blocks * blockSize));
+            slabs.push_back(slab);
+            for (size_t i = blocks; i > 0; --i) {
+                const auto block = reinterpret_cast< FreeBlock* >(slab + (i - 1) * blockSize);
+                block->next = freeBlocks;
+                freeBlocks = block;
+            }
+            blockCount += blocks;
+        }
+
+        bool IsPooledSize(size_t size) const {
+            return (
+                (size <= blockSize)
+                && (size + blockAlignment > blockSize)
+            );
+        }
+    };
+
+    SlabPool::~SlabPool() noexcept = default;
+
+    SlabPool::SlabPool()
+        : impl_(new Impl())
+    {
+    }
+
+    void* SlabPool::Allocate(size_t size) {
+        std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+        if (impl_->blockSize == 0) {
+            impl_->blockSize = (
+                (std::max(size, sizeof(Impl::FreeBlock)) + blockAlignment - 1)
+                / blockAlignment
+                * blockAlignment
+            );
+            if (impl_->blocksToReserve > 0) {
+                impl_->AddSlab(impl_->blocksToReserve);
+            }
+        }
+        if (!impl_->IsPooledSize(size)) {
+            return ::operator new(size);
+        }
+        if (impl_->freeBlocks == nullptr) {
+            impl_->AddSlab(
+                std::min(
+                    std::max(impl_->blockCount, (size_t)1),
+                    maximumBlocksPerSlab
+                )
+            );
+        }
+        const auto block = impl_->freeBlocks;
+        impl_->freeBlocks = block->next;
+        ++impl_->blocksInUse;
+        return block;
+    }
+
+    void SlabPool::Deallocate(void* block, size_t size) {
+        {
+            std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+            if (impl_->IsPooledSize(size)) {
+                const auto freeBlock = static_cast< Impl::FreeBlock* >(block);
+                freeBlock->next = impl_->freeBlocks;
+                impl_->freeBlocks = freeBlock;
+                --impl_->blocksInUse;
+                return;
+            }
+        }
+        ::operator delete(block);
+    }
+
+    size_t SlabPool::GetBlockCount() const {
+        std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+        return impl_->blockCount;
+    }
+
+    size_t SlabPool::GetBlocksInUse() const {
+        std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+        return impl_->blocksInUse;
+    }
+
+    void SlabPool::Reserve(size_t blocks) {
+        std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+        if (impl_->blockSize == 0) {
+            impl_->blocksToReserve = blocks;
+        } else if (blocks > impl_->blockCount) {
+            impl_->AddSlab(blocks - impl_->blockCount);
+        }
+    }
+
+}
@@ -0,0 +1,233 @@
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <memory>
+#include <signal.h>
+#include <Sockets/Detail/TraceBuffer.hpp>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <io.h>
+#define OPEN_FOR_DUMP(path) _open(path, _O_BINARY | _O_WRONLY | _O_CREAT | _O_TRUNC, _S_IREAD | _S_IWRITE)
+#define WRITE_DUMP _write
+#define CLOSE_DUMP _close
+#else /* POSIX */
+#include <unistd.h>
+#define OPEN_FOR_DUMP(path) open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)
+#define WRITE_DUMP write
+#define CLOSE_DUMP close
+#endif /* _WIN32 or POSIX */
+
+namespace {
+
+    struct Slot {
+        // This is one more than the index of the event held in the slot,
+        // or zero while the slot is being written.
+        std::atomic< uint64_t > sequence{0};
+
+        Sockets::Trace::Event event;
+    };
+
+    // Rings are never freed once made, so that they can be dumped safely at
+    // any time (including from a signal handler).  When a thread exits, its
+    // ring is released to be reused by the next thread which needs one.
+    struct Ring {
+        Ring* next = nullptr;
+        std::atomic< bool > inUse{true};
+        uint32_t id = 0;
+        size_t capacity = 0;
+        std::atomic< uint64_t > head{0};
+        std::unique_ptr< Slot[] > slots;
+    };
+
+    struct ThreadRing {
+        Ring* ring = nullptr;
+
+        ~ThreadRing() noexcept {
+            if (ring != nullptr) {
+                ring->inUse.store(false, std::memory_order_release);
+            }
+        }
+    };
+
+    constexpr size_t eventsPerDumpWrite = 64;
+    constexpr size_t maximumDumpPathLength = 4096;
+
+    std::atomic< Ring* > rings{nullptr};
+    std::atomic< uint32_t > nextRingId{0};
+    std::atomic< size_t > eventsPerThread{4096};
+    thread_local ThreadRing threadRing;
+    char dumpPath[maximumDumpPathLength];
+
+    Ring* AcquireRing() {
+        const auto capacity = eventsPerThread.load(std::memory_order_relaxed);
+        for (
+            auto ring = rings.load(std::memory_order_acquire);
+            ring != nullptr;
+            ring = ring->next
+        ) {
+            bool inUse = false;
+            if (
+                (ring->capacity == capacity)
+                && ring->inUse.compare_exchange_strong(inUse, true)
+            ) {
+                return ring;
+            }
+        }
+        auto ring = new Ring();
+        ring->id = nextRingId++;
+        ring->capacity = capacity;
+        ring->slots.reset(new Slot[capacity]);
+        ring->next = rings.load(std::memory_order_relaxed);
+        while (
+            !rings.compare_exchange_weak(
+                ring->next,
+                ring,
+                std::memory_order_release,
+                std::memory_order_relaxed
+            )
+        ) {
+        }
+        return ring;
+    }
+
+    bool WriteAll(int file, const void* data, size_t size) {
+        auto bytes = (const char*)data;
+        while (size > 0) {
+            const auto amountWritten = WRITE_DUMP(file, bytes, (unsigned int)size);
+            if (amountWritten <= 0) {
+                return false;
+            }
+            bytes += amountWritten;
+            size -= (size_t)amountWritten;
+        }
+        return true;
+    }
+
+    // This only uses async-signal-safe functions, and allocates nothing,
+    // so that it can be called from a signal handler.
+    bool DumpTo(const char* path) {
+        const int file = OPEN_FOR_DUMP(path);
+        if (file < 0) {
+            return false;
+        }
+        Sockets::Trace::FileHeader header;
+        (void)memcpy(header.magic, Sockets::Trace::magic, sizeof(header.magic));
+        header.version = Sockets::Trace::version;
+        header.eventSize = (uint32_t)sizeof(Sockets::Trace::Event);
+        bool success = WriteAll(file, &header, sizeof(header));
+        Sockets::Trace::Event events[eventsPerDumpWrite];
+        size_t numEvents = 0;
+        for (
+            auto ring = rings.load(std::memory_order_acquire);
+            success && (ring != nullptr);
+            ring = ring->next
+        ) {
+            const auto head = ring->head.load(std::memory_order_acquire);
+            const auto tail = (head > ring->capacity) ? head - ring->capacity : 0;
+            for (auto index = tail; index < head; ++index) {
+                const auto& slot = ring->slots[index % ring->capacity];
+                const auto sequence = slot.sequence.load(std::memory_order_acquire);
+                if (sequence != index + 1) {
+                    continue;
+                }
+                events[numEvents] = slot.event;
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot.sequence.load(std::memory_order_relaxed) != sequence) {
+                    continue;
+                }
+                if (++numEvents == eventsPerDumpWrite) {
+                    success = WriteAll(file, events, sizeof(events));
+                    numEvents = 0;
+                    if (!success) {
+                        break;
+                    }
+                }
+            }
+        }
+        if (success && (numEvents > 0)) {
+            success = WriteAll(file, events, numEvents * sizeof(*events));
+        }
+        (void)CLOSE_DUMP(file);
+        return success;
+    }
+
+    void OnDumpSignal(int) {
+        (void)DumpTo(dumpPath);
+    }
+
+}
+
+namespace Sockets {
+
+    std::atomic< bool > traceEnabled{false};
+
+    constexpr char Trace::magic[8];
+    constexpr uint32_t Trace::version;
+
+    void RecordTraceEvent(
+        Trace::EventType type,
+        int64_t socket,
+        uint64_t bytes
+    ) {
+        auto ring = threadRing.ring;
+        if (ring == nullptr) {
+            ring = threadRing.ring = AcquireRing();
+        }
+        const auto index = ring->head.load(std::memory_order_relaxed);
+        auto& slot = ring->slots[index % ring->capacity];
+        slot.sequence.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.event.timestamp = (uint64_t)std::chrono::duration_cast< std::chrono::nanoseconds >(
+            std::chrono::steady_clock::now().time_since_epoch()
+        ).count();
+        slot.event.bytes = bytes;
+        slot.event.socket = socket;
+        slot.event.thread = ring->id;
+        slot.event.type = (uint16_t)type;
+        slot.event.reserved = 0;
+        slot.sequence.store(index + 1, std::memory_order_release);
+        ring->head.store(index + 1, std::memory_order_release);
+    }
+
+    bool Trace::Dump(const std::string& path) {
+        return DumpTo(path.c_str());
+    }
+
+    const char* Trace::GetEventTypeName(EventType type) {
+        switch (type) {
+            case EventType::Accept: return "accept";
+            case EventType::Receive: return "recv";
+            case EventType::Send: return "send";
+            case EventType::PartialWrite: return "partial-write";
+            case EventType::WouldBlock: return "would-block";
+            case EventType::Wakeup: return "wakeup";
+            case EventType::Close: return "close";
+            case EventType::Error: return "error";
+            default: return "unknown";
+        }
+    }
+
+    bool Trace::InstallDumpSignalHandler(
+        int signalNumber,
+        const std::string& path
+    ) {
+        if (path.length() >= maximumDumpPathLength) {
+            return false;
+        }
+        (void)memcpy(dumpPath, path.c_str(), path.length() + 1);
+        return (signal(signalNumber, OnDumpSignal) != SIG_ERR);
+    }
+
+    bool Trace::IsEnabled() {
+        return traceEnabled.load(std::memory_order_relaxed);
+    }
+
+    void Trace::SetEnabled(bool enabled, size_t eventsPerThread) {
+        ::eventsPerThread = std::max(eventsPerThread, (size_t)1);
+        traceEnabled = enabled;
+    }
+
+}
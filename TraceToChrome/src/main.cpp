@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <inttypes.h>
+#include <Sockets/Trace.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+namespace {
+
+    // This function reads all the events from a trace file written by the
+    // Sockets library (see Sockets::Trace::Dump), checking the file header
+    // to make sure the file is one we know how to read.
+    bool ReadTrace(
+        FILE* input,
+        std::vector< Sockets::Trace::Event >& events
+    ) {
+        Sockets::Trace::FileHeader header;
+        if (fread(&header, sizeof(header), 1, input) != 1) {
+            fprintf(stderr, "error: unable to read trace file header\n");
+            return false;
+        }
+        if (
+            (memcmp(header.magic, Sockets::Trace::magic, sizeof(header.magic)) != 0)
+            || (header.version != Sockets::Trace::version)
+            || (header.eventSize != sizeof(Sockets::Trace::Event))
+        ) {
+            fprintf(stderr, "error: not a trace file, or unsupported version\n");
+            return false;
+        }
+        Sockets::Trace::Event event;
+        while (fread(&event, sizeof(event), 1, input) == 1) {
+            events.push_back(event);
+        }
+        return true;
+    }
+
+    // This function writes the given events in the Chrome Trace Event
+    // (JSON) format, which can be loaded by chrome://tracing or Perfetto.
+    // Each event becomes an "instant" event on a track for the ring buffer
+    // (thread) which recorded it.
+    void WriteChromeTrace(
+        FILE* output,
+        const std::vector< Sockets::Trace::Event >& events
+    ) {
+        const uint64_t start = (
+            events.empty()
+            ? 0
+            : events.front().timestamp
+        );
+        fprintf(output, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+        for (size_t i = 0; i < events.size(); ++i) {
+            const auto& event = events[i];
+            const auto nanoseconds = event.timestamp - start;
+            fprintf(
+                output,
+                "%s{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,"
+                "\"tid\":%" PRIu32 ",\"ts\":%" PRIu64 ".%03" PRIu64 ","
+                "\"args\":{\"socket\":%" PRId64 ",\"bytes\":%" PRIu64 "}}",
+                (i == 0) ? "" : ",\n",
+                Sockets::Trace::GetEventTypeName((Sockets::Trace::EventType)event.type),
+                event.thread,
+                nanoseconds / 1000,
+                nanoseconds % 1000,
+                event.socket,
+                event.bytes
+            );
+        }
+        fprintf(output, "\n]}\n");
+    }
+
+}
+
+int main(int argc, char* argv[]) {
+    if ((argc < 2) || (argc > 3)) {
+        fprintf(stderr, "usage: TraceToChrome <trace file> [<output JSON file>]\n");
+        return EXIT_FAILURE;
+    }
+
+    // Read all the events from the trace file.
+    FILE* input = fopen(argv[1], "rb");
+    if (input == NULL) {
+        fprintf(stderr, "error: unable to open \"%s\"\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    std::vector< Sockets::Trace::Event > events;
+    const auto readSuccessfully = ReadTrace(input, events);
+    (void)fclose(input);
+    if (!readSuccessfully) {
+        return EXIT_FAILURE;
+    }
+
+    // Events are grouped by ring buffer in the file, so put them back into
+    // the order in which they happened.
+    std::stable_sort(
+        events.begin(),
+        events.end(),
+        [](
+            const Sockets::Trace::Event& lhs,
+            const Sockets::Trace::Event& rhs
+        ) {
+            return lhs.timestamp < rhs.timestamp;
+        }
+    );
+
+    // Write the events out in the Chrome Trace Event format, either to
+    // the file given, or to standard output.
+    FILE* output = stdout;
+    if (argc == 3) {
+        output = fopen(argv[2], "w");
+        if (output == NULL) {
+            fprintf(stderr, "error: unable to open \"%s\"\n", argv[2]);
+            return EXIT_FAILURE;
+        }
+    }
+    WriteChromeTrace(output, events);
+    if (output != stdout) {
+        (void)fclose(output);
+    }
+    return EXIT_SUCCESS;
+}
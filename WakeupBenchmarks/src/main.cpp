@@ -0,0 +1,377 @@
+#include "PipeSignal.hpp"
+
+#include <atomic>
+#include <benchmark/benchmark.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <poll.h>
+#include <Sockets/Detail/Abstractions.hpp>
+#include <Sockets/LatencyHistogram.hpp>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#endif /* __linux__ */
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    uint64_t Now() {
+        return (uint64_t)std::chrono::duration_cast< std::chrono::nanoseconds >(
+            Clock::now().time_since_epoch()
+        ).count();
+    }
+
+    // Each of the following "wakers" is a different way for one thread to
+    // wake up another.  They all provide the same operations as PipeSignal
+    // (Set, Clear and IsSet), plus a blocking Wait, so that the same
+    // benchmarks can be run with each.
+
+    // This is the mechanism actually used by the event loop.
+    struct PipeWaker {
+        Sockets::PipeSignal signal;
+
+        PipeWaker() {
+            (void)signal.Initialize();
+        }
+
+        void Set() {
+            signal.Set();
+        }
+
+        void Clear() {
+            signal.Clear();
+        }
+
+        bool IsSet() {
+            return signal.IsSet();
+        }
+
+        void Wait() {
+            struct pollfd pollfd;
+            pollfd.fd = signal.GetSelectHandle();
+            pollfd.events = POLLIN;
+            (void)poll(&pollfd, 1, -1);
+        }
+    };
+
+#ifdef __linux__
+    // An eventfd can also be polled along with a socket, but setting it
+    // any number of times only ever needs one read to clear it.
+    struct EventFdWaker {
+        int fd = eventfd(0, EFD_NONBLOCK);
+
+        ~EventFdWaker() {
+            (void)close(fd);
+        }
+
+        void Set() {
+            const uint64_t one = 1;
+            (void)write(fd, &one, sizeof(one));
+        }
+
+        void Clear() {
+            uint64_t count;
+            (void)read(fd, &count, sizeof(count));
+        }
+
+        bool IsSet() {
+            struct pollfd pollfd;
+            pollfd.fd = fd;
+            pollfd.events = POLLIN;
+            return (poll(&pollfd, 1, 0) > 0);
+        }
+
+        void Wait() {
+            struct pollfd pollfd;
+            pollfd.fd = fd;
+            pollfd.events = POLLIN;
+            (void)poll(&pollfd, 1, -1);
+        }
+    };
+
+    // A futex can't be waited on along with a socket, but setting and
+    // testing it only needs a system call when there's a transition.
+    struct FutexWaker {
+        std::atomic< uint32_t > word{0};
+
+        void Set() {
+            if (word.exchange(1, std::memory_order_release) == 0) {
+                (void)syscall(SYS_futex, &word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+            }
+        }
+
+        void Clear() {
+            word.store(0, std::memory_order_relaxed);
+        }
+
+        bool IsSet() {
+            return (word.load(std::memory_order_acquire) != 0);
+        }
+
+        void Wait() {
+            while (word.load(std::memory_order_acquire) == 0) {
+                (void)syscall(SYS_futex, &word, FUTEX_WAIT_PRIVATE, 0, NULL, NULL, 0);
+            }
+        }
+    };
+#endif /* __linux__ */
+
+    // This is the portable standard library way, for comparison.
+    struct ConditionWaker {
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool set = false;
+
+        void Set() {
+            std::lock_guard< decltype(mutex) > lock(mutex);
+            set = true;
+            condition.notify_one();
+        }
+
+        void Clear() {
+            std::lock_guard< decltype(mutex) > lock(mutex);
+            set = false;
+        }
+
+        bool IsSet() {
+            std::lock_guard< decltype(mutex) > lock(mutex);
+            return set;
+        }
+
+        void Wait() {
+            std::unique_lock< decltype(mutex) > lock(mutex);
+            condition.wait(lock, [this]{ return set; });
+        }
+    };
+
+    void ReportLatencies(
+        benchmark::State& state,
+        const Sockets::LatencyHistogram& latencies
+    ) {
+        state.counters["p50_ns"] = (double)latencies.GetPercentile(50.0);
+        state.counters["p99_ns"] = (double)latencies.GetPercentile(99.0);
+        state.counters["p999_ns"] = (double)latencies.GetPercentile(99.9);
+    }
+
+    // This measures the cost of setting and then clearing a signal, with
+    // nobody waiting on it.
+    template< typename Waker > void SetClear(benchmark::State& state) {
+        Waker waker;
+        for (auto _: state) {
+            waker.Set();
+            waker.Clear();
+        }
+    }
+
+    // This measures the cost of testing a signal which isn't set.
+    template< typename Waker > void IsSet(benchmark::State& state) {
+        Waker waker;
+        for (auto _: state) {
+            benchmark::DoNotOptimize(waker.IsSet());
+        }
+    }
+
+    // This measures how well a burst of signals is coalesced: the signal is
+    // set a number of times in a row, and then cleared until it no longer
+    // appears set.  Each clear stands for one wake-up of the waiting thread.
+    template< typename Waker > void DrainBurst(benchmark::State& state) {
+        Waker waker;
+        const auto burstSize = state.range(0);
+        uint64_t wakeups = 0;
+        for (auto _: state) {
+            for (int64_t i = 0; i < burstSize; ++i) {
+                waker.Set();
+            }
+            while (waker.IsSet()) {
+                waker.Clear();
+                ++wakeups;
+            }
+        }
+        state.counters["wakeupsPerBurst"] = benchmark::Counter(
+            (double)wakeups,
+            benchmark::Counter::kAvgIterations
+        );
+    }
+
+    // This measures the latency of waking up another thread: one thread
+    // sets a signal and the other, waiting on it, notes how long it took to
+    // wake up, before setting a second signal to hand control back.  The
+    // reported time is for the whole round trip; the percentiles are for
+    // the one-way wake-up.
+    template< typename Waker > void PingPong(benchmark::State& state) {
+        Waker ping;
+        Waker pong;
+        std::atomic< bool > done{false};
+        std::atomic< uint64_t > sentAt{0};
+        Sockets::LatencyHistogram latencies;
+        std::thread waiter(
+            [&]{
+                for (;;) {
+                    ping.Wait();
+                    const auto now = Now();
+                    ping.Clear();
+                    if (done) {
+                        break;
+                    }
+                    latencies.Record(now - sentAt.load());
+                    pong.Set();
+                }
+            }
+        );
+        for (auto _: state) {
+            const auto start = Clock::now();
+            sentAt = Now();
+            ping.Set();
+            pong.Wait();
+            pong.Clear();
+            state.SetIterationTime(
+                std::chrono::duration< double >(Clock::now() - start).count()
+            );
+        }
+        done = true;
+        ping.Set();
+        waiter.join();
+        ReportLatencies(state, latencies);
+    }
+
+    // This is shared between the benchmark and an event loop's worker,
+    // counting calls to the socket ready delegate and timing how long they
+    // took to come after a user event was signaled.
+    struct EventLoopProbe {
+        std::atomic< uint64_t > callbacks{0};
+        std::atomic< uint64_t > sentAt{0};
+        Sockets::LatencyHistogram latencies;
+
+        bool OnSocketReady() {
+            const auto signaledAt = sentAt.exchange(0);
+            if (signaledAt != 0) {
+                latencies.Record(Now() - signaledAt);
+            }
+            callbacks.fetch_add(1, std::memory_order_release);
+            return true;
+        }
+    };
+
+    // This measures the whole path taken when another thread sends a
+    // message: SocketEventLoop::UserEvent signals the worker, which wakes
+    // up from waiting on the socket and calls the socket ready delegate.
+    void EventLoopUserEvent(benchmark::State& state) {
+        int sockets[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0) {
+            state.SkipWithError("unable to create socket pair");
+            return;
+        }
+        const auto probe = std::make_shared< EventLoopProbe >();
+        {
+            Sockets::SocketEventLoop eventLoop;
+            (void)eventLoop.Start(
+                sockets[0],
+                []{ return false; },
+                [probe]{ return probe->OnSocketReady(); }
+            );
+            for (auto _: state) {
+                const auto start = Clock::now();
+                const auto before = probe->callbacks.load(std::memory_order_acquire);
+                probe->sentAt = Now();
+                eventLoop.UserEvent();
+                while (probe->callbacks.load(std::memory_order_acquire) == before) {
+                }
+                state.SetIterationTime(
+                    std::chrono::duration< double >(Clock::now() - start).count()
+                );
+            }
+        }
+        ReportLatencies(state, probe->latencies);
+        (void)close(sockets[0]);
+        (void)close(sockets[1]);
+    }
+
+    // This measures how many times the event loop's worker wakes up to call
+    // the socket ready delegate when a burst of user events is signaled
+    // (for example, when many messages are sent at once).
+    void EventLoopBurst(benchmark::State& state) {
+        int sockets[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0) {
+            state.SkipWithError("unable to create socket pair");
+            return;
+        }
+        const auto burstSize = state.range(0);
+        const auto probe = std::make_shared< EventLoopProbe >();
+        uint64_t callbacks = 0;
+        {
+            Sockets::SocketEventLoop eventLoop;
+            (void)eventLoop.Start(
+                sockets[0],
+                []{ return false; },
+                [probe]{ return probe->OnSocketReady(); }
+            );
+            for (auto _: state) {
+                const auto start = Clock::now();
+                const auto before = probe->callbacks.load(std::memory_order_acquire);
+                for (int64_t i = 0; i < burstSize; ++i) {
+                    eventLoop.UserEvent();
+                }
+
+                // Wait for the worker to go quiet, which we take to mean no
+                // more calls for 100 microseconds.
+                auto lastCount = before;
+                auto lastChange = Clock::now();
+                for (;;) {
+                    const auto count = probe->callbacks.load(std::memory_order_acquire);
+                    const auto now = Clock::now();
+                    if (count != lastCount) {
+                        lastCount = count;
+                        lastChange = now;
+                    } else if (
+                        (count != before)
+                        && (now - lastChange >= std::chrono::microseconds(100))
+                    ) {
+                        break;
+                    }
+                }
+                callbacks += lastCount - before;
+                state.SetIterationTime(
+                    std::chrono::duration< double >(lastChange - start).count()
+                );
+            }
+        }
+        state.counters["callbacksPerBurst"] = benchmark::Counter(
+            (double)callbacks,
+            benchmark::Counter::kAvgIterations
+        );
+        (void)close(sockets[0]);
+        (void)close(sockets[1]);
+    }
+
+}
+
+BENCHMARK_TEMPLATE(SetClear, PipeWaker);
+BENCHMARK_TEMPLATE(IsSet, PipeWaker);
+BENCHMARK_TEMPLATE(DrainBurst, PipeWaker)->Arg(16);
+BENCHMARK_TEMPLATE(PingPong, PipeWaker)->UseManualTime();
+#ifdef __linux__
+BENCHMARK_TEMPLATE(SetClear, EventFdWaker);
+BENCHMARK_TEMPLATE(IsSet, EventFdWaker);
+BENCHMARK_TEMPLATE(DrainBurst, EventFdWaker)->Arg(16);
+BENCHMARK_TEMPLATE(PingPong, EventFdWaker)->UseManualTime();
+BENCHMARK_TEMPLATE(SetClear, FutexWaker);
+BENCHMARK_TEMPLATE(IsSet, FutexWaker);
+BENCHMARK_TEMPLATE(DrainBurst, FutexWaker)->Arg(16);
+BENCHMARK_TEMPLATE(PingPong, FutexWaker)->UseManualTime();
+#endif /* __linux__ */
+BENCHMARK_TEMPLATE(SetClear, ConditionWaker);
+BENCHMARK_TEMPLATE(IsSet, ConditionWaker);
+BENCHMARK_TEMPLATE(DrainBurst, ConditionWaker)->Arg(16);
+BENCHMARK_TEMPLATE(PingPong, ConditionWaker)->UseManualTime();
+BENCHMARK(EventLoopUserEvent)->UseManualTime();
+BENCHMARK(EventLoopBurst)->Arg(1)->Arg(16)->UseManualTime();
+
+BENCHMARK_MAIN();